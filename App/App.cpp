@@ -4,11 +4,15 @@
 #include <sgx_uswitchless.h>
 #include "Enclave_u.h"
 #include "log.h"
+#include "utils.h"
+#include <thread>
+#include <vector>
 // #include "utils.h"
 
 /* Global EID shared by multiple threads */
 sgx_enclave_id_t global_eid = 0;
 bool enclave_created = false;
+bool enclave_switchless = false;
 
 /* Check error conditions for loading enclave */
 void print_error_message(sgx_status_t ret) {
@@ -28,15 +32,24 @@ void print_error_message(sgx_status_t ret) {
         log_error("Unexpected error occurred.");
 }
 
+/* Untrusted switchless workers mark their thread on start, so the ocalls they serve can be told
+ * apart from ones that made the calling thread leave the enclave */
+static void mark_switchless_worker(sgx_uswitchless_worker_type_t type, sgx_uswitchless_worker_event_t event,
+                                   const sgx_uswitchless_worker_stats_t* stats) {
+    if (type == SGX_USWITCHLESS_WORKER_TYPE_UNTRUSTED)
+        utils::is_switchless_worker = true;
+}
+
 /* Initialize the enclave:
  *   Call sgx_create_enclave to initialize an enclave instance
  */
-int initialize_enclave(bool enable_sgx_switchless) {
+int initialize_enclave(bool enable_sgx_switchless, int num_uworkers) {
     /* Configuration for Switchless SGX */
     sgx_uswitchless_config_t us_config = SGX_USWITCHLESS_CONFIG_INITIALIZER;
-    /* The only entry to set partition nums */
-    us_config.num_uworkers = 2;
-    us_config.num_tworkers = 2;
+    /* Untrusted workers serve the ocalls marked transition_using_threads; no ecall is switchless */
+    us_config.num_uworkers = num_uworkers;
+    us_config.num_tworkers = 0;
+    us_config.callback_func[SGX_USWITCHLESS_WORKER_EVENT_START] = mark_switchless_worker;
 
     sgx_status_t ret;
 
@@ -73,9 +86,54 @@ int initialize_enclave(bool enable_sgx_switchless) {
         log_error("ecall failed");
     }
     enclave_created = true;
+    enclave_switchless = enable_sgx_switchless;
     return 0;
 }
 
+void destroy_enclave() {
+    if (!enclave_created)
+        return;
+    stop_enclave_workers();
+    sgx_destroy_enclave(global_eid);
+    enclave_created = false;
+}
+
+/* Host threads parked inside the enclave as workers of its thread pool */
+static std::vector<std::thread> enclave_workers;
+
+void stop_enclave_workers() {
+    if (enclave_workers.empty())
+        return;
+    int ret;
+    sgx_status_t ecall_status = ecall_thread_pool_stop(global_eid, &ret);
+    if (ecall_status) {
+        print_error_message(ecall_status);
+        log_error("ecall failed");
+    }
+    for (auto& worker : enclave_workers)
+        worker.join();
+    enclave_workers.clear();
+}
+
+/* Start num_workers host threads that enter the enclave and serve its thread pool.
+ * Each one occupies a TCS for the lifetime of the enclave, so keep num_workers below TCSNum. */
+void start_enclave_workers(int num_workers) {
+    if (!enclave_workers.empty() || num_workers <= 0)
+        return;
+    for (int i = 0; i < num_workers; i++) {
+        enclave_workers.emplace_back([i]() {
+            int ret;
+            sgx_status_t ecall_status = ecall_thread_pool_worker(global_eid, &ret, i);
+            if (ecall_status) {
+                print_error_message(ecall_status);
+                log_error("ecall failed");
+            }
+        });
+    }
+    std::atexit(stop_enclave_workers);
+    log_info("%d enclave worker threads started", num_workers);
+}
+
 // OCALLs implementation
 int ocall_print_msg(const char* str, size_t len) {
     char* buf = (char*)malloc(sizeof(char) * (len + 1));
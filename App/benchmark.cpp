@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include "App.h"
+#include "Enclave_u.h"
 #include "GlobalTable.h"
 #include "log.h"
 #include "utils.h"
@@ -28,6 +29,8 @@ void print_result() {
     std::cout << "TIME COMM = " << read_write_ms << " ms" << std::endl;
     std::cout << "TIME COMP = " << comp_ms << " ms" << std::endl;
     std::cout << "SIZE COMM = " << total_comm << std::endl;
+    std::cout << "OCALLS = " << ocall_count << " (" << switchless_ocall_count << " switchless, "
+        << ocall_count - switchless_ocall_count << " enclave transitions)" << std::endl;
     std::cout << "*** TIME TOTAL = " << read_write_ms + comp_ms << " ms ***" << std::endl;
     std::cout << "*** SIZE COMM/IN = " << (float)total_comm / (N + M) << " ***" << std::endl
         << std::endl;
@@ -200,10 +203,43 @@ void join(const po::variables_map& vm) {
     print_result();
 }
 
+// time the enclave compare-exchange kernels on 2-, 3-, 4- and 8-column tuples (rows of 3, 4, 5 and 9
+// ints with the dummy flag), for every simd level available on this machine
+void cswap(const po::variables_map& vm) {
+    if (utils::is_distributed) {
+        log_error("Cannot run cswap benchmark in distributed setting!");
+    }
+    int rows = vm["cswap.rows"].as<int>();
+    int rounds = vm["cswap.rounds"].as<int>();
+    const char* level_names[] = { "scalar", "sse", "avx2", "avx512" };
+    for (int num_columns : { 2, 3, 4, 8 }) {
+        double scalar_ms = 0;
+        for (int level = utils::SIMD_NONE; level <= utils::simd_level; level++) {
+            int ret;
+            ecall_setup_simd(global_eid, &ret, level);
+            auto start = std::chrono::high_resolution_clock::now();
+            sgx_status_t ecall_status = ecall_bench_cswap(global_eid, &ret, num_columns, rows, rounds);
+            auto end = std::chrono::high_resolution_clock::now();
+            if (ecall_status) {
+                print_error_message(ecall_status);
+                log_error("ecall failed");
+            }
+            double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            if (level == utils::SIMD_NONE)
+                scalar_ms = ms;
+            std::cout << "columns=" << num_columns << " " << level_names[level] << ": " << std::fixed << std::setprecision(3)
+                << ms << " ms, speedup " << scalar_ms / ms << std::endl;
+        }
+    }
+    int ret;
+    ecall_setup_simd(global_eid, &ret, utils::simd_level);
+}
+
 const std::unordered_map<std::string, std::function<void(const po::variables_map& vm)>> task_string_map = {
     {"join",       join      },
     {"pkjoin",     pkjoin    },
-    {"opartition", opartition}
+    {"opartition", opartition},
+    {"cswap",      cswap     }
 };
 
 po::variables_map read_settings(int argc, char** argv) {
@@ -230,6 +266,8 @@ po::variables_map read_settings(int argc, char** argv) {
     task_desc.add_options()("join.config.3.table", po::value<std::string>());
     task_desc.add_options()("join.config.3.prob", po::value<std::string>());
     task_desc.add_options()("join.alg", po::value<std::string>());
+    task_desc.add_options()("cswap.rows", po::value<int>()->default_value(1 << 20));
+    task_desc.add_options()("cswap.rounds", po::value<int>()->default_value(20));
 
     log_info("Read task file start");
     po::variables_map task_vm;
@@ -53,6 +53,7 @@
 
 extern sgx_enclave_id_t global_eid; /* global enclave id */
 extern bool enclave_created;
+extern bool enclave_switchless; /* created with switchless ocalls enabled */
 
 typedef struct sgx_errlist_t_ {
   sgx_status_t err;
@@ -83,7 +84,10 @@ static sgx_errlist_t sgx_errlist[] = {
 };
 
 void print_error_message(sgx_status_t ret);
-int initialize_enclave(bool enable_sgx_switchless);
+int initialize_enclave(bool enable_sgx_switchless, int num_uworkers = 2);
+void destroy_enclave();
+void start_enclave_workers(int num_workers);
+void stop_enclave_workers();
 
 #if defined(__cplusplus)
 extern "C" {
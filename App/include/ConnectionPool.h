@@ -0,0 +1,48 @@
+#pragma once
+
+#include <folly/SocketAddress.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Keep-alive HTTP/1.1 sessions to the coordinator and the workers, kept open between requests. A
+ * connection owns the EventBase its session lives on, so any thread can borrow it (one at a time),
+ * drive the request with loopOnce and give it back. A session the peer has closed in the meantime
+ * notices on the next loop and is dropped instead of reused. */
+class PooledConnection : public proxygen::HTTPSessionBase::InfoCallback {
+  public:
+    folly::EventBase evb;
+    folly::HHWheelTimer::UniquePtr timer;
+    proxygen::HTTPUpstreamSession* session{nullptr};
+    std::string destination;
+
+    ~PooledConnection() override;
+    // whether the session is still open and can take another request
+    bool reusable();
+
+    void onDestroy(const proxygen::HTTPSessionBase&) override {
+        session = nullptr;
+    }
+};
+
+class ConnectionPool {
+  public:
+    // an open connection to addr: an idle one if there is any, else a new one; nullptr if connecting fails
+    std::unique_ptr<PooledConnection> acquire(const folly::SocketAddress& addr, int connect_timeout_ms);
+    // keep conn for the next request to the same destination, or close it if it can not be reused
+    void release(std::unique_ptr<PooledConnection> conn);
+
+  private:
+    std::unique_ptr<PooledConnection> connect(const folly::SocketAddress& addr, int connect_timeout_ms);
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<std::unique_ptr<PooledConnection>>> idle;
+};
+
+// never destroyed, so no session is torn down after proxygen's statics at exit
+extern ConnectionPool* connection_pool;
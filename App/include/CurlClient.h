@@ -144,6 +144,11 @@ class CurlClient
         return task_ret;
     }
 
+    // whether the transaction has finished, with a response or an error
+    bool isDone() const {
+        return done_;
+    }
+
   protected:
     void sendBodyFromFile();
 
@@ -182,6 +187,7 @@ class CurlClient
 
     friend class CurlPushHandler;
     std::string task_ret;
+    bool done_{false};
 };
 
 }  // namespace CurlService
@@ -44,7 +44,19 @@ class EchoHandler : public proxygen::RequestHandler {
   EchoStats* const stats_{nullptr};
   std::ofstream fileStream_;
   std::unique_ptr<folly::IOBuf> body_;
-  std::string ret;
+  void sendResponse(const std::string& body_ret);
+  void sendBadRequest();
+
+  bool is_rpc_{false};
+  std::string request_;  // the binary request of an rpc task
+  bool task_running_{false};  // the task runs on task_executor, see onEOM
+  bool aborted_{false};       // the request failed while its task was running
+  // a shuffle file from another worker, in a buffer from utils::host_buffers
+  std::string chunk_name_;
+  uint8_t* chunk_{nullptr};
+  size_t chunk_length_{0};
+  size_t chunk_capacity_{0};
+  bool bad_request_{false};  // malformed, answered with 400 on EOM and otherwise dropped
 };
 
 } // namespace EchoService
@@ -10,14 +10,25 @@
 
 extern sgx_enclave_id_t global_eid; /* global enclave id */
 
+/* How the rows of a table are laid out, as far as the coordinator knows. The operators keep it up to date
+ * and skip the sorts and shuffles whose result is already there; it only depends on the plan, so skipping
+ * them reveals nothing about the data. */
+struct PhysicalProperties {
+    std::vector<int> sorted_on;      // every partition is sorted on these columns, dummies last; empty if not known
+    bool range_partitioned = false;  // and partition i comes before partition i + 1 in that order
+    std::vector<int> hash_key;       // rows with equal key are in the partition this key hashes to; empty if not known
+    int hash_seed = -1;              // the seed of that hash
+};
+
 class GlobalTable {
 public:
     static int TOTAL;
     // GlobalTable(const char *filePath, int num_partitions);
     GlobalTable(const char* filePath, sgx_enclave_id_t eid = global_eid);
     GlobalTable(const std::string& filePath, sgx_enclave_id_t eid = global_eid) : GlobalTable(filePath.c_str(), eid) {}
-    GlobalTable(std::vector<LocalTable>& local_tables, const std::vector<std::string> column_names);
+    GlobalTable(std::vector<LocalTable>& local_tables, const std::vector<std::string> column_names, int num_columns = -1, std::vector<int> sizes = {}, PhysicalProperties properties = {});
     ~GlobalTable();
+    // both are answered from what the coordinator tracks; only what it cannot derive is asked from the partitions
     const int size();
     const int numColumns();
     GlobalTable copy();
@@ -58,6 +69,7 @@ public:
     void sodaGroupByAggregate(AssociateOperator& op);
     void soda_shuffleByKey(const std::vector<int>& cols);
     int expansion(int d_index, long long M, bool delete_expand_col = true);
+    // changes made directly on the local tables are not seen by numColumns(), size() and the physical properties
     std::vector<LocalTable>& getLocalTables();
     int appendCol(int defaultVal);
 
@@ -73,6 +85,22 @@ private:
     std::string m_filePath;
     std::vector<LocalTable> m_localTables;
     std::vector<std::string> m_columnNames;
+    // kept up to date by the operators, -1 where not known; checked against the partitions if utils::verify_metadata
+    int m_numColumns;
+    std::vector<int> m_sizes;  // rows of each partition, dummies included
+    void addColumns(int count);
+    void setSizes(int n);  // every partition now has n rows
+    void forgetSizes();
+    PhysicalProperties m_properties;
+    // columns is a prefix of the columns every partition is sorted on, or of those the whole table is sorted on
+    bool locallySortedOn(const std::vector<int>& columns) const;
+    bool sortedOn(const std::vector<int>& columns) const;
+    bool hashPartitionedOn(const std::vector<int>& key, int seed) const;
+    void forgetOrder();
+    void forgetProperties();
+    void remapProperties(const std::vector<int>& columns);  // the new column i is the old column columns[i]
+    void insertColumns(int pos, int count);                 // count columns were inserted before column pos
+    void changedColumn(int column);                          // the values of column may have changed
     // Statistics &m_stat;
     // Load data into the Table 
     void loadDataFromFile(const char* filePath, std::vector<Tuple>& output);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+/* Host buffers the enclave seals shuffle files into. A buffer moves from the pool to the enclave
+ * (acquire), through ocall_write_file to the transport, and comes back once it has been sent, written
+ * out, or read by the target partition (release). Every phase ships partitions of about the same
+ * padded size, so after the first one the pool serves every acquire from a buffer it already has and
+ * no shuffle write allocates or page-faults in a fresh buffer. The idle buffers are capped in bytes, so
+ * one large shuffle does not pin its buffers for the rest of the run. */
+class HostBufferPool {
+  public:
+    explicit HostBufferPool(size_t max_idle_bytes = (size_t)1 << 30) : max_idle_bytes(max_idle_bytes) {}
+    ~HostBufferPool();
+    // a buffer of at least size bytes: the smallest idle one that fits, or a new one
+    uint8_t* acquire(size_t size);
+    // give back a buffer from acquire
+    void release(uint8_t* buffer);
+    // free the idle buffers
+    void clear();
+    // keep at most this many bytes of idle buffers, freeing the smallest first
+    void setMaxIdleBytes(size_t bytes);
+
+  private:
+    std::mutex mutex;
+    std::multimap<size_t, uint8_t*> idle;          // capacity -> buffer
+    std::unordered_map<uint8_t*, size_t> lent;    // buffer -> capacity
+    size_t max_idle_bytes;
+    size_t idle_bytes = 0;
+
+    // free idle buffers until they fit max_idle_bytes; the caller holds mutex
+    void trim();
+};
@@ -5,6 +5,54 @@
 #include "Operators.h"
 #include "Tuple.h"
 
+/* Local steps for one partition, sent as one message and run back to back in one ecall (see
+ * LocalTable::run), so a stage costs one round trip up to its next data exchange instead of one per
+ * step. The steps mean the same as the LocalTable methods of the same name. */
+class LocalPlan {
+public:
+  // keep in sync with PlanOp in Enclave/LocalTable.h
+  enum Op {
+    ADD_COL,
+    COPY_COL,
+    DELETE_COL,
+    PROJECT,
+    MV_JOIN_COLS_AHEAD,
+    LOCAL_SORT,
+    FOREIGN_TABLE_MODIFY_COL_Z,
+    REMOVE_DUP_AFTER_PREFIX,
+    FINALIZE_PKJOIN_RESULT,
+    EXPANSION_PREPARE,
+    ADD_AND_CALCULATE_COL_T_P,
+    EXPANSION_DISTRIBUTE_AND_CLEAR,
+    JOIN_COMPUTE_ALIGNMENT
+  };
+
+  LocalPlan() {}
+  // the steps of a plan received from the coordinator
+  explicit LocalPlan(std::vector<int> steps) : steps(std::move(steps)) {}
+
+  LocalPlan& addCol(int defaultVal, int col_index = -1);
+  LocalPlan& copyCol(int col_index = -1);
+  LocalPlan& deleteCol(int col_index = -1);
+  LocalPlan& project(const std::vector<int>& columns);
+  LocalPlan& mvJoinColsAhead(const std::vector<int>& join_cols);
+  LocalPlan& localSort(const std::vector<int>& columns);
+  LocalPlan& foreignTableModifyColZ(const std::vector<int>& columns);
+  LocalPlan& remove_dup_after_prefix(const std::vector<int>& columns);
+  LocalPlan& finalizePkjoinResult(const std::vector<int>& columns, int ori_r_col_num, int r_align_col_num);
+  LocalPlan& expansion_prepare(int d_index);
+  LocalPlan& add_and_calculate_col_t_p(int d_index, int m);
+  LocalPlan& expansion_distribute_and_clear(int m);
+  LocalPlan& joinComputeAlignment(int m);
+
+  // each step is its opcode and its arguments; a list argument is its length, then its elements
+  const std::vector<int>& data() const { return steps; }
+
+private:
+  LocalPlan& put(const std::vector<int>& list);
+  std::vector<int> steps;
+};
+
 class LocalTable {
 public:
   LocalTable(int global_id_, int id_, std::string filePath, bool is_distributed = false, std::string url = "");
@@ -31,16 +79,18 @@ public:
   void randomShuffle(int num_partitions);
   void shuffleByKey(int num_partitions, const std::vector<int> key, int seed, int size_bound);
   void shuffleByCol(int num_partitions, int i_col_id, int size_bound);
-  void shuffleMerge(int num_partitions);
+  // first round of a two-round shuffle: at most size_bound tuples per target, and overflow_bound
+  // tuples of overflow go to partition 0, whose shuffleRelay sends them on
+  void shuffleByKeyTwoRound(int num_partitions, const std::vector<int> key, int seed, int size_bound, int overflow_bound);
+  void shuffleRelay(int num_partitions, int overflow_bound);
+  void shuffleMerge(int num_partitions, bool relayed = false);
   // sort table by columns (dictionary order); dummy tuples are always moved to the end
   // Note: this project operation does not elimiate duplicate tuples!
   // Note2: if project the same column for multiple times, then getColumnIdsByNames may not work correctly due to duplicate names
   void removeDummy();
   long long sum(int column);
-  // Please ensure that the tuples are already sorted by the group by columns; return the last non-dummy tuple
-  Tuple groupByPrefixAggregate(AssociateOperator& op, int phase = 1, bool reverse = false);
-  // Which is used for groupByPrefixAggregate only
-  void _addValueByKey(AssociateOperator& op);
+  // round of GlobalTable::groupByPrefixAggregate: 0 aggregates the partition, the rest combine the other partitions
+  Tuple groupByPrefixAggregate(AssociateOperator& op, int round, bool reverse = false);
   // Please ensure that the tuples are already sorted by the group by columns
   void groupByAggregate(AssociateOperator& op);
   void sample(double rate, std::vector<Tuple>& output);
@@ -49,6 +99,7 @@ public:
   // void expandMoveStep2(int column);
   // void distribute1(int column, int num_partitions, int output_size, std::vector<std::vector<Tuple>> &output);
   // void distribute2(int column, int output_size);
+  void samplePivots(int sample_size);  // send a random sample of sample_size rows to local_table 0 for getPivots
   void getPivots(const std::vector<int> columns);
   void sortMerge(const std::vector<int> columns);
   void localSort(const std::vector<int> columns);
@@ -60,11 +111,12 @@ public:
   void copyCol(int col_index = -1);                                                                   // the new col will copy the last column and add to the last by default
   void expansion_prepare(int d_index);
   void add_and_calculate_col_t_p(int d_index, int m);
-  void expansion_suffix_sum(int phase);
   void expansion_distribute_and_clear(int m);
   void remove_dup_after_prefix(const std::vector<int>& columns);
   void project(const std::vector<int>& columns);
   void deleteCol(int col_index = -1);
+  // run the steps of plan in order
+  void run(const LocalPlan& plan);
   int getId() const;
   int getGlobalId();
 
@@ -59,7 +59,7 @@ class OperatorMin : public AssociateOperator {
 
 class OperatorCopy : public AssociateOperator {
   public:
-    OperatorCopy() {}
+    OperatorCopy() : AssociateOperator({}, -1, 0, COPY) {}
 
     bool apply(Tuple& a, Tuple& b) {
         return false;
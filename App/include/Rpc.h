@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Operators.h"
+
+/* Binary requests from the coordinator to a worker. A request is one opcode byte followed by the
+ * arguments, a response is one status byte followed by the return value, if any. Every argument is a
+ * typed field [type: 1 byte][length: 4 bytes][payload], read back in the order it was written.
+ * Numbers are in host byte order: the coordinator and the workers run the same build. */
+namespace rpc {
+
+// one per task a worker runs; keep op_names in Rpc.cpp in the same order
+enum Op : uint8_t {
+    READ_CONFIG_FILE,
+    CREATE_LOCAL_TABLE,
+    COPY,
+    SIZE,
+    SUM,
+    MAX,
+    SODA_STEP1,
+    SODA_STEP2,
+    SODA_STEP3,
+    LOCAL_JOIN,
+    SODA_STEP5,
+    ASSIGN_COL_E,
+    NUM_COLUMNS,
+    PRINT,
+    UNION_TABLE,
+    PAD_TO_SIZE,
+    OPAQUE_PREPARE_SHUFFLE_COL,
+    SHUFFLE_MERGE,
+    RANDOM_SHUFFLE,
+    SHUFFLE_BY_KEY,
+    SHUFFLE_BY_KEY_TWO_ROUND,
+    SHUFFLE_RELAY,
+    SHUFFLE_BY_COL,
+    PARTITION_BY_PIVOTS,
+    GROUP_BY_PREFIX_AGGREGATE,
+    GROUP_BY_AGGREGATE,
+    MV_JOIN_COLS_AHEAD,
+    PK_JOIN_COMBINE,
+    FOREIGN_TABLE_MODIFY_COL_Z,
+    REMOVE_DUP_AFTER_PREFIX,
+    FINALIZE_PKJOIN_RESULT,
+    JOIN_COMPUTE_ALIGNMENT,
+    JOIN_FINAL_COMBINE,
+    SORT_MERGE,
+    PROJECT,
+    SAMPLE_PIVOTS,
+    GET_PIVOTS,
+    LOCAL_SORT,
+    EXPANSION_PREPARE,
+    COPY_COL,
+    ADD_COL,
+    ADD_AND_CALCULATE_COL_T_P,
+    EXPANSION_DISTRIBUTE_AND_CLEAR,
+    DELETE_COL,
+    SODA_SHUFFLE_BY_KEY,
+    DESTROY,
+    GET_COMM_AND_RESET,
+    RUN_PLAN,
+    NUM_OPS
+};
+
+extern const char* const op_names[NUM_OPS];
+
+enum Status : uint8_t { OK, FAILED };
+
+class Writer {
+  public:
+    // a response, which the caller starts with a Status
+    Writer() {}
+    // a request for op
+    explicit Writer(Op op) {
+        buf.push_back((char)op);
+    }
+
+    Writer& put(int value);
+    Writer& put(long long value);
+    Writer& put(const std::vector<int>& values);
+    Writer& put(const std::string& value);
+    Writer& put(const AssociateOperator& op);
+    Writer& put(Status status) {
+        buf.push_back((char)status);
+        return *this;
+    }
+
+    const std::string& data() const {
+        return buf;
+    }
+
+  private:
+    void field(uint8_t type, const void* payload, uint32_t length);
+    std::string buf;
+};
+
+// the fields of a request after its opcode, or of a response after its status; a field missing or of
+// another type than asked for throws std::runtime_error
+class Reader {
+  public:
+    explicit Reader(std::string data) : buf(std::move(data)) {}
+
+    uint8_t head();  // the opcode or the status
+    int get_int();
+    long long get_long();
+    std::vector<int> get_ints();
+    std::string get_string();
+    std::unique_ptr<AssociateOperator> get_operator();
+
+  private:
+    const char* field(uint8_t type, uint32_t* length);
+    std::string buf;
+    size_t pos = 0;
+};
+
+// run request on the worker at url and return its response, positioned after the status
+Reader call(const std::string& url, const Writer& request);
+
+}  // namespace rpc
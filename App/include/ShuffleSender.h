@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HostBufferPool.h"
+
+/* Sends the sealed shuffle files a worker writes for other workers. Every destination has its own
+ * thread and queue, so ocall_write_file returns as soon as a file is queued: the enclave serializes
+ * and seals the next destination's rows while the earlier ones are still on the wire, and the p - 1
+ * destinations are sent to at the same time. Each file goes to its target's mailbox (task
+ * "shuffle_chunk"), and its buffer goes back to the pool once it is delivered. */
+class ShuffleSender {
+  public:
+    explicit ShuffleSender(HostBufferPool* buffers) : buffers(buffers) {}
+    // queue length bytes of content for the worker at url, which stores them under file_name
+    void send(const std::string& url, const std::string& file_name, uint8_t* content, size_t length);
+    // wait until every queued file has been delivered
+    void flush();
+
+  private:
+    struct Chunk {
+        std::string file_name;
+        uint8_t* content;
+        size_t length;
+    };
+    struct Destination {
+        std::string url;
+        std::deque<Chunk> queue;
+        std::thread thread;
+    };
+    void run(Destination* destination);
+
+    HostBufferPool* buffers;
+    std::mutex mutex;
+    std::condition_variable queued;     // a destination has a chunk to send
+    std::condition_variable delivered;  // pending dropped to 0
+    std::vector<Destination*> destinations;
+    size_t pending = 0;  // queued or being sent
+};
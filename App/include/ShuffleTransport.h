@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "HostBufferPool.h"
+
+/* Where the sealed files an enclave sends to its own process go: the local half of ocall_write_file
+ * and ocall_read_file. The enclave names each file after (gid, source lid, target lid), plus a suffix
+ * for the pivots (see genFileName), so the file name is the mailbox key. Files for another worker in
+ * real distributed mode go over HTTP: to that worker's disk, or with the memory transport straight
+ * into its mailbox. */
+class ShuffleTransport {
+  public:
+    virtual ~ShuffleTransport() {}
+    explicit ShuffleTransport(HostBufferPool* buffers) : buffers(buffers) {}
+    // store length bytes of content under file_name, replacing what was there. content comes from
+    // buffers and the transport gives it back once it no longer needs it
+    virtual void put(const std::string& file_name, uint8_t* content, size_t length) = 0;
+    // lend the buffer stored under file_name to the caller until release(), in *content and *length.
+    // Returns false if there is no such file; it runs in an ocall, so it must not throw
+    virtual bool take(const std::string& file_name, uint8_t** content, size_t* length) = 0;
+    virtual void release(uint8_t* content, size_t length) = 0;
+
+  protected:
+    HostBufferPool* buffers;
+};
+
+// files under ../data/shuffle_buffer, read back through a read-only mapping instead of a copy
+class FileTransport : public ShuffleTransport {
+  public:
+    explicit FileTransport(HostBufferPool* buffers) : ShuffleTransport(buffers) {}
+    void put(const std::string& file_name, uint8_t* content, size_t length) override;
+    bool take(const std::string& file_name, uint8_t** content, size_t* length) override;
+    void release(uint8_t* content, size_t length) override;
+};
+
+// the sealed buffers themselves, kept until the target has read them. With wait_for_mail, take() waits
+// for a file that is still on its way from another worker (see ShuffleSender) instead of failing, up to
+// mail_timeout: a file lost with its sender then fails the task instead of blocking every later one
+class MemoryTransport : public ShuffleTransport {
+  public:
+    explicit MemoryTransport(HostBufferPool* buffers, bool wait_for_mail = false,
+                             std::chrono::seconds mail_timeout = std::chrono::seconds(600))
+        : ShuffleTransport(buffers), wait_for_mail(wait_for_mail), mail_timeout(mail_timeout) {}
+    ~MemoryTransport();
+    void put(const std::string& file_name, uint8_t* content, size_t length) override;
+    bool take(const std::string& file_name, uint8_t** content, size_t* length) override;
+    void release(uint8_t* content, size_t length) override;
+
+  private:
+    struct Mail {
+        uint8_t* content;
+        size_t length;
+    };
+    bool wait_for_mail;
+    std::chrono::seconds mail_timeout;
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::unordered_map<std::string, Mail> mailbox;
+};
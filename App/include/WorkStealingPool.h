@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Persistent threads for the per-partition sections of GlobalTable. run() deals the n tasks of a
+ * section round-robin onto one deque per thread; a thread takes from the front of its own deque and,
+ * once that is empty, steals from the back of another one. The calling thread works on its own deque
+ * as well until the section is done, so a task may start a section of its own without a deadlock. */
+class WorkStealingPool {
+  public:
+    // num_threads workers besides the threads that call run()
+    explicit WorkStealingPool(int num_threads);
+    ~WorkStealingPool();
+
+    int num_threads() const {
+        return (int)threads.size();
+    }
+
+    // run func(0), ..., func(n - 1) and return when all are done; the first exception a task throws
+    // is rethrown here once the others have finished
+    void run(int n, const std::function<void(int)>& func);
+
+  private:
+    struct Section {
+        const std::function<void(int)>* func;
+        std::atomic<int> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+    struct Task {
+        Section* section;
+        int index;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // a task from queue self, else one stolen from another queue
+    bool pop(size_t self, Task* task);
+    void execute(const Task& task);
+    void work(size_t self);
+
+    std::vector<std::unique_ptr<Queue>> queues;  // one per worker, the last one for the callers of run()
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable queued;  // tasks > 0 or stopping
+    std::atomic<int> tasks{0};       // in the queues, not yet taken
+    bool stopping = false;
+};
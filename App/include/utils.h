@@ -1,19 +1,58 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <atomic>
 #include <chrono>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include "Operators.h"
+#include "ShuffleSender.h"
+#include "ShuffleTransport.h"
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 #include "log.h"
 
 namespace utils {
   extern int num_partitions;
+  extern int enclave_threads;  // threads used by one enclave for oblivious sorting
+  extern int simulation_threads;  // partitions a simulation run works on at the same time
+
+  // keep in sync with obliv::SortAlgorithm
+  const int SORT_BITONIC = 0;
+  const int SORT_BUCKET = 1;
+  const int SORT_TAG = 2;
+  extern int sort_algorithm;
+  extern bool two_round_shuffle;  // shuffle by key in two rounds, see getTwoRoundBounds
+  extern int sort_sample_size;  // rows each partition samples for the splitters of GlobalTable::sort
+  extern int sort_budget_mb;  // working set of one sort, beyond it the sort merges sealed runs; 0 for no limit
+
+  // keep in sync with obliv::SimdLevel
+  const int SIMD_NONE = 0;
+  const int SIMD_SSE = 1;
+  const int SIMD_AVX2 = 2;
+  const int SIMD_AVX512 = 3;
+  extern int simd_level;  // compare-exchange kernels in use inside the enclave
   extern std::vector<std::string> worker_urls;
 
+  extern bool switchless;          // serve the I/O and profiling ocalls from untrusted worker threads
+  extern int switchless_uworkers;  // number of those threads
+  // I/O and profiling ocalls since reset(), and how many of them a switchless worker served
+  extern std::atomic<long long> ocall_count;
+  extern std::atomic<long long> switchless_ocall_count;
+  extern thread_local bool is_switchless_worker;
+
   extern bool is_distributed;
+  extern bool verify_metadata;  // check the column counts and sizes GlobalTable tracks against the partitions
+
+  extern HostBufferPool host_buffers;  // what the enclave seals shuffle files into
+  extern ShuffleTransport* shuffle_transport;  // local end of the shuffle files, see shuffle_transport in config.ini
+  extern bool memory_transport;
+  extern ShuffleSender* shuffle_sender;  // the shuffle files for other workers, see streaming_shuffle()
+  // whether the workers stream shuffle files into each other's mailbox, so a shuffle can read while it writes
+  inline bool streaming_shuffle() {
+    return memory_transport && is_distributed;
+  }
 
   const int DUMMY_VAL = 9999;
 
@@ -26,6 +65,8 @@ namespace utils {
   extern std::unordered_map<int, std::unordered_map<std::string, double>> duration_matrix;
   extern std::unordered_map<int, long long> comm_map;
   extern long long total_comm;
+  // guards the timing and communication maps above, which partitions running at once update together
+  extern std::mutex timing_mutex;
   extern int time_phase;
   extern double read_write_ms;
   extern double comp_ms;
@@ -43,9 +84,6 @@ namespace utils {
   bool exist_in_matrix(int id, std::string content);
   void update_phase(std::string phase_name = "");
   void ReadConfig(const std::string& filename);
-  std::string extractRet(const std::string& str);
-  std::string vectorToString(const std::vector<int>& vec);
-  std::vector<int> stringToVector(const std::string& str);
 
   int extractPort(const std::string& addr);
 
@@ -55,10 +93,10 @@ namespace utils {
   void reset();
 
   int getSizeBound(int n, int p);
-
-  // Utility functions for serializing and deserializing AssociateOperator objects
-  std::string serializeOperator(const AssociateOperator& op);
-  AssociateOperator* deserializeOperator(const std::string& data);
+  // bounds of a two-round shuffle by key of n tuples from each of p partitions: at most first_bound
+  // tuples go straight to each target, and the rest are carried in overflow_bound tuples through
+  // partition 0; overflow_bound is 0 (and first_bound getSizeBound(n, p)) if one round sends less
+  void getTwoRoundBounds(int n, int p, int* first_bound, int* overflow_bound);
 
   class CommStatTransportCallback : public proxygen::HTTPTransactionTransportCallback {
     void firstHeaderByteFlushed() noexcept override {
@@ -0,0 +1,92 @@
+#include "ConnectionPool.h"
+#include <folly/io/SocketOptionMap.h>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include "log.h"
+
+using namespace folly;
+using namespace proxygen;
+
+ConnectionPool* connection_pool = new ConnectionPool();
+
+PooledConnection::~PooledConnection() {
+    if (session) {
+        session->setInfoCallback(nullptr);
+        session->dropConnection();
+    }
+    // let the session finish tearing down before the timer and the event base go
+    evb.loopOnce(EVLOOP_NONBLOCK);
+}
+
+bool PooledConnection::reusable() {
+    // run pending events first, so a close from the peer is seen
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    return session != nullptr && session->isReusable();
+}
+
+namespace {
+class ConnectCallback : public HTTPConnector::Callback {
+  public:
+    HTTPUpstreamSession* session{nullptr};
+    bool finished{false};
+
+    void connectSuccess(HTTPUpstreamSession* s) override {
+        session = s;
+        finished = true;
+    }
+
+    void connectError(const AsyncSocketException& ex) override {
+        log_error("Couldn't connect: %s", ex.what());
+        finished = true;
+    }
+};
+}  // namespace
+
+std::unique_ptr<PooledConnection> ConnectionPool::connect(const SocketAddress& addr, int connect_timeout_ms) {
+    std::unique_ptr<PooledConnection> conn(new PooledConnection());
+    conn->destination = addr.describe();
+    // Note: HHWheelTimer is a large object, so it is created once per connection rather than per request
+    conn->timer = HHWheelTimer::newTimer(
+        &conn->evb,
+        std::chrono::milliseconds(HHWheelTimer::DEFAULT_TICK_INTERVAL),
+        AsyncTimeout::InternalEnum::NORMAL,
+        std::chrono::milliseconds(connect_timeout_ms));
+    static const SocketOptionMap opts{
+        {{SOL_SOCKET, SO_REUSEADDR}, 1}
+    };
+    ConnectCallback cb;
+    HTTPConnector connector(&cb, conn->timer.get());
+    connector.connect(&conn->evb, addr, std::chrono::milliseconds(connect_timeout_ms), opts);
+    while (!cb.finished)
+        conn->evb.loopOnce();
+    if (!cb.session)
+        return nullptr;
+    conn->session = cb.session;
+    conn->session->setInfoCallback(conn.get());
+    return conn;
+}
+
+std::unique_ptr<PooledConnection> ConnectionPool::acquire(const SocketAddress& addr, int connect_timeout_ms) {
+    std::string destination = addr.describe();
+    while (true) {
+        std::unique_ptr<PooledConnection> conn;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& conns = idle[destination];
+            if (conns.empty())
+                break;
+            conn = std::move(conns.back());
+            conns.pop_back();
+        }
+        if (conn->reusable())
+            return conn;
+    }
+    log_debug("Opening a connection to %s", destination.c_str());
+    return connect(addr, connect_timeout_ms);
+}
+
+void ConnectionPool::release(std::unique_ptr<PooledConnection> conn) {
+    if (!conn->reusable())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    idle[conn->destination].push_back(std::move(conn));
+}
@@ -251,6 +251,7 @@ namespace CurlService {
     }
 
     void CurlClient::detachTransaction() noexcept {
+        done_ = true;
     }
 
     void CurlClient::onHeadersComplete(unique_ptr<HTTPMessage> msg) noexcept {
@@ -274,7 +275,7 @@ namespace CurlService {
                 //outputStream_->flush();
                 p = p->next();
             } while (p != chain.get());
-            task_ret = ret;
+            task_ret += ret;  // a long body arrives in several calls
         }
     }
 
@@ -10,12 +10,19 @@
 
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
+#include <folly/Conv.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/io/async/EventBaseManager.h>
+
+#include <array>
+#include <cstring>
 
 // #include <mutex>
 #include "App.h"
 #include "EchoStats.h"
 #include "Enclave_u.h"
 #include "LocalTable.h"
+#include "Rpc.h"
 #include "log.h"
 #include "utils.h"
 
@@ -46,245 +53,333 @@ unordered_map<string, string> headerToMap(HTTPHeaders header) {
 
 std::unordered_map<int, std::shared_ptr<LocalTable> > localTableMap;
 
-std::string executeTask(unordered_map<string, string>& task) {
-    std::string task_ret = "";
-    if (task["task"] != "destroy")
-        log_info("Executing task: %s", task["task"].c_str());
-    else
-        log_debug("Destroying table");
-    if (task["task"] == "read_config_file") {
-        utils::read_config_file("../data/shuffle_buffer/config_" + task["worker_id"], true);
-    } else if (task["task"] == "create_local_table") {
-        int global_id = stoi(task["global_id"]);
-        int local_id = stoi(task["local_id"]);
-        std::string file_path = task["file_path"];
+// a task reads its arguments from args in the order LocalTable wrote them and puts its return value, if
+// any, into ret
+typedef void (*Task)(rpc::Reader& args, rpc::Writer& ret);
+
+static std::array<Task, rpc::NUM_OPS> makeTaskTable() {
+    std::array<Task, rpc::NUM_OPS> tasks{};
+    tasks[rpc::READ_CONFIG_FILE] = [](rpc::Reader& args, rpc::Writer&) {
+        int worker_id = args.get_int();
+        utils::read_config_file("../data/shuffle_buffer/config_" + std::to_string(worker_id), true);
+    };
+    tasks[rpc::CREATE_LOCAL_TABLE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int local_id = args.get_int();
+        std::string file_path = args.get_string();
         localTableMap[global_id] = make_shared<LocalTable>(global_id, local_id, file_path);
-    } else if (task["task"] == "copy") {
-        int global_id = stoi(task["global_id"]);
-        int new_global_id = stoi(task["new_global_id"]);
+    };
+    tasks[rpc::COPY] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int new_global_id = args.get_int();
         localTableMap[new_global_id] = std::make_shared<LocalTable>(localTableMap[global_id]->copy(new_global_id));
-    } else if (task["task"] == "size") {
-        int global_id = stoi(task["global_id"]);
-        int ret = localTableMap[global_id]->size();
-        log_debug("ret size is %d", ret);
-        task_ret = std::to_string(ret);
-    } else if (task["task"] == "sum") {
-        int global_id = stoi(task["global_id"]);
-        int column = stoi(task["column"]);
-        long long ret = localTableMap[global_id]->sum(column);
-        log_debug("ret sum is %d", ret);
-        task_ret = std::to_string(ret);
-    } else if (task["task"] == "max") {
-        int global_id = stoi(task["global_id"]);
-        int column = stoi(task["column"]);
-        int ret = localTableMap[global_id]->max(column);
-        log_debug("ret max is %d", ret);
-        task_ret = std::to_string(ret);
-    } else if (task["task"] == "SODA_step1") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
-        int aggCol = stoi(task["aggCol"]);
-        long long ret = localTableMap[global_id]->SODA_step1(columns, aggCol);
-        log_debug("ret SODA_step1 is %lld", ret);
-        task_ret = std::to_string(ret);
-    } else if (task["task"] == "SODA_step2") {
-        int global_id = stoi(task["global_id"]);
-        int p = stoi(task["p"]);
+    };
+    tasks[rpc::SIZE] = [](rpc::Reader& args, rpc::Writer& ret) {
+        int global_id = args.get_int();
+        ret.put(localTableMap[global_id]->size());
+    };
+    tasks[rpc::SUM] = [](rpc::Reader& args, rpc::Writer& ret) {
+        int global_id = args.get_int();
+        int column = args.get_int();
+        ret.put(localTableMap[global_id]->sum(column));
+    };
+    tasks[rpc::MAX] = [](rpc::Reader& args, rpc::Writer& ret) {
+        int global_id = args.get_int();
+        int column = args.get_int();
+        ret.put(localTableMap[global_id]->max(column));
+    };
+    tasks[rpc::SODA_STEP1] = [](rpc::Reader& args, rpc::Writer& ret) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
+        int aggCol = args.get_int();
+        ret.put(localTableMap[global_id]->SODA_step1(columns, aggCol));
+    };
+    tasks[rpc::SODA_STEP2] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int p = args.get_int();
         localTableMap[global_id]->SODA_step2(p);
-    } else if (task["task"] == "SODA_step3") {
-        int global_id = stoi(task["global_id"]);
-        int p = stoi(task["p"]);
+    };
+    tasks[rpc::SODA_STEP3] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int p = args.get_int();
         localTableMap[global_id]->SODA_step3(p);
-    } else if (task["task"] == "localJoin") {
-        int global_id = stoi(task["global_id"]);
-        int other_global_id = stoi(task["other_global_id"]);
-        int other_id = stoi(task["other_id"]);
-        int join_col_num = stoi(task["join_col_num"]);
-        int output_bound = stoi(task["output_bound"]);
-        int ret = localTableMap[global_id]->localJoin(other_global_id, other_id, join_col_num, output_bound);
-        task_ret = std::to_string(ret);
-    } else if (task["task"] == "SODA_step5") {
-        int global_id = stoi(task["global_id"]);
+    };
+    tasks[rpc::LOCAL_JOIN] = [](rpc::Reader& args, rpc::Writer& ret) {
+        int global_id = args.get_int();
+        int other_global_id = args.get_int();
+        int other_id = args.get_int();
+        int join_col_num = args.get_int();
+        int output_bound = args.get_int();
+        ret.put(localTableMap[global_id]->localJoin(other_global_id, other_id, join_col_num, output_bound));
+    };
+    tasks[rpc::SODA_STEP5] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
         localTableMap[global_id]->SODA_step5();
-    } else if (task["task"] == "assignColE") {
-        int global_id = stoi(task["global_id"]);
-        int col = stoi(task["col"]);
+    };
+    tasks[rpc::ASSIGN_COL_E] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int col = args.get_int();
         localTableMap[global_id]->assignColE(col);
-    } else if (task["task"] == "num_columns") {
-        int global_id = stoi(task["global_id"]);
-        int ret = localTableMap[global_id]->num_columns();
-        log_debug("ret num_columns is %d", ret);
-        task_ret = std::to_string(ret);
-    } else if (task["task"] == "print") {
-        int global_id = stoi(task["global_id"]);
-        int limit_size = stoi(task["limit_size"]);
-        bool show_dummy = stoi(task["show_dummy"]);
+    };
+    tasks[rpc::NUM_COLUMNS] = [](rpc::Reader& args, rpc::Writer& ret) {
+        int global_id = args.get_int();
+        ret.put(localTableMap[global_id]->num_columns());
+    };
+    tasks[rpc::PRINT] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int limit_size = args.get_int();
+        bool show_dummy = args.get_int();
         localTableMap[global_id]->print(limit_size, show_dummy);
-    } else if (task["task"] == "union_table") {
-        int global_id = stoi(task["global_id"]);
-        int table_global_id = stoi(task["table_global_id"]);
-        int table_id = stoi(task["table_id"]);
+    };
+    tasks[rpc::UNION_TABLE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int table_global_id = args.get_int();
+        int table_id = args.get_int();
         localTableMap[global_id]->union_table(table_global_id, table_id);
-    } else if (task["task"] == "pad_to_size") {
-        int global_id = stoi(task["global_id"]);
-        int n = stoi(task["n"]);
+    };
+    tasks[rpc::PAD_TO_SIZE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int n = args.get_int();
         localTableMap[global_id]->pad_to_size(n);
-    } else if (task["task"] == "opaque_prepare_shuffle_col") {
-        int global_id = stoi(task["global_id"]);
-        int col_id = stoi(task["col_id"]);
-        int tuple_num = stoi(task["tuple_num"]);
+    };
+    tasks[rpc::OPAQUE_PREPARE_SHUFFLE_COL] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int col_id = args.get_int();
+        int tuple_num = args.get_int();
         localTableMap[global_id]->opaque_prepare_shuffle_col(col_id, tuple_num);
-    } else if (task["task"] == "shuffleMerge") {
-        int global_id = stoi(task["global_id"]);
-        int num_partitions = stoi(task["num_partitions"]);
-        localTableMap[global_id]->shuffleMerge(num_partitions);
-    } else if (task["task"] == "randomShuffle") {
-        int global_id = stoi(task["global_id"]);
-        int num_partitions = stoi(task["num_partitions"]);
+    };
+    tasks[rpc::SHUFFLE_MERGE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int num_partitions = args.get_int();
+        bool relayed = args.get_int();
+        localTableMap[global_id]->shuffleMerge(num_partitions, relayed);
+    };
+    tasks[rpc::RANDOM_SHUFFLE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int num_partitions = args.get_int();
         localTableMap[global_id]->randomShuffle(num_partitions);
-    } else if (task["task"] == "shuffleByKey") {
-        int global_id = stoi(task["global_id"]);
-        int num_partitions = stoi(task["num_partitions"]);
-        const std::vector<int> key = stringToVector(task["key"]);
-        int seed = stoi(task["seed"]);
-        int size_bound = stoi(task["size_bound"]);
+    };
+    tasks[rpc::SHUFFLE_BY_KEY] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int num_partitions = args.get_int();
+        std::vector<int> key = args.get_ints();
+        int seed = args.get_int();
+        int size_bound = args.get_int();
         localTableMap[global_id]->shuffleByKey(num_partitions, key, seed, size_bound);
-    } else if (task["task"] == "shuffleByCol") {
-        int global_id = stoi(task["global_id"]);
-        int num_partitions = stoi(task["num_partitions"]);
-        int i_col_id = stoi(task["i_col_id"]);
-        int size_bound = stoi(task["size_bound"]);
+    };
+    tasks[rpc::SHUFFLE_BY_KEY_TWO_ROUND] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int num_partitions = args.get_int();
+        std::vector<int> key = args.get_ints();
+        int seed = args.get_int();
+        int size_bound = args.get_int();
+        int overflow_bound = args.get_int();
+        localTableMap[global_id]->shuffleByKeyTwoRound(num_partitions, key, seed, size_bound, overflow_bound);
+    };
+    tasks[rpc::SHUFFLE_RELAY] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int num_partitions = args.get_int();
+        int overflow_bound = args.get_int();
+        localTableMap[global_id]->shuffleRelay(num_partitions, overflow_bound);
+    };
+    tasks[rpc::SHUFFLE_BY_COL] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int num_partitions = args.get_int();
+        int i_col_id = args.get_int();
+        int size_bound = args.get_int();
         localTableMap[global_id]->shuffleByCol(num_partitions, i_col_id, size_bound);
-    } else if (task["task"] == "partitionByPivots") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
-        int size_bound = stoi(task["size_bound"]);
+    };
+    tasks[rpc::PARTITION_BY_PIVOTS] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
+        int size_bound = args.get_int();
         localTableMap[global_id]->partitionByPivots(columns, size_bound);
-    } else if (task["task"] == "groupByPrefixAggregate") {
-        int global_id = stoi(task["global_id"]);
-        AssociateOperator* op = deserializeOperator(task["op"]);
-        int phase = stoi(task["phase"]);
-        bool reverse = task["reverse"] == "1";
-        localTableMap[global_id]->groupByPrefixAggregate(*op, phase);
-    } else if (task["task"] == "groupByAggregate") {
-        int global_id = stoi(task["global_id"]);
-        AssociateOperator* op = deserializeOperator(task["op"]);
+    };
+    tasks[rpc::GROUP_BY_PREFIX_AGGREGATE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::unique_ptr<AssociateOperator> op = args.get_operator();
+        int round = args.get_int();
+        bool reverse = args.get_int();
+        localTableMap[global_id]->groupByPrefixAggregate(*op, round, reverse);
+    };
+    tasks[rpc::GROUP_BY_AGGREGATE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::unique_ptr<AssociateOperator> op = args.get_operator();
         localTableMap[global_id]->groupByAggregate(*op);
-    } else if (task["task"] == "_addValueByKey") {
-        int global_id = stoi(task["global_id"]);
-        AssociateOperator* op = deserializeOperator(task["op"]);
-        localTableMap[global_id]->_addValueByKey(*op);
-    } else if (task["task"] == "mvJoinColsAhead") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> join_cols = stringToVector(task["join_cols"]);
+    };
+    tasks[rpc::MV_JOIN_COLS_AHEAD] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> join_cols = args.get_ints();
         localTableMap[global_id]->mvJoinColsAhead(join_cols);
-    } else if (task["task"] == "pkJoinCombine") {
-        int global_id = stoi(task["global_id"]);
-        int s_table_local_global_id = stoi(task["s_table_local_global_id"]);
-        int s_table_local_id = stoi(task["s_table_local_id"]);
-        std::vector<int> combine_sort_cols = stringToVector(task["combine_sort_cols"]);
-        std::vector<int> new_join_cols = stringToVector(task["new_join_cols"]);
-        int ori_r_col_num = stoi(task["ori_r_col_num"]);
-        int r_align_col_num = stoi(task["r_align_col_num"]);
-
+    };
+    tasks[rpc::PK_JOIN_COMBINE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int s_table_local_global_id = args.get_int();
+        int s_table_local_id = args.get_int();
+        std::vector<int> combine_sort_cols = args.get_ints();
+        std::vector<int> new_join_cols = args.get_ints();
+        int ori_r_col_num = args.get_int();
+        int r_align_col_num = args.get_int();
         localTableMap[global_id]->pkJoinCombine(s_table_local_global_id,
                                                 s_table_local_id,
                                                 combine_sort_cols,
                                                 new_join_cols,
                                                 ori_r_col_num,
                                                 r_align_col_num);
-    } else if (task["task"] == "foreignTableModifyColZ") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
+    };
+    tasks[rpc::FOREIGN_TABLE_MODIFY_COL_Z] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
         localTableMap[global_id]->foreignTableModifyColZ(columns);
-    } else if (task["task"] == "remove_dup_after_prefix") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
+    };
+    tasks[rpc::REMOVE_DUP_AFTER_PREFIX] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
         localTableMap[global_id]->remove_dup_after_prefix(columns);
-    } else if (task["task"] == "finalizePkjoinResult") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
-        int ori_r_col_num = stoi(task["ori_r_col_num"]);
-        int r_align_col_num = stoi(task["r_align_col_num"]);
+    };
+    tasks[rpc::FINALIZE_PKJOIN_RESULT] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
+        int ori_r_col_num = args.get_int();
+        int r_align_col_num = args.get_int();
         localTableMap[global_id]->finalizePkjoinResult(columns, ori_r_col_num, r_align_col_num);
-    } else if (task["task"] == "joinComputeAlignment") {
-        int global_id = stoi(task["global_id"]);
-        int m = stoi(task["m"]);
+    };
+    tasks[rpc::JOIN_COMPUTE_ALIGNMENT] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int m = args.get_int();
         localTableMap[global_id]->joinComputeAlignment(m);
-    } else if (task["task"] == "joinFinalCombine") {
-        int global_id = stoi(task["global_id"]);
-        int r_table_global_id = stoi(task["r_table_global_id"]);
-        int num_join_cols = stoi(task["num_join_cols"]);
+    };
+    tasks[rpc::JOIN_FINAL_COMBINE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int r_table_global_id = args.get_int();
+        int num_join_cols = args.get_int();
         localTableMap[global_id]->joinFinalCombine(*localTableMap[r_table_global_id], num_join_cols);
-    } else if (task["task"] == "sortMerge") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
+    };
+    tasks[rpc::SORT_MERGE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
         localTableMap[global_id]->sortMerge(columns);
-    } else if (task["task"] == "project") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
+    };
+    tasks[rpc::PROJECT] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
         localTableMap[global_id]->project(columns);
-    } else if (task["task"] == "getPivots") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
+    };
+    tasks[rpc::SAMPLE_PIVOTS] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int sample_size = args.get_int();
+        localTableMap[global_id]->samplePivots(sample_size);
+    };
+    tasks[rpc::GET_PIVOTS] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
         localTableMap[global_id]->getPivots(columns);
-    } else if (task["task"] == "localSort") {
-        int global_id = stoi(task["global_id"]);
-        const std::vector<int> columns = stringToVector(task["columns"]);
+    };
+    tasks[rpc::LOCAL_SORT] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        std::vector<int> columns = args.get_ints();
         localTableMap[global_id]->localSort(columns);
-    } else if (task["task"] == "expansion_prepare") {
-        int global_id = stoi(task["global_id"]);
-        int d_index = stoi(task["d_index"]);
+    };
+    tasks[rpc::EXPANSION_PREPARE] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int d_index = args.get_int();
         localTableMap[global_id]->expansion_prepare(d_index);
-    } else if (task["task"] == "copyCol") {
-        int global_id = stoi(task["global_id"]);
-        int col_index = stoi(task["col_index"]);
+    };
+    tasks[rpc::COPY_COL] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int col_index = args.get_int();
         localTableMap[global_id]->copyCol(col_index);
-    } else if (task["task"] == "addCol") {
-        int global_id = stoi(task["global_id"]);
-        int defaultVal = stoi(task["defaultVal"]);
-        int col_index = stoi(task["col_index"]);
+    };
+    tasks[rpc::ADD_COL] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int defaultVal = args.get_int();
+        int col_index = args.get_int();
         localTableMap[global_id]->addCol(defaultVal, col_index);
-    } else if (task["task"] == "add_and_calculate_col_t_p") {
-        int global_id = stoi(task["global_id"]);
-        int d_index = stoi(task["d_index"]);
-        int m = stoi(task["m"]);
+    };
+    tasks[rpc::ADD_AND_CALCULATE_COL_T_P] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int d_index = args.get_int();
+        int m = args.get_int();
         localTableMap[global_id]->add_and_calculate_col_t_p(d_index, m);
-    } else if (task["task"] == "expansion_distribute_and_clear") {
-        int global_id = stoi(task["global_id"]);
-        int m = stoi(task["m"]);
+    };
+    tasks[rpc::EXPANSION_DISTRIBUTE_AND_CLEAR] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int m = args.get_int();
         localTableMap[global_id]->expansion_distribute_and_clear(m);
-    } else if (task["task"] == "expansion_suffix_sum") {
-        int global_id = stoi(task["global_id"]);
-        int phase = stoi(task["phase"]);
-        localTableMap[global_id]->expansion_suffix_sum(phase);
-    } else if (task["task"] == "deleteCol") {
-        int global_id = stoi(task["global_id"]);
-        int col_index = stoi(task["col_index"]);
+    };
+    tasks[rpc::DELETE_COL] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int col_index = args.get_int();
         localTableMap[global_id]->deleteCol(col_index);
-    } else if (task["task"] == "soda_shuffleByKey") {
-        int global_id = stoi(task["global_id"]);
-        auto key = stringToVector(task["key"]);
-        localTableMap[global_id]->soda_shuffleByKey(utils::num_partitions, key, 0);
-    } else if (task["task"] == "destroy") {
-        int global_id = stoi(task["global_id"]);
+    };
+    tasks[rpc::SODA_SHUFFLE_BY_KEY] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        int num_partitions = args.get_int();
+        std::vector<int> key = args.get_ints();
+        int size_bound = args.get_int();
+        localTableMap[global_id]->soda_shuffleByKey(num_partitions, key, size_bound);
+    };
+    tasks[rpc::DESTROY] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
         localTableMap[global_id]->destroy();
-    } else if (task["task"] == "get_comm_and_reset") {
-        log_info("header size = %d, body size = %d", utils::header_total_size, utils::body_total_size );
-        long long ret = utils::body_total_size + utils::header_total_size;
-        task_ret = std::to_string(ret);
+    };
+    tasks[rpc::GET_COMM_AND_RESET] = [](rpc::Reader&, rpc::Writer& ret) {
+        log_info("header size = %d, body size = %d", utils::header_total_size, utils::body_total_size);
+        ret.put(utils::body_total_size + utils::header_total_size);
         utils::body_total_size = utils::header_total_size = 0;
-    } else {
-        log_warn("Unknown task %s", task["task"].c_str());
-        return "Unsupported";
+    };
+    tasks[rpc::RUN_PLAN] = [](rpc::Reader& args, rpc::Writer&) {
+        int global_id = args.get_int();
+        LocalPlan plan(args.get_ints());
+        localTableMap[global_id]->run(plan);
+    };
+    return tasks;
+}
+
+static const std::array<Task, rpc::NUM_OPS> tasks = makeTaskTable();
+
+// runs the tasks one at a time in the order they arrive, away from the IO threads: a task may wait for
+// shuffle files from other workers (see MemoryTransport) that an IO thread has to receive
+static folly::CPUThreadPoolExecutor* task_executor = new folly::CPUThreadPoolExecutor(1);
+
+// run the binary request and return the binary response; a task that throws gets rpc::FAILED, so the
+// caller always has a response to send back and the coordinator does not wait forever
+std::string executeTask(const std::string& request) {
+    rpc::Reader args(request);
+    rpc::Writer ret;
+    try {
+        uint8_t op = args.head();
+        if (op >= rpc::NUM_OPS || !tasks[op]) {
+            log_warn("Unknown task %d", op);
+            return rpc::Writer().put(rpc::FAILED).data();
+        }
+        if (op != rpc::DESTROY)
+            log_info("Executing task: %s", rpc::op_names[op]);
+        else
+            log_debug("Destroying table");
+        ret.put(rpc::OK);
+        tasks[op](args, ret);
+        // the task is done once the shuffle files it wrote for other workers have arrived
+        utils::shuffle_sender->flush();
+    } catch (const std::runtime_error& e) {
+        log_error("Malformed request: %s", e.what());
+        return rpc::Writer().put(rpc::FAILED).data();
+    } catch (const std::exception& e) {
+        log_error("Task failed: %s", e.what());
+        return rpc::Writer().put(rpc::FAILED).data();
+    } catch (...) {
+        log_error("Task failed with an unknown exception");
+        return rpc::Writer().put(rpc::FAILED).data();
     }
-    return task_ret;
+    return ret.data();
 }
 
 EchoHandler::~EchoHandler() {
     if (fileStream_.is_open()) {
         fileStream_.close();
     }
+    if (chunk_)
+        utils::host_buffers.release(chunk_);
 }
 
 void EchoHandler::onRequest(std::unique_ptr<HTTPMessage> req) noexcept {
@@ -309,13 +404,46 @@ void EchoHandler::onRequest(std::unique_ptr<HTTPMessage> req) noexcept {
     if (task["task"] == "write_file") {
         log_debug("write_file task reached");
         fileStream_.open(task["file_name"], std::ios::binary);
+    } else if (task["task"] == "shuffle_chunk") {
+        // a shuffle file from another worker, kept in memory for the partition that reads it
+        chunk_name_ = task["file_name"];
+        // this callback must not throw, so the length is parsed without exceptions
+        auto length = folly::tryTo<size_t>(req->getHeaders().getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH));
+        if (!length.hasValue()) {
+            log_error("Shuffle chunk %s has no valid Content-Length", chunk_name_.c_str());
+            bad_request_ = true;
+            return;
+        }
+        chunk_capacity_ = length.value();
+        chunk_ = utils::host_buffers.acquire(chunk_capacity_);
+        chunk_length_ = 0;
+    } else if (task["task"] == "rpc") {
+        is_rpc_ = true;  // the request is the body, run on EOM
     } else {
-        ret = executeTask(task);
+        log_warn("Unknown task %s", task["task"].c_str());
     }
 }
 
 void EchoHandler::onBody(std::unique_ptr<folly::IOBuf> body) noexcept {
-    if (body) {
+    if (body && is_rpc_) {
+        const folly::IOBuf* current = body.get();
+        do {
+            request_.append(reinterpret_cast<const char*>(current->data()), current->length());
+            current = current->next();
+        } while (current != body.get());
+    } else if (body && chunk_ && !bad_request_) {
+        const folly::IOBuf* current = body.get();
+        do {
+            if (chunk_length_ + current->length() > chunk_capacity_) {
+                log_error("Shuffle chunk %s is longer than its Content-Length", chunk_name_.c_str());
+                bad_request_ = true;
+                return;
+            }
+            memcpy(chunk_ + chunk_length_, current->data(), current->length());
+            chunk_length_ += current->length();
+            current = current->next();
+        } while (current != body.get());
+    } else if (body) {
         // 检查文件流是否打开
         if (!fileStream_.is_open()) {
             log_error("File stream is not open");
@@ -340,16 +468,63 @@ void EchoHandler::onEOM() noexcept {
         fileStream_.close();
     }
 
+    if (bad_request_) {
+        // a chunk that does not match its Content-Length never reaches the mailbox; the partition
+        // waiting for it times out and its task fails
+        if (chunk_) {
+            utils::host_buffers.release(chunk_);
+            chunk_ = nullptr;
+        }
+        sendBadRequest();
+        return;
+    }
+
+    if (chunk_) {
+        utils::shuffle_transport->put(chunk_name_, chunk_, chunk_length_);
+        chunk_ = nullptr;
+    }
+
+    if (is_rpc_) {
+        // the response is sent from this handler's IO thread once the task is done
+        folly::EventBase* evb = folly::EventBaseManager::get()->getExistingEventBase();
+        task_running_ = true;
+        task_executor->add([this, evb] {
+            std::string body_ret;
+            try {
+                body_ret = executeTask(request_);
+            } catch (...) {
+                body_ret = rpc::Writer().put(rpc::FAILED).data();
+            }
+            evb->runInEventBaseThread([this, body_ret = std::move(body_ret)] {
+                task_running_ = false;
+                if (aborted_)
+                    delete this;
+                else
+                    sendResponse(body_ret);
+            });
+        });
+        return;
+    }
     // ResponseBuilder(downstream_).sendWithEOM();
-    std::string body_ret = "(ret:" + ret + ")";
+    sendResponse("");
+}
 
+void EchoHandler::sendResponse(const std::string& body_ret) {
+    // the length must be exact, or a keep-alive client reads the next response out of step
     ResponseBuilder(downstream_)
         .status(200, "OK")
-        .header("Content-Length", "6")
+        .header("Content-Length", std::to_string(body_ret.size()))
         .body(body_ret)
         .sendWithEOM();  // 最后发送响应，并用 sendWithEOM() 标记请求已处理完毕
 }
 
+void EchoHandler::sendBadRequest() {
+    ResponseBuilder(downstream_)
+        .status(400, "Bad Request")
+        .header("Content-Length", "0")
+        .sendWithEOM();
+}
+
 void EchoHandler::onUpgrade(UpgradeProtocol /*protocol*/) noexcept {
     // handler doesn't support upgrades
 }
@@ -359,6 +534,10 @@ void EchoHandler::requestComplete() noexcept {
 }
 
 void EchoHandler::onError(ProxygenError /*err*/) noexcept {
+    if (task_running_) {
+        aborted_ = true;  // deleted once the task is done
+        return;
+    }
     delete this;
 }
 }  // namespace EchoService
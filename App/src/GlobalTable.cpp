@@ -8,6 +8,7 @@
 #include <sstream>
 #include "App.h"
 #include "ReqSender.h"
+#include "WorkStealingPool.h"
 #include "log.h"
 #include "utils.h"
 
@@ -33,14 +34,18 @@ std::vector<int> computeQuatileIndex(int n, int p) {
 
 GlobalTable::GlobalTable(
     const char* filePath,
-    sgx_enclave_id_t eid) : m_filePath(filePath), m_eid(eid) {
+    sgx_enclave_id_t eid) : m_filePath(filePath), m_eid(eid), m_numColumns(-1) {
     id = TOTAL++;
     splitData();
+    forgetSizes();
 }
 
-GlobalTable::GlobalTable(std::vector<LocalTable>& local_tables, const std::vector<std::string> column_names) {
+GlobalTable::GlobalTable(std::vector<LocalTable>& local_tables, const std::vector<std::string> column_names, int num_columns, std::vector<int> sizes, PhysicalProperties properties)
+    : m_numColumns(num_columns), m_sizes(std::move(sizes)), m_properties(std::move(properties)) {
     id = TOTAL++;
     m_localTables = local_tables;
+    if (m_sizes.size() != m_localTables.size())
+        forgetSizes();
     int ret;
     // ecall_setup_env(global_eid, &ret, utils::num_partitions);
     if (!utils::is_distributed) {
@@ -69,61 +74,33 @@ GlobalTable::~GlobalTable() {
     }
 }
 
+// shared by every GlobalTable and sized on first use, once the config is read. In real distributed mode
+// a task waits on its worker, so all partitions run at once; in simulation mode simulation_threads of them
+// call into the enclave at the same time
+static WorkStealingPool& partition_pool() {
+    static WorkStealingPool* pool = new WorkStealingPool((utils::is_distributed ? utils::num_partitions : utils::simulation_threads) - 1);
+    return *pool;
+}
+
 template <typename Func>
 void GlobalTable::parallel_for_each(Func func) {
-    if (utils::is_distributed) {
-        std::vector<boost::thread> threads;
-        for (auto& table : m_localTables) {
-            threads.emplace_back(func, std::ref(table));
-        }
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
-    } else {
-        for (auto& table : m_localTables) {
-            func(table);
-        }
-    }
+    partition_pool().run(m_localTables.size(), [&](int i) {
+        func(m_localTables[i]);
+    });
 }
 
 template <typename Func>
 void parallel_for_each_i(Func func) {
-    if (utils::is_distributed) {
-        std::vector<boost::thread> threads;
-        for (int i = 0; i < utils::num_partitions; i++) {
-            threads.emplace_back(func, i);
-        }
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
-    } else {
-        for (int i = 0; i < utils::num_partitions; i++) {
-            func(i);
-        }
-    }
+    partition_pool().run(utils::num_partitions, [&](int i) {
+        func(i);
+    });
 }
 
 template <typename Func>
 void GlobalTable::parallel_for_each(Func func) const {
-    if (utils::is_distributed) {
-        std::vector<boost::thread> threads;
-        for (const auto& table : m_localTables) {
-            threads.emplace_back(func, std::ref(table));
-        }
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
-    } else {
-        for (auto& table : m_localTables) {
-            func(table);
-        }
-    }
+    partition_pool().run(m_localTables.size(), [&](int i) {
+        func(m_localTables[i]);
+    });
 }
 
 // is only called by creator
@@ -170,19 +147,30 @@ void GlobalTable::splitData() {
     });
 }
 
+// the partitions whose size is not known are asked in one round, in verify mode all of them
 const int GlobalTable::size() {
-    int sz = 0;
-    boost::mutex mutex;
-    parallel_for_each([&sz, &mutex](LocalTable& table) {
-        int this_size = table.size();
-        {
-            boost::lock_guard<boost::mutex> lock(mutex);
-            sz += this_size;
-        }
+    parallel_for_each_i([this](int i) {
+        if (m_sizes[i] >= 0 && !utils::verify_metadata)
+            return;
+        int real_size = m_localTables[i].size();
+        if (m_sizes[i] >= 0 && m_sizes[i] != real_size)
+            log_error("Table %d partition %d has %d rows, but %d are tracked", id, i, real_size, m_sizes[i]);
+        m_sizes[i] = real_size;
     });
+    int sz = 0;
+    for (int n : m_sizes)
+        sz += n;
     return sz;
 }
 
+void GlobalTable::setSizes(int n) {
+    m_sizes.assign(m_localTables.size(), n);
+}
+
+void GlobalTable::forgetSizes() {
+    setSizes(-1);
+}
+
 void GlobalTable::showInfo() {
     std::cout << "<<<<<<<<<   ";
     for (auto& table : m_localTables)
@@ -191,7 +179,93 @@ void GlobalTable::showInfo() {
 }
 
 const int GlobalTable::numColumns() {
-    return m_localTables[0].num_columns();
+    if (m_numColumns < 0 || utils::verify_metadata) {
+        int real_num = m_localTables[0].num_columns();
+        if (m_numColumns >= 0 && m_numColumns != real_num)
+            log_error("Table %d has %d columns, but %d are tracked", id, real_num, m_numColumns);
+        m_numColumns = real_num;
+    }
+    return m_numColumns;
+}
+
+// columns are only ever removed from the end
+void GlobalTable::addColumns(int count) {
+    if (m_numColumns < 0) {
+        if (count < 0)
+            forgetProperties();
+        return;
+    }
+    m_numColumns += count;
+    for (int c = m_numColumns; c < m_numColumns - count; c++)
+        changedColumn(c);
+}
+
+static bool isPrefix(const std::vector<int>& prefix, const std::vector<int>& of) {
+    return !prefix.empty() && prefix.size() <= of.size() && std::equal(prefix.begin(), prefix.end(), of.begin());
+}
+
+bool GlobalTable::locallySortedOn(const std::vector<int>& columns) const {
+    return isPrefix(columns, m_properties.sorted_on);
+}
+
+bool GlobalTable::sortedOn(const std::vector<int>& columns) const {
+    return m_properties.range_partitioned && locallySortedOn(columns);
+}
+
+bool GlobalTable::hashPartitionedOn(const std::vector<int>& key, int seed) const {
+    return !key.empty() && key == m_properties.hash_key && seed == m_properties.hash_seed;
+}
+
+void GlobalTable::forgetOrder() {
+    m_properties.sorted_on.clear();
+    m_properties.range_partitioned = false;
+}
+
+void GlobalTable::forgetProperties() {
+    m_properties = PhysicalProperties();
+}
+
+void GlobalTable::remapProperties(const std::vector<int>& columns) {
+    auto new_index = [&columns](int column) {
+        for (int i = 0; i < columns.size(); i++)
+            if (columns[i] == column)
+                return i;
+        return -1;
+    };
+    // an order is kept up to its first dropped column, a hash only with all of its key
+    std::vector<int> sorted_on;
+    for (int column : m_properties.sorted_on) {
+        if (new_index(column) < 0)
+            break;
+        sorted_on.push_back(new_index(column));
+    }
+    std::vector<int> hash_key;
+    for (int column : m_properties.hash_key) {
+        if (new_index(column) < 0) {
+            hash_key.clear();
+            break;
+        }
+        hash_key.push_back(new_index(column));
+    }
+    m_properties.sorted_on = sorted_on;
+    m_properties.range_partitioned &= !sorted_on.empty();
+    m_properties.hash_key = hash_key;
+}
+
+void GlobalTable::insertColumns(int pos, int count) {
+    for (int& column : m_properties.sorted_on)
+        column += column >= pos ? count : 0;
+    for (int& column : m_properties.hash_key)
+        column += column >= pos ? count : 0;
+}
+
+void GlobalTable::changedColumn(int column) {
+    auto& sorted_on = m_properties.sorted_on;
+    sorted_on.erase(std::find(sorted_on.begin(), sorted_on.end(), column), sorted_on.end());
+    m_properties.range_partitioned &= !sorted_on.empty();
+    auto& hash_key = m_properties.hash_key;
+    if (std::find(hash_key.begin(), hash_key.end(), column) != hash_key.end())
+        hash_key.clear();
 }
 
 /* the global id of the copied table is designed to be original table's global id + 1000 */
@@ -200,7 +274,7 @@ GlobalTable GlobalTable::copy() {
     parallel_for_each_i([this, &tables](int i) {
         tables[i] = m_localTables[i].copy(TOTAL);
     });
-    return GlobalTable(tables, m_columnNames);
+    return GlobalTable(tables, m_columnNames, m_numColumns, m_sizes, m_properties);
 }
 
 void GlobalTable::print(int limit_size, bool show_dummy) {
@@ -233,9 +307,15 @@ void GlobalTable::project(const std::vector<int> columns) {
     parallel_for_each([&columns](LocalTable& table) {
         table.project(columns);
     });
+    m_numColumns = columns.size();
+    remapProperties(columns);
 }
 
 void GlobalTable::shuffle(int shuffleType, const std::vector<int> key, int seed, int by_col_size_bound) {
+    if (shuffleType == SHUFFLE_BY_KEY && hashPartitionedOn(key, seed)) {
+        log_info("Table %d is already partitioned on the key, skip shuffle", id);
+        return;
+    }
     int origin_size = size();
     std::string shuffleTypeStr;
     if (shuffleType == RANDOM_SHUFFLE) {
@@ -250,40 +330,72 @@ void GlobalTable::shuffle(int shuffleType, const std::vector<int> key, int seed,
     }
 
     // get the max local table size for shuffleByKey
-    int max_n = 0, size_bound = 0;
+    int max_n = 0, size_bound = 0, overflow_bound = 0;
     if (shuffleType == SHUFFLE_BY_KEY) {
-        boost::mutex mutex;
-
-        parallel_for_each([&max_n, &mutex](LocalTable& table) {
-            int cur_size = table.size();
-            {
-                boost::lock_guard<boost::mutex> lock(mutex);
-                if (cur_size > max_n) {
-                    max_n = cur_size;
-                }
-            }
-        });
-
-        size_bound = utils::getSizeBound(max_n, utils::num_partitions);
-        if (size_bound > max_n) size_bound = max_n;
+        for (int n : m_sizes)
+            max_n = std::max(max_n, n);
+
+        if (utils::two_round_shuffle) {
+            utils::getTwoRoundBounds(max_n, utils::num_partitions, &size_bound, &overflow_bound);
+        } else {
+            size_bound = utils::getSizeBound(max_n, utils::num_partitions);
+            if (size_bound > max_n) size_bound = max_n;
+        }
     }
+    // the overflow reaches its targets only after partition 0 has relayed it, so no streaming merge
+    bool two_round = overflow_bound > 0;
+    bool streaming = utils::streaming_shuffle() && !two_round;
 
-    parallel_for_each([&shuffleType, &key, this, &seed, &size_bound, &by_col_size_bound](LocalTable& table) {
+    parallel_for_each([&shuffleType, &key, this, &seed, &size_bound, &overflow_bound, &two_round, &streaming, &by_col_size_bound](LocalTable& table) {
         if (shuffleType == RANDOM_SHUFFLE) {
             table.randomShuffle(utils::num_partitions);
+        } else if (shuffleType == SHUFFLE_BY_KEY && two_round) {
+            table.shuffleByKeyTwoRound(utils::num_partitions, key, seed, size_bound, overflow_bound);
         } else if (shuffleType == SHUFFLE_BY_KEY) {
             table.shuffleByKey(utils::num_partitions, key, seed, size_bound);
         } else if (shuffleType == SHUFFLE_BY_COL) {
             table.shuffleByCol(utils::num_partitions, key[0], by_col_size_bound);
         }
+        // a worker that is done writing starts reading, taking each file as it arrives
+        if (streaming)
+            table.shuffleMerge(utils::num_partitions);
     });
 
-    utils::update_phase("<" + shuffleTypeStr + " write>");
+    if (streaming) {
+        utils::update_phase("<" + shuffleTypeStr + " stream>");
+    } else {
+        utils::update_phase("<" + shuffleTypeStr + " write>");
+
+        if (two_round) {
+            m_localTables[0].shuffleRelay(utils::num_partitions, overflow_bound);
+            utils::update_phase("<shuffle relay overflow>");
+        }
 
-    parallel_for_each([](LocalTable& table) {
-        table.shuffleMerge(utils::num_partitions);
-    });
-    utils::update_phase("<shuffle read>");
+        parallel_for_each([&two_round](LocalTable& table) {
+            table.shuffleMerge(utils::num_partitions, two_round);
+        });
+        utils::update_phase("<shuffle read>");
+    }
+
+    // a padded shuffle sends min(bound, n) rows from every partition to every partition
+    int bound = shuffleType == SHUFFLE_BY_KEY ? size_bound : shuffleType == SHUFFLE_BY_COL ? by_col_size_bound : 0;
+    int received = 0;
+    for (int n : m_sizes) {
+        if (bound <= 0 || n <= 0) {
+            received = -1;
+            break;
+        }
+        received += std::min(bound, n);
+    }
+    // and partition 0 relays overflow_bound rows of overflow to every partition
+    if (received >= 0)
+        received += overflow_bound;
+    setSizes(received);
+    forgetProperties();
+    if (shuffleType == SHUFFLE_BY_KEY) {
+        m_properties.hash_key = key;
+        m_properties.hash_seed = seed;
+    }
 
     int padded_size = size();
     float padding_rate = 100.0 * (padded_size - origin_size) / origin_size;
@@ -294,9 +406,10 @@ void GlobalTable::randomShuffle() {
     shuffle(RANDOM_SHUFFLE, {});
 }
 
-int size_bound_for_sorting(int N, int p, int n0, int ni) {
+// sample is the number of rows the splitters were chosen from
+int size_bound_for_sorting(int N, int p, int sample, int ni) {
     // compute c1
-    double b = 2.0 * (utils::KAPPA + 1 + log(N)) * p / n0;
+    double b = 2.0 * (utils::KAPPA + 1 + log(N)) * p / sample;
     double c1 = (b + sqrt(b * b + 4 * b)) / 2;
     // compute c2
     b = (utils::KAPPA + 1.0 + 2 * log(p)) * p * (1 + c1) / ni;
@@ -320,6 +433,12 @@ void GlobalTable::mvJoinColsAhead(std::vector<int> join_cols) {
     }
 
     parallel_for_each([&](LocalTable& table) { table.mvJoinColsAhead(join_cols); });
+    // the join columns, then the others in their order
+    std::vector<int> order = join_cols;
+    for (int j = 0; j < numColumns(); j++)
+        if (std::find(join_cols.begin(), join_cols.end(), j) == join_cols.end())
+            order.push_back(j);
+    remapProperties(order);
 }
 
 std::vector<LocalTable>& GlobalTable::getLocalTables() {
@@ -333,6 +452,12 @@ void GlobalTable::union_table(GlobalTable& r_table) {
     parallel_for_each_i([&](int i) {
         m_localTables[i].union_table(r_table.getLocalTables()[i].getGlobalId(), r_table.getLocalTables()[i].getId());
     });
+    for (int i = 0; i < m_sizes.size(); i++)
+        m_sizes[i] = m_sizes[i] < 0 || r_table.m_sizes[i] < 0 ? -1 : m_sizes[i] + r_table.m_sizes[i];
+    // the rows of r_table follow ours, so only a partitioning both tables share survives
+    forgetOrder();
+    if (!r_table.hashPartitionedOn(m_properties.hash_key, m_properties.hash_seed))
+        forgetProperties();
 }
 
 int size_bound_soda(int N1, int N2, int a1, int a2, int p, int threshold) {
@@ -422,34 +547,38 @@ void GlobalTable::soda_join(GlobalTable& r_table, std::vector<int> r_cols, std::
     copy().shuffle(SHUFFLE_BY_KEY, {0});
 
     //  step 12
+    int r_col_e_id = r_table.numColumns();
     r_table.parallel_for_each([&](LocalTable& table) {
         table.addCol(0);
-        table.assignColE(r_table.numColumns() - 1);
+        table.assignColE(r_col_e_id);
     });
+    r_table.addColumns(1);
 
     // step 13
     int threshold = utils::getSizeBound(M / p + a1 * a2, p);
     int shuffle_by_col_padding_size = size_bound_soda(N1, N2, a1, a2, utils::num_partitions, threshold);
-    r_table.shuffle(SHUFFLE_BY_COL, {r_table.numColumns() - 1}, -1, shuffle_by_col_padding_size);
+    r_table.shuffle(SHUFFLE_BY_COL, {r_col_e_id}, -1, shuffle_by_col_padding_size);
 
     // step 14
-    int r_col_e_id = r_table.numColumns() - 1;
     r_table.parallel_for_each([&](LocalTable& table) {
         table.deleteCol(r_col_e_id);
     });
+    r_table.addColumns(-1);
 
     //  step 15
+    int s_col_e_id = numColumns();
     parallel_for_each([&](LocalTable& table) {
         table.addCol(0);
-        table.assignColE(numColumns() - 1);
+        table.assignColE(s_col_e_id);
     });
+    addColumns(1);
 
-    shuffle(SHUFFLE_BY_COL, {numColumns() - 1}, -1, shuffle_by_col_padding_size);
+    shuffle(SHUFFLE_BY_COL, {s_col_e_id}, -1, shuffle_by_col_padding_size);
 
-    int s_col_e_id = numColumns() - 1;
     parallel_for_each([&](LocalTable& table) {
         table.deleteCol(s_col_e_id);
     });
+    addColumns(-1);
 
     // step 16
 
@@ -467,7 +596,8 @@ void GlobalTable::soda_join(GlobalTable& r_table, std::vector<int> r_cols, std::
     //step 18
     // shuffle(SHUFFLE_BY_KEY,{0});
 
-    int max_n = r_table.m_localTables[0].size();
+    r_table.size();
+    int max_n = r_table.m_sizes[0];
     int size_bound = utils::getSizeBound(max_n, utils::num_partitions);
     if (size_bound > max_n) size_bound = max_n;
     r_table.shuffle(SHUFFLE_BY_KEY, {0}, 0, size_bound);
@@ -485,17 +615,25 @@ void GlobalTable::opaque_pkjoin(GlobalTable& r_table, std::vector<int> r_cols, s
     /* insert columns into r_table and s_table to align */
     int r_start = ori_r_col_num;
     int r_align_col_num = ori_s_col_num - join_col_num;
+    LocalPlan r_align;
+    for (int i = 0; i < r_align_col_num; i++)
+        r_align.addCol(utils::DUMMY_VAL, r_start + i);
     r_table.parallel_for_each([&](LocalTable& table) {
-        for (int i = 0; i < r_align_col_num; i++)
-            table.addCol(utils::DUMMY_VAL, r_start + i);
+        table.run(r_align);
     });
+    r_table.addColumns(r_align_col_num);
+    r_table.insertColumns(r_start, r_align_col_num);
 
     int s_start = join_col_num;
     int s_align_col_num = ori_r_col_num - join_col_num;
+    LocalPlan s_align;
+    for (int i = 0; i < s_align_col_num; i++)
+        s_align.addCol(utils::DUMMY_VAL, s_start + i);
     parallel_for_each([&](LocalTable& table) {
-        for (int i = 0; i < s_align_col_num; i++)
-            table.addCol(utils::DUMMY_VAL, s_start + i);
+        table.run(s_align);
     });
+    addColumns(s_align_col_num);
+    insertColumns(s_start, s_align_col_num);
     union_table(r_table);
 
     // step 2
@@ -517,6 +655,7 @@ int GlobalTable::appendCol(int defaultVal) {
     parallel_for_each([&](LocalTable& table) {
         table.addCol(defaultVal);
     });
+    addColumns(1);
     return numColumns() - 1;
 }
 
@@ -541,20 +680,24 @@ void GlobalTable::computeDegrees(GlobalTable& r_table, GlobalTable& s_table, con
     // pk join attach degrees
     auto projected_cols = s_cols;
     projected_cols.push_back(ss_col);
-    _s_table.project(projected_cols);
     // auto _s_cols = s_cols;
     // std::iota(_s_cols.begin(), _s_cols.end(), 0);  // _s_cols = {0,1,...}
     _s_table.parallel_for_each([&](LocalTable& table) {
-        table.remove_dup_after_prefix(s_cols);
+        table.run(LocalPlan().project(projected_cols).remove_dup_after_prefix(s_cols));
     });
+    _s_table.m_numColumns = projected_cols.size();
+    _s_table.remapProperties(projected_cols);
+    _s_table.forgetOrder();  // the duplicates became dummies in place
     _s_table.pkjoin(r_table, r_cols, s_cols, false);
 
     projected_cols = r_cols;
     projected_cols.push_back(rr_col);
-    _r_table.project(projected_cols);
     _r_table.parallel_for_each([&](LocalTable& table) {
-        table.remove_dup_after_prefix(r_cols);
+        table.run(LocalPlan().project(projected_cols).remove_dup_after_prefix(r_cols));
     });
+    _r_table.m_numColumns = projected_cols.size();
+    _r_table.remapProperties(projected_cols);
+    _r_table.forgetOrder();
     _r_table.pkjoin(s_table, s_cols, r_cols, false);
 }
 
@@ -581,6 +724,7 @@ void GlobalTable::join(GlobalTable& r_table, std::vector<int> r_cols, std::vecto
     r_table.parallel_for_each([&](LocalTable& table) {
         table.deleteCol(rr_col);
     });
+    r_table.addColumns(-1);
     r_num_cols -= 2;  // rr_col and rs_col were removed
     int ss_col = s_num_cols - 2, sr_col = s_num_cols - 1;
     expansion(sr_col, M, false);
@@ -600,6 +744,7 @@ void GlobalTable::join(GlobalTable& r_table, std::vector<int> r_cols, std::vecto
     parallel_for_each([&](LocalTable& table) {
         table.joinComputeAlignment(m);
     });
+    addColumns(2);
     s_num_cols += 2;
     randomShuffle();
     int size_bound = utils::getSizeBound(m, utils::num_partitions);
@@ -607,6 +752,9 @@ void GlobalTable::join(GlobalTable& r_table, std::vector<int> r_cols, std::vecto
     parallel_for_each_i([&](int i) {
         m_localTables[i].joinFinalCombine(r_table.m_localTables[i], r_cols.size());
     });
+    r_table.addColumns(s_num_cols - 6 - (int)r_cols.size());
+    r_table.forgetProperties();
+    forgetProperties();
 }
 
 void GlobalTable::pkjoin(GlobalTable& r_table, std::vector<int> r_cols, std::vector<int> s_cols, bool need_move_cols) {
@@ -630,13 +778,19 @@ void GlobalTable::pkjoin(GlobalTable& r_table, std::vector<int> r_cols, std::vec
     std::vector<int> new_join_cols;
     for (int i = 0; i < join_col_num; i++)
         new_join_cols.push_back(i);
+    // r_table comes sorted on the join columns from join (see computeDegrees)
+    bool r_sorted = r_table.locallySortedOn(new_join_cols);
     r_table.parallel_for_each([&](LocalTable& table) {
-        table.localSort(new_join_cols);
-        table.addCol(table.getId());  //add column I
-        table.addCol(0);              //add column Z
-        table.foreignTableModifyColZ(new_join_cols);
+        LocalPlan plan;
+        if (!r_sorted)
+            plan.localSort(new_join_cols);
+        table.run(plan
+                      .addCol(table.getId())  //add column I
+                      .addCol(0)              //add column Z
+                      .foreignTableModifyColZ(new_join_cols));
     });
-    utils::update_phase("<pkjoin local sort R>");
+    r_table.addColumns(2);
+    utils::update_phase(r_sorted ? "<pkjoin prepare R>" : "<pkjoin local sort R>");
 
     std::vector<int> r_shuffle_cols = new_join_cols;
     r_shuffle_cols.push_back(r_table.numColumns() - 1);
@@ -644,9 +798,11 @@ void GlobalTable::pkjoin(GlobalTable& r_table, std::vector<int> r_cols, std::vec
     r_table.shuffle(SHUFFLE_BY_KEY, r_shuffle_cols, seed, true);
 
     parallel_for_each([&](LocalTable& table) {
-        table.addCol(-1);  //  add column I, -1 represents that this row is from s_table
-        table.addCol(0);   //  add column Z, all Z values are 0 in s_table
+        table.run(LocalPlan()
+                      .addCol(-1)    //  add column I, -1 represents that this row is from s_table
+                      .addCol(0));   //  add column Z, all Z values are 0 in s_table
     });
+    addColumns(2);
     std::vector<int> s_shuffle_cols = new_join_cols;
     s_shuffle_cols.push_back(numColumns() - 1);
     shuffle(SHUFFLE_BY_KEY, s_shuffle_cols, seed);
@@ -655,17 +811,25 @@ void GlobalTable::pkjoin(GlobalTable& r_table, std::vector<int> r_cols, std::vec
     /* insert columns into r_table and s_table to align */
     int r_start = ori_r_col_num;
     int r_align_col_num = ori_s_col_num - join_col_num;
+    LocalPlan r_align;
+    for (int i = 0; i < r_align_col_num; i++)
+        r_align.addCol(utils::DUMMY_VAL, r_start + i);
     r_table.parallel_for_each([&](LocalTable& table) {
-        for (int i = 0; i < r_align_col_num; i++)
-            table.addCol(utils::DUMMY_VAL, r_start + i);
+        table.run(r_align);
     });
+    r_table.addColumns(r_align_col_num);
+    r_table.insertColumns(r_start, r_align_col_num);
 
     int s_start = join_col_num;
     int s_align_col_num = ori_r_col_num - join_col_num;
+    LocalPlan s_align;
+    for (int i = 0; i < s_align_col_num; i++)
+        s_align.addCol(utils::DUMMY_VAL, s_start + i);
     parallel_for_each([&](LocalTable& table) {
-        for (int i = 0; i < s_align_col_num; i++)
-            table.addCol(utils::DUMMY_VAL, s_start + i);
+        table.run(s_align);
     });
+    addColumns(s_align_col_num);
+    insertColumns(s_start, s_align_col_num);
 
     /* Combine r_table and s_table's local tables in the same partition */
     std::vector<int> combine_sort_cols = new_join_cols;
@@ -676,42 +840,41 @@ void GlobalTable::pkjoin(GlobalTable& r_table, std::vector<int> r_cols, std::vec
     });
     utils::update_phase("<pkjoin combine1>");
 
-    int loc_size = r_table.m_localTables[0].size();
+    // the combined partitions keep the sizes r_table had; size() asks for them if they are not tracked,
+    // since an unknown (-1) size would leave the shuffle without padding
+    r_table.size();
+    int loc_size = r_table.m_sizes[0];
     if (loc_size % utils::num_partitions != 0) {
         log_error("shuffle by col error in pk join! loc_size=%d, num partitions=%d", loc_size, utils::num_partitions);
     }
     r_table.shuffle(SHUFFLE_BY_COL, {r_table.numColumns() - 2}, -1, loc_size / utils::num_partitions);
 
-    /* Finalize r_table's join result */
+    /* Finalize r_table's join result, then delete Col I and Col Z */
     std::vector<int> result_sort_cols = new_join_cols;
     result_sort_cols.push_back(numColumns() - 1);  // sort by join_cols + Z col
-    r_table.parallel_for_each([&](LocalTable& table) {
-        table.finalizePkjoinResult(result_sort_cols, ori_r_col_num, r_align_col_num);
-    });
-    utils::update_phase("<pkjoin combine2>");
-
-    /* Delete Col I and Col Z */
     int cur_col_num = ori_r_col_num + ori_s_col_num - join_col_num + 2;
-
     r_table.parallel_for_each([&](LocalTable& table) {
-        table.deleteCol(cur_col_num - 1);  //delete column Z
-        table.deleteCol(cur_col_num - 2);  //delete column I
+        table.run(LocalPlan()
+                      .finalizePkjoinResult(result_sort_cols, ori_r_col_num, r_align_col_num)
+                      .deleteCol(cur_col_num - 1)    //delete column Z
+                      .deleteCol(cur_col_num - 2));  //delete column I
     });
+    r_table.addColumns(-2);
+    forgetProperties();  // our rows went into r_table
+    utils::update_phase("<pkjoin combine2>");
 }
 
 int GlobalTable::expansion(int d_index, long long M, bool delete_expand_col) {
     int num_cols = numColumns();
     int m = M / utils::num_partitions + (M % utils::num_partitions != 0);
 
-    /* set dummy tuple's col D to 0 */
-    parallel_for_each([&](LocalTable& table) {
-        table.expansion_prepare(d_index);
-    });
-
-    /* calculate column L */
+    /* set dummy tuple's col D to 0, then calculate column L */
     parallel_for_each([&](LocalTable& table) {
-        table.copyCol();  //  copy col D
+        table.run(LocalPlan()
+                      .expansion_prepare(d_index)
+                      .copyCol());  //  copy col D
     });
+    addColumns(1);
     int l_index = num_cols++;  // one column added
     OperatorAdd op_add({}, l_index);
 
@@ -725,6 +888,7 @@ int GlobalTable::expansion(int d_index, long long M, bool delete_expand_col) {
         //  add column T, P and calculate their values
         table.add_and_calculate_col_t_p(d_index, m);
     });
+    addColumns(2);
     num_cols += 2;  //  two columns added
     randomShuffle();
     int padding_size = utils::getSizeBound(m, utils::num_partitions);
@@ -737,24 +901,16 @@ int GlobalTable::expansion(int d_index, long long M, bool delete_expand_col) {
         // distribute
         // delete col P,T,L
     });
+    addColumns(-3);
+    setSizes(m);
     utils::update_phase("<expansion distribute>");
 
     // print(5, true);
 
-    /* Suffix sum */
-    parallel_for_each([&](LocalTable& table) {
-        table.expansion_suffix_sum(1);
-    });
-    utils::update_phase("<suffix sum phase 1>");
-    // print(5, true);
-    m_localTables[0].expansion_suffix_sum(2);
-    utils::update_phase("<suffix sum phase 2 id 0>");
-    // this two phase should be separated
-    parallel_for_each_i([&](int i) {
-        if (i > 0)
-            m_localTables[i].expansion_suffix_sum(2);
-    });
-    utils::update_phase("<suffix sum phase 2 id not 0>");
+    /* Suffix sum: every dummy tuple takes the first real tuple after it */
+    OperatorCopy op_copy;
+    groupByPrefixAggregate(op_copy, true);
+    utils::update_phase("<suffix sum>");
     // print(5, true);
 
     /* delete col D */
@@ -762,24 +918,50 @@ int GlobalTable::expansion(int d_index, long long M, bool delete_expand_col) {
         parallel_for_each([&](LocalTable& table) {
             table.deleteCol(d_index);  //   delete col D
         });
+        addColumns(-1);
     }
     return m;
 }
 
 void GlobalTable::sort(const std::vector<int>& columns) {
+    if (sortedOn(columns)) {
+        log_info("Table %d is already sorted on the columns, skip sort", id);
+        return;
+    }
     randomShuffle();  // dummy elements would also be removed
     int N = size();
     int p = utils::num_partitions;
-    int n0 = m_localTables[0].size();
 
+    // the splitters are the quantiles of a sample of up to sort_sample_size rows from every partition
+    int sample = 0;
+    for (int n : m_sizes)
+        sample += std::min(utils::sort_sample_size, n);
+    parallel_for_each([&](LocalTable& table) {
+        table.samplePivots(utils::sort_sample_size);
+    });
     m_localTables[0].getPivots(columns);
 
     utils::update_phase("<sort get pivots>");
-    parallel_for_each([&](LocalTable& table) {
-        int ni = table.size();
-        int size_bound = size_bound_for_sorting(N, p, n0, ni);
-        table.partitionByPivots(columns, size_bound);
+    // every partition sends size_bound rows to each partition
+    int received = 0;
+    std::vector<int> size_bounds(p);
+    for (int i = 0; i < p; i++) {
+        size_bounds[i] = size_bound_for_sorting(N, p, sample, m_sizes[i]);
+        received = m_sizes[i] <= 0 || received < 0 ? -1 : received + size_bounds[i];
+    }
+    parallel_for_each_i([&](int i) {
+        m_localTables[i].partitionByPivots(columns, size_bounds[i]);
+        if (utils::streaming_shuffle())
+            m_localTables[i].sortMerge(columns);
     });
+    setSizes(received);
+    forgetProperties();
+    m_properties.sorted_on = columns;
+    m_properties.range_partitioned = true;
+    if (utils::streaming_shuffle()) {
+        utils::update_phase("<sort partition and merge>");
+        return;
+    }
     utils::update_phase("<sort partition by pivots>");
 
     parallel_for_each([&](LocalTable& table) {
@@ -803,9 +985,13 @@ void GlobalTable::opaque_sort(const std::vector<int>& columns) {
             m_localTables[j].localSort(columns);
             half.getLocalTables()[j].opaque_prepare_shuffle_col(-1, -1);
         });
+        for (int& n : half.m_sizes)
+            n = n < 0 ? -1 : n / 2;
         utils::update_phase();
         half.randomShuffle();
     }
+    forgetProperties();
+    m_properties.sorted_on = columns;
     utils::update_phase();
 }
 
@@ -828,9 +1014,9 @@ int GlobalTable::max(int column) {
     boost::mutex mutex;
     parallel_for_each([&ret, &mutex, column](LocalTable& table) {
         int cur = table.max(column);
-        int cond = cur > ret;
         {
             boost::lock_guard<boost::mutex> lock(mutex);
+            int cond = cur > ret;
             ret ^= (-cond) & (ret ^ cur);
         }
     });
@@ -848,7 +1034,8 @@ long long GlobalTable::SODA_step1(std::vector<int> columns, int aggCol) {
             ret += cur_ret;
         }
     });
-
+    // every partition was sorted on columns, and the rows after the first of a group made dummies
+    forgetProperties();
     return ret;
 }
 
@@ -856,73 +1043,76 @@ void GlobalTable::SODA_step2(int p) {
     parallel_for_each([p](LocalTable& table) {
         table.SODA_step2(p);
     });
+    forgetProperties();
 }
 
 void GlobalTable::SODA_step3(int p) {
     parallel_for_each([p](LocalTable& table) {
         table.SODA_step3(p);
     });
+    forgetProperties();
 }
 
 void GlobalTable::localJoin(GlobalTable& r_table, std::vector<int> r_cols, std::vector<int> s_cols, int& output_bound) {
+    bool pk_join = output_bound == -1;
     mvJoinColsAhead(s_cols);
     r_table.mvJoinColsAhead(r_cols);
     // when output_bound = 0 (single join), it is modified to the true value
     parallel_for_each_i([&](int i) {
         output_bound = m_localTables[i].localJoin(r_table.id, r_table.m_localTables[i].getId(), r_cols.size(), output_bound);
     });
+    // r_table receives the joined rows; a pk join keeps the sizes of r_table, otherwise both sides are expanded
+    r_table.addColumns(numColumns() - (int)r_cols.size());
+    if (!pk_join) {
+        r_table.forgetSizes();
+        forgetSizes();
+    }
+    r_table.forgetProperties();
+    forgetProperties();
 }
 
 void GlobalTable::SODA_step5() {
     parallel_for_each([](LocalTable& table) {
         table.SODA_step5();
     });
+    forgetProperties();
 }
 
 void GlobalTable::groupByPrefixAggregate(AssociateOperator& op, bool reverse) {
-    // std::vector<Tuple> last_tuples;
-
-    /* phase1:
-     * each local table do prefix sum and write the last tuple into files 
-     * local_table i write to gid(x)_lid(i)_tlid0
-    */
-    parallel_for_each([&](LocalTable& table) {
-        table.groupByPrefixAggregate(op, 1, reverse);
-    });
-    // m_stat.addComm(utils::num_partitions * (1 + op.group_by_columns.size()));
-
-    /* phase2:
-     * local table 0 acts as a role to calculate, write the result to files, but not change its own data 
-     * the read tuple num will be (num_partitions - 1), after do prefix sum to those tuples,
-     * write the i'th result tuple to gid(x)_lid0_tlid(i+1)
-    */
-    m_localTables[0].groupByPrefixAggregate(op, 2, reverse);
-    // LocalTable last_tuples_table(last_tuples);
-    // last_tuples_table.groupByPrefixAggregate(op, 2);
-
-    /* phase3: 
-     * add to [1, ..., utils::num_partitions-1 ] local_tables
+    /* round 0: each local table does its prefix aggregate, and sends its last tuple on
+     * round k: each local table takes in the aggregate of the 2^(k-1) partitions that end 2^(k-1) partitions
+     * before it (after it if reverse), and passes on what it has covered; the last round adds the
+     * aggregate of all the partitions before it to its own tuples
+     * so no partition waits for all the others, and there are ceil(log2 p) rounds after round 0
      */
-    int start = 0, end = utils::num_partitions - 1, step = 1;
-    if (reverse) {
-        start = 1;
-        end = utils::num_partitions;
-        step = -1;
+    int rounds = 0;
+    while ((1 << rounds) < utils::num_partitions)
+        rounds++;
+    for (int round = 0; round <= rounds; round++) {
+        parallel_for_each([&](LocalTable& table) {
+            table.groupByPrefixAggregate(op, round, reverse);
+        });
     }
-    parallel_for_each_i([&](int i) {
-        if ((!reverse && i > 0) || (reverse && i < utils::num_partitions - 1))
-            m_localTables[i]._addValueByKey(op);
-    });
+    // rows stay in place; a copy overwrites whole rows, dummies included
+    if (op.op_id == AssociateOperator::COPY)
+        forgetProperties();
+    else
+        changedColumn(op.aggregate_column);
 }
 
 // Input not need to be sorted
 void GlobalTable::sodaGroupByAggregate(AssociateOperator& op) {
     auto group_by_columns = op.group_by_columns;
     int num_columns = group_by_columns.size();
+    bool sorted = locallySortedOn(group_by_columns);
     parallel_for_each([&](LocalTable& table) {
-        table.localSort(group_by_columns);
+        if (!sorted)
+            table.localSort(group_by_columns);
         table.groupByAggregate(op);
     });
+    // groupByAggregate leaves dummies between the groups
+    forgetOrder();
+    changedColumn(op.aggregate_column);
 
     /* do projection */
     auto project_cols = group_by_columns;
@@ -935,11 +1125,19 @@ void GlobalTable::sodaGroupByAggregate(AssociateOperator& op) {
     for (int i = 0; i < num_columns; i++)
         group_by_columns[i] = i;
 
-    shuffle(SHUFFLE_BY_KEY, group_by_columns);
-
     op.group_by_columns = group_by_columns;
     op.aggregate_column = num_columns;
 
+    // if every group already lives in one partition, the local aggregate is the final one
+    auto& hash_key = m_properties.hash_key;
+    bool co_located = !hash_key.empty() && std::all_of(hash_key.begin(), hash_key.end(), [num_columns](int column) {
+        return column < num_columns;
+    });
+    if (co_located)
+        return;
+
+    shuffle(SHUFFLE_BY_KEY, group_by_columns);
+
     parallel_for_each([&](LocalTable& table) {
         table.localSort(group_by_columns);
         table.groupByAggregate(op);
@@ -951,6 +1149,8 @@ void GlobalTable::soda_shuffleByKey(const std::vector<int>& cols) {
     parallel_for_each([&](LocalTable& table) {
         table.soda_shuffleByKey(utils::num_partitions, cols, 0);
     });
+    forgetSizes();
+    forgetProperties();
     utils::update_phase();
 }
 
@@ -958,6 +1158,7 @@ void GlobalTable::removeDummy() {
     parallel_for_each([&](LocalTable& table) {
         table.removeDummy();
     });
+    forgetSizes();
 }
 
 // input must be vectors with equal size
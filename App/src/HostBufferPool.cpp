@@ -0,0 +1,61 @@
+#include "HostBufferPool.h"
+#include "log.h"
+
+HostBufferPool::~HostBufferPool() {
+    clear();
+}
+
+uint8_t* HostBufferPool::acquire(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint8_t* buffer;
+    size_t capacity;
+    auto it = idle.lower_bound(size);
+    if (it != idle.end()) {
+        capacity = it->first;
+        buffer = it->second;
+        idle_bytes -= capacity;
+        idle.erase(it);
+    } else {
+        capacity = size > 0 ? size : 1;
+        buffer = new uint8_t[capacity];
+    }
+    lent[buffer] = capacity;
+    return buffer;
+}
+
+void HostBufferPool::release(uint8_t* buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = lent.find(buffer);
+    if (it == lent.end()) {
+        log_error("Buffer %p was not acquired from the pool", buffer);
+        return;
+    }
+    idle.emplace(it->second, buffer);
+    idle_bytes += it->second;
+    lent.erase(it);
+    trim();
+}
+
+void HostBufferPool::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& it : idle)
+        delete[] it.second;
+    idle.clear();
+    idle_bytes = 0;
+}
+
+void HostBufferPool::setMaxIdleBytes(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    max_idle_bytes = bytes;
+    trim();
+}
+
+void HostBufferPool::trim() {
+    // acquire takes the smallest buffer that fits, so the largest ones serve the most requests
+    while (idle_bytes > max_idle_bytes) {
+        auto it = idle.begin();
+        idle_bytes -= it->first;
+        delete[] it->second;
+        idle.erase(it);
+    }
+}
@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <iostream>
 #include <random>
+#include <stdexcept>
 //#include "define.h"
 #include <cmath>
 #include <fstream>
@@ -9,7 +10,7 @@
 #include <vector>
 #include "App.h"
 #include "Enclave_u.h"
-#include "ReqSender.h"
+#include "Rpc.h"
 #include "log.h"
 #include "utils.h"
 
@@ -18,13 +19,7 @@ extern sgx_enclave_id_t global_eid; /* global enclave id */
 LocalTable::LocalTable(int global_id_, int id_, std::string filePath_, bool is_handle, std::string url) : global_id(global_id_), id(id_), filePath(filePath_), is_handle_(is_handle), url_(url) {
     if (is_handle_) {
         // if it is handle itself, send request to remote LocalTable to execute
-        unordered_map<string, string> header_map = {
-            {"task",      "create_local_table"      },
-            {"global_id", std::to_string(global_id_)},
-            {"local_id",  std::to_string(id_)       },
-            {"file_path", filePath_                 }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::CREATE_LOCAL_TABLE).put(global_id_).put(id_).put(filePath_));
     } else {
         m_tuples = std::vector<Tuple>();
         if (filePath_ == "") {
@@ -48,12 +43,7 @@ LocalTable::LocalTable(int global_id_, int id_, std::string filePath_, bool is_h
 
 const int LocalTable::size() {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "size"                   },
-            {"global_id", std::to_string(global_id)}
-        };
-        std::string ret = utils::extractRet(send_get_request(url_, header_map));
-        return std::stoi(ret);
+        return rpc::call(url_, rpc::Writer(rpc::SIZE).put(global_id)).get_int();
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_size(global_eid, &ret, global_id, id);
@@ -68,14 +58,7 @@ const int LocalTable::size() {
 
 const int LocalTable::num_columns() {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "num_columns"            },
- // {"worker_id", std::to_string(id_)},
-            {"global_id", std::to_string(global_id)}
-        };
-        std::string ret = utils::extractRet(send_get_request(url_, header_map));
-        log_debug("num_columns ret is %s", ret.c_str());
-        return std::stoi(ret);
+        return rpc::call(url_, rpc::Writer(rpc::NUM_COLUMNS).put(global_id)).get_int();
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_num_columns(global_eid, &ret, global_id, id);
@@ -95,13 +78,7 @@ std::vector<Tuple>& LocalTable::getData() {
 void LocalTable::print(int limit_size, bool show_dummy)  //TODO::: move the logic to enclave
 {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",       "print"                   },
-            {"limit_size", std::to_string(limit_size)},
-            {"show_dummy", std::to_string(show_dummy)},
-            {"global_id",  std::to_string(global_id) }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::PRINT).put(global_id).put(limit_size).put((int)show_dummy));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_print(global_eid, &ret, global_id, id, limit_size, show_dummy);
@@ -118,12 +95,7 @@ void LocalTable::showInfo() {
 
 LocalTable LocalTable::copy(int new_global_id) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",          "copy"                       },
-            {"global_id",     std::to_string(global_id)    },
-            {"new_global_id", std::to_string(new_global_id)}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::COPY).put(global_id).put(new_global_id));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_copy(global_eid, &ret, global_id, id, new_global_id);
@@ -174,13 +146,7 @@ void LocalTable::sample(double rate, std::vector<Tuple>& output) {
 
 void LocalTable::partitionByPivots(const std::vector<int> columns, int size_bound) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",       "partitionByPivots"           },
-            {"columns",    utils::vectorToString(columns)},
-            {"size_bound", std::to_string(size_bound)    },
-            {"global_id",  std::to_string(global_id)     }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::PARTITION_BY_PIVOTS).put(global_id).put(columns).put(size_bound));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_partitionByPivots(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size(), size_bound);
@@ -188,19 +154,14 @@ void LocalTable::partitionByPivots(const std::vector<int> columns, int size_boun
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_partitionByPivots failed");
     }
 }
 
 void LocalTable::shuffleByCol(int num_partitions, int i_col_id, int size_bound) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",           "shuffleByCol"                },
-            {"global_id",      std::to_string(global_id)     },
-            {"num_partitions", std::to_string(num_partitions)},
-            {"i_col_id",       std::to_string(i_col_id)      },
-            {"size_bound",     std::to_string(size_bound)    }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::SHUFFLE_BY_COL).put(global_id).put(num_partitions).put(i_col_id).put(size_bound));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_shuffleByCol(global_eid, &ret, global_id, id, num_partitions, i_col_id, size_bound);
@@ -208,20 +169,14 @@ void LocalTable::shuffleByCol(int num_partitions, int i_col_id, int size_bound)
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_shuffleByCol failed");
     }
 }
 
 void LocalTable::shuffleByKey(int num_partitions, const std::vector<int> key, int seed, int size_bound) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",           "shuffleByKey"                },
-            {"global_id",      std::to_string(global_id)     },
-            {"num_partitions", std::to_string(num_partitions)},
-            {"key",            utils::vectorToString(key)    },
-            {"seed",           std::to_string(seed)          },
-            {"size_bound",     std::to_string(size_bound)    }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::SHUFFLE_BY_KEY).put(global_id).put(num_partitions).put(key).put(seed).put(size_bound));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_shuffleByKey(global_eid, &ret, global_id, id, num_partitions, const_cast<int*>(key.data()), key.size(), seed, size_bound);
@@ -229,35 +184,59 @@ void LocalTable::shuffleByKey(int num_partitions, const std::vector<int> key, in
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_shuffleByKey failed");
     }
 }
 
-void LocalTable::shuffleMerge(int num_partitions) {
+void LocalTable::shuffleByKeyTwoRound(int num_partitions, const std::vector<int> key, int seed, int size_bound, int overflow_bound) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",           "shuffleMerge"                },
-            {"global_id",      std::to_string(global_id)     },
-            {"num_partitions", std::to_string(num_partitions)}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::SHUFFLE_BY_KEY_TWO_ROUND).put(global_id).put(num_partitions).put(key).put(seed).put(size_bound).put(overflow_bound));
     } else {
         int ret;
-        sgx_status_t ecall_status = ecall_shuffleMerge(global_eid, &ret, global_id, id, num_partitions);
+        sgx_status_t ecall_status = ecall_shuffleByKeyTwoRound(global_eid, &ret, global_id, id, num_partitions, const_cast<int*>(key.data()), key.size(), seed, size_bound, overflow_bound);
         if (ecall_status) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_shuffleByKeyTwoRound failed");
+    }
+}
+
+void LocalTable::shuffleRelay(int num_partitions, int overflow_bound) {
+    if (is_handle_) {
+        rpc::call(url_, rpc::Writer(rpc::SHUFFLE_RELAY).put(global_id).put(num_partitions).put(overflow_bound));
+    } else {
+        int ret;
+        sgx_status_t ecall_status = ecall_shuffleRelay(global_eid, &ret, global_id, id, num_partitions, overflow_bound);
+        if (ecall_status) {
+            print_error_message(ecall_status);
+            log_error("ecall failed");
+        }
+        if (ret < 0)
+            throw std::runtime_error("ecall_shuffleRelay failed");
+    }
+}
+
+void LocalTable::shuffleMerge(int num_partitions, bool relayed) {
+    if (is_handle_) {
+        rpc::call(url_, rpc::Writer(rpc::SHUFFLE_MERGE).put(global_id).put(num_partitions).put((int)relayed));
+    } else {
+        int ret;
+        sgx_status_t ecall_status = ecall_shuffleMerge(global_eid, &ret, global_id, id, num_partitions, relayed);
+        if (ecall_status) {
+            print_error_message(ecall_status);
+            log_error("ecall failed");
+        }
+        if (ret < 0)
+            throw std::runtime_error("ecall_shuffleMerge failed");
     }
 }
 
 void LocalTable::randomShuffle(int num_partitions) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",           "randomShuffle"               },
-            {"global_id",      std::to_string(global_id)     },
-            {"num_partitions", std::to_string(num_partitions)}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::RANDOM_SHUFFLE).put(global_id).put(num_partitions));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_randomShuffle(global_eid, &ret, global_id, id, num_partitions);
@@ -265,17 +244,14 @@ void LocalTable::randomShuffle(int num_partitions) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_randomShuffle failed");
     }
 }
 
 void LocalTable::sortMerge(const std::vector<int> columns) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "sortMerge"                   },
-            {"columns",   utils::vectorToString(columns)},
-            {"global_id", std::to_string(global_id)     }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::SORT_MERGE).put(global_id).put(columns));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_sortMerge(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size());
@@ -283,17 +259,14 @@ void LocalTable::sortMerge(const std::vector<int> columns) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_sortMerge failed");
     }
 }
 
 void LocalTable::localSort(const std::vector<int> columns) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "localSort"                   },
-            {"columns",   utils::vectorToString(columns)},
-            {"global_id", std::to_string(global_id)     }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::LOCAL_SORT).put(global_id).put(columns));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_localSort(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size());
@@ -301,17 +274,14 @@ void LocalTable::localSort(const std::vector<int> columns) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_localSort failed");
     }
 }
 
 void LocalTable::pad_to_size(int n) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "pad_to_size"            },
-            {"global_id", std::to_string(global_id)},
-            {"n",         std::to_string(n)        }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::PAD_TO_SIZE).put(global_id).put(n));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_pad_to_size(global_eid, &ret, global_id, id, n);
@@ -319,18 +289,14 @@ void LocalTable::pad_to_size(int n) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_pad_to_size failed");
     }
 }
 
 void LocalTable::opaque_prepare_shuffle_col(int col_id, int tuple_num) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "opaque_prepare_shuffle_col"},
-            {"global_id", std::to_string(global_id)   },
-            {"col_id",    std::to_string(col_id)      },
-            {"tuple_num", std::to_string(tuple_num)   }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::OPAQUE_PREPARE_SHUFFLE_COL).put(global_id).put(col_id).put(tuple_num));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_opaque_prepare_shuffle_col(global_eid, &ret, global_id, id, col_id, tuple_num);
@@ -338,17 +304,14 @@ void LocalTable::opaque_prepare_shuffle_col(int col_id, int tuple_num) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_opaque_prepare_shuffle_col failed");
     }
 }
 
 void LocalTable::foreignTableModifyColZ(const std::vector<int> columns) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "foreignTableModifyColZ"      },
-            {"columns",   utils::vectorToString(columns)},
-            {"global_id", std::to_string(global_id)     }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::FOREIGN_TABLE_MODIFY_COL_Z).put(global_id).put(columns));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_foreignTableModifyColZ(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size());
@@ -356,17 +319,14 @@ void LocalTable::foreignTableModifyColZ(const std::vector<int> columns) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_foreignTableModifyColZ failed");
     }
 }
 
 void LocalTable::copyCol(int col_index) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "copyCol"                },
-            {"global_id", std::to_string(global_id)},
-            {"col_index", std::to_string(col_index)}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::COPY_COL).put(global_id).put(col_index));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_copyCol(global_eid, &ret, global_id, id, col_index);
@@ -374,17 +334,14 @@ void LocalTable::copyCol(int col_index) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_copyCol failed");
     }
 }
 
 void LocalTable::expansion_prepare(int d_index) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "expansion_prepare"      },
-            {"global_id", std::to_string(global_id)},
-            {"d_index",   std::to_string(d_index)  }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::EXPANSION_PREPARE).put(global_id).put(d_index));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_expansion_prepare(global_eid, &ret, global_id, id, d_index);
@@ -392,18 +349,14 @@ void LocalTable::expansion_prepare(int d_index) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_expansion_prepare failed");
     }
 }
 
 void LocalTable::add_and_calculate_col_t_p(int d_index, int m) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "add_and_calculate_col_t_p"},
-            {"global_id", std::to_string(global_id)  },
-            {"d_index",   std::to_string(d_index)    },
-            {"m",         std::to_string(m)          }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::ADD_AND_CALCULATE_COL_T_P).put(global_id).put(d_index).put(m));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_add_and_calculate_col_t_p(global_eid, &ret, global_id, id, d_index, m);
@@ -411,99 +364,157 @@ void LocalTable::add_and_calculate_col_t_p(int d_index, int m) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_add_and_calculate_col_t_p failed");
     }
 }
 
-void LocalTable::expansion_suffix_sum(int phase) {
+void LocalTable::expansion_distribute_and_clear(int m) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "expansion_suffix_sum"   },
-            {"global_id", std::to_string(global_id)},
-            {"phase",     std::to_string(phase)    }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::EXPANSION_DISTRIBUTE_AND_CLEAR).put(global_id).put(m));
     } else {
         int ret;
-        sgx_status_t ecall_status = ecall_expansion_suffix_sum(global_eid, &ret, global_id, id, phase);
+        sgx_status_t ecall_status = ecall_expansion_distribute_and_clear(global_eid, &ret, global_id, id, m);
         if (ecall_status) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_expansion_distribute_and_clear failed");
     }
 }
 
-void LocalTable::expansion_distribute_and_clear(int m) {
+void LocalTable::finalizePkjoinResult(const std::vector<int> columns, int ori_r_col_num, int r_align_col_num) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "expansion_distribute_and_clear"},
-            {"global_id", std::to_string(global_id)       },
-            {"m",         std::to_string(m)               }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::FINALIZE_PKJOIN_RESULT).put(global_id).put(columns).put(ori_r_col_num).put(r_align_col_num));
     } else {
         int ret;
-        sgx_status_t ecall_status = ecall_expansion_distribute_and_clear(global_eid, &ret, global_id, id, m);
+        sgx_status_t ecall_status = ecall_finalizePkjoinResult(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size(), ori_r_col_num, r_align_col_num);
         if (ecall_status) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_finalizePkjoinResult failed");
     }
 }
 
-void LocalTable::finalizePkjoinResult(const std::vector<int> columns, int ori_r_col_num, int r_align_col_num) {
+void LocalTable::joinComputeAlignment(int m) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",            "finalizePkjoinResult"         },
-            {"columns",         utils::vectorToString(columns) },
-            {"ori_r_col_num",   std::to_string(ori_r_col_num)  },
-            {"r_align_col_num", std::to_string(r_align_col_num)},
-            {"global_id",       std::to_string(global_id)      }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::JOIN_COMPUTE_ALIGNMENT).put(global_id).put(m));
     } else {
         int ret;
-        sgx_status_t ecall_status = ecall_finalizePkjoinResult(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size(), ori_r_col_num, r_align_col_num);
+        sgx_status_t ecall_status = ecall_joinComputeAlignment(global_eid, &ret, global_id, id, m);
         if (ecall_status) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_joinComputeAlignment failed");
     }
 }
 
-void LocalTable::joinComputeAlignment(int m) {
+void LocalTable::joinFinalCombine(LocalTable& r_table, int num_join_cols) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "joinComputeAlignment"   },
-            {"m",         std::to_string(m)        },
-            {"global_id", std::to_string(global_id)}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::JOIN_FINAL_COMBINE).put(global_id).put(r_table.getGlobalId()).put(num_join_cols));
     } else {
         int ret;
-        sgx_status_t ecall_status = ecall_joinComputeAlignment(global_eid, &ret, global_id, id, m);
+        sgx_status_t ecall_status = ecall_joinFinalCombine(global_eid, &ret, global_id, id, r_table.getGlobalId(), num_join_cols);
         if (ecall_status) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_joinFinalCombine failed");
     }
 }
 
-void LocalTable::joinFinalCombine(LocalTable& r_table, int num_join_cols) {
+LocalPlan& LocalPlan::put(const std::vector<int>& list) {
+    steps.push_back(list.size());
+    steps.insert(steps.end(), list.begin(), list.end());
+    return *this;
+}
+
+LocalPlan& LocalPlan::addCol(int defaultVal, int col_index) {
+    steps.insert(steps.end(), {ADD_COL, defaultVal, col_index});
+    return *this;
+}
+
+LocalPlan& LocalPlan::copyCol(int col_index) {
+    steps.insert(steps.end(), {COPY_COL, col_index});
+    return *this;
+}
+
+LocalPlan& LocalPlan::deleteCol(int col_index) {
+    steps.insert(steps.end(), {DELETE_COL, col_index});
+    return *this;
+}
+
+LocalPlan& LocalPlan::project(const std::vector<int>& columns) {
+    steps.push_back(PROJECT);
+    return put(columns);
+}
+
+LocalPlan& LocalPlan::mvJoinColsAhead(const std::vector<int>& join_cols) {
+    steps.push_back(MV_JOIN_COLS_AHEAD);
+    return put(join_cols);
+}
+
+LocalPlan& LocalPlan::localSort(const std::vector<int>& columns) {
+    steps.push_back(LOCAL_SORT);
+    return put(columns);
+}
+
+LocalPlan& LocalPlan::foreignTableModifyColZ(const std::vector<int>& columns) {
+    steps.push_back(FOREIGN_TABLE_MODIFY_COL_Z);
+    return put(columns);
+}
+
+LocalPlan& LocalPlan::remove_dup_after_prefix(const std::vector<int>& columns) {
+    steps.push_back(REMOVE_DUP_AFTER_PREFIX);
+    return put(columns);
+}
+
+LocalPlan& LocalPlan::finalizePkjoinResult(const std::vector<int>& columns, int ori_r_col_num, int r_align_col_num) {
+    steps.push_back(FINALIZE_PKJOIN_RESULT);
+    put(columns);
+    steps.insert(steps.end(), {ori_r_col_num, r_align_col_num});
+    return *this;
+}
+
+LocalPlan& LocalPlan::expansion_prepare(int d_index) {
+    steps.insert(steps.end(), {EXPANSION_PREPARE, d_index});
+    return *this;
+}
+
+LocalPlan& LocalPlan::add_and_calculate_col_t_p(int d_index, int m) {
+    steps.insert(steps.end(), {ADD_AND_CALCULATE_COL_T_P, d_index, m});
+    return *this;
+}
+
+LocalPlan& LocalPlan::expansion_distribute_and_clear(int m) {
+    steps.insert(steps.end(), {EXPANSION_DISTRIBUTE_AND_CLEAR, m});
+    return *this;
+}
+
+LocalPlan& LocalPlan::joinComputeAlignment(int m) {
+    steps.insert(steps.end(), {JOIN_COMPUTE_ALIGNMENT, m});
+    return *this;
+}
+
+void LocalTable::run(const LocalPlan& plan) {
+    const std::vector<int>& steps = plan.data();
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",              "joinFinalCombine"                   },
-            {"num_join_cols",     std::to_string(num_join_cols)        },
-            {"global_id",         std::to_string(global_id)            },
-            {"r_table_global_id", std::to_string(r_table.getGlobalId())}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::RUN_PLAN).put(global_id).put(steps));
     } else {
         int ret;
-        sgx_status_t ecall_status = ecall_joinFinalCombine(global_eid, &ret, global_id, id, r_table.getGlobalId(), num_join_cols);
+        sgx_status_t ecall_status = ecall_run_plan(global_eid, &ret, global_id, id, const_cast<int*>(steps.data()), steps.size());
         if (ecall_status) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_run_plan failed");
     }
 }
 
@@ -527,17 +538,7 @@ void LocalTable::pkJoinCombine(
     }
 
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",                    "pkJoinCombine"                         },
-            {"global_id",               std::to_string(global_id)               },
-            {"s_table_local_global_id", std::to_string(s_table_local_global_id) },
-            {"s_table_local_id",        std::to_string(s_table_local_id)        },
-            {"combine_sort_cols",       utils::vectorToString(combine_sort_cols)},
-            {"new_join_cols",           utils::vectorToString(new_join_cols)    },
-            {"ori_r_col_num",           std::to_string(ori_r_col_num)           },
-            {"r_align_col_num",         std::to_string(r_align_col_num)         },
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::PK_JOIN_COMBINE).put(global_id).put(s_table_local_global_id).put(s_table_local_id).put(combine_sort_cols).put(new_join_cols).put(ori_r_col_num).put(r_align_col_num));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_pkJoinCombine(global_eid, &ret, global_id, id,
@@ -549,18 +550,14 @@ void LocalTable::pkJoinCombine(
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_pkJoinCombine failed");
     }
 }
 
 void LocalTable::addCol(int defaultVal, int col_index) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",       "addCol"                  },
-            {"global_id",  std::to_string(global_id) },
-            {"defaultVal", std::to_string(defaultVal)},
-            {"col_index",  std::to_string(col_index) }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::ADD_COL).put(global_id).put(defaultVal).put(col_index));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_addCol(global_eid, &ret, global_id, id, defaultVal, col_index);
@@ -568,17 +565,14 @@ void LocalTable::addCol(int defaultVal, int col_index) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_addCol failed");
     }
 }
 
 void LocalTable::deleteCol(int col_index) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "deleteCol"              },
-            {"global_id", std::to_string(global_id)},
-            {"col_index", std::to_string(col_index)}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::DELETE_COL).put(global_id).put(col_index));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_deleteCol(global_eid, &ret, global_id, id, col_index);
@@ -586,17 +580,29 @@ void LocalTable::deleteCol(int col_index) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_deleteCol failed");
+    }
+}
+
+void LocalTable::samplePivots(int sample_size) {
+    if (is_handle_) {
+        rpc::call(url_, rpc::Writer(rpc::SAMPLE_PIVOTS).put(global_id).put(sample_size));
+    } else {
+        int ret;
+        sgx_status_t ecall_status = ecall_samplePivots(global_eid, &ret, global_id, id, sample_size);
+        if (ecall_status) {
+            print_error_message(ecall_status);
+            log_error("ecall failed");
+        }
+        if (ret < 0)
+            throw std::runtime_error("ecall_samplePivots failed");
     }
 }
 
 void LocalTable::getPivots(const std::vector<int> columns) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "getPivots"                   },
-            {"columns",   utils::vectorToString(columns)},
-            {"global_id", std::to_string(global_id)     }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::GET_PIVOTS).put(global_id).put(columns));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_getPivots(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size());
@@ -604,17 +610,14 @@ void LocalTable::getPivots(const std::vector<int> columns) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_getPivots failed");
     }
 }
 
 void LocalTable::remove_dup_after_prefix(const std::vector<int>& columns) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "remove_dup_after_prefix"     },
-            {"columns",   utils::vectorToString(columns)},
-            {"global_id", std::to_string(global_id)     }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::REMOVE_DUP_AFTER_PREFIX).put(global_id).put(columns));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_remove_dup_after_prefix(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size());
@@ -622,17 +625,14 @@ void LocalTable::remove_dup_after_prefix(const std::vector<int>& columns) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_remove_dup_after_prefix failed");
     }
 }
 
 void LocalTable::project(const std::vector<int>& columns) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "project"                     },
-            {"columns",   utils::vectorToString(columns)},
-            {"global_id", std::to_string(global_id)     }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::PROJECT).put(global_id).put(columns));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_project(global_eid, &ret, global_id, id, const_cast<int*>(columns.data()), columns.size());
@@ -640,20 +640,14 @@ void LocalTable::project(const std::vector<int>& columns) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_project failed");
     }
 }
 
 long long LocalTable::sum(int column) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "sum"                    },
-            {"column",    std::to_string(column)   },
-            {"global_id", std::to_string(global_id)}
-        };
-        std::string ret = utils::extractRet(send_get_request(url_, header_map));
-        log_debug("sum ret is %s", ret.c_str());
-
-        return std::stoll(ret);
+        return rpc::call(url_, rpc::Writer(rpc::SUM).put(global_id).put(column)).get_long();
     } else {
         long long ret;
         sgx_status_t ecall_status = ecall_sum(global_eid, &ret, global_id, id, column);
@@ -666,8 +660,8 @@ long long LocalTable::sum(int column) {
 }
 
 Tuple LocalTable::groupByAggregateBase(AssociateOperator& op, bool doPrefix, int phase, bool reverse) {
-    if (doPrefix && phase != 1 && phase != 2) {
-        std::cerr << "ERROR: groupByAggregateBase requires phase to be 1 or 2 in groupByPrefixAggregate, " << phase << " is not supported" << std::endl;
+    if (doPrefix && phase < 0) {
+        std::cerr << "ERROR: groupByAggregateBase requires a round >= 0 in groupByPrefixAggregate, " << phase << " is not supported" << std::endl;
         throw;
     }
 
@@ -677,18 +671,15 @@ Tuple LocalTable::groupByAggregateBase(AssociateOperator& op, bool doPrefix, int
         print_error_message(ecall_status);
         log_error("ecall failed");
     }
+    if (ret < 0)
+        throw std::runtime_error("ecall_groupByAggregateBase failed");
 
     return Tuple();
 }
 
 void LocalTable::mvJoinColsAhead(std::vector<int> join_cols) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "mvJoinColsAhead"               },
-            {"join_cols", utils::vectorToString(join_cols)},
-            {"global_id", std::to_string(global_id)       }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::MV_JOIN_COLS_AHEAD).put(global_id).put(join_cols));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_mvJoinColsAhead(global_eid, &ret, global_id, id, const_cast<int*>(join_cols.data()), join_cols.size());
@@ -696,52 +687,23 @@ void LocalTable::mvJoinColsAhead(std::vector<int> join_cols) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_mvJoinColsAhead failed");
     }
 }
 
-Tuple LocalTable::groupByPrefixAggregate(AssociateOperator& op, int phase, bool reverse) {
+Tuple LocalTable::groupByPrefixAggregate(AssociateOperator& op, int round, bool reverse) {
     /* pre-check */
-    if (phase != 1 && phase != 2) {
-        std::cerr << "ERROR: Phase can only be 1 or 2 in groupByPrefixAggregate, " << phase << " is not supported" << std::endl;
+    if (round < 0) {
+        std::cerr << "ERROR: Round must be >= 0 in groupByPrefixAggregate, " << round << " is not supported" << std::endl;
         throw;
     }
-    if (phase == 2) {
-        if (id != 0) {
-            std::cerr << "ERROR: phase 2 can only be performed by local_table 0, local_table " << id << " can not do this" << std::endl;
-            throw;
-        }
-    }
 
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "groupByPrefixAggregate"    },
-            {"op",        utils::serializeOperator(op)},
-            {"phase",     std::to_string(phase)       },
-            {"reverse",   std::to_string(reverse)     },
-            {"global_id", std::to_string(global_id)   }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::GROUP_BY_PREFIX_AGGREGATE).put(global_id).put(op).put(round).put((int)reverse));
         return Tuple();  // always return dummy tuple. Meaningless.
     } else {
-        return groupByAggregateBase(op, true, phase, reverse);
-    }
-}
-
-void LocalTable::_addValueByKey(AssociateOperator& op) {
-    if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "_addValueByKey"            },
-            {"op",        utils::serializeOperator(op)},
-            {"global_id", std::to_string(global_id)   }
-        };
-        send_get_request(url_, header_map);
-    } else {
-        int ret;
-        sgx_status_t ecall_status = ecall_addValueByKey(global_eid, &ret, global_id, id, static_cast<void*>(&op));
-        if (ecall_status) {
-            print_error_message(ecall_status);
-            log_error("ecall failed");
-        }
+        return groupByAggregateBase(op, true, round, reverse);
     }
 }
 
@@ -752,16 +714,13 @@ void LocalTable::generateData(int num_cols, int num_rows) {
         print_error_message(ecall_status);
         log_error("ecall failed");
     }
+    if (ret < 0)
+        throw std::runtime_error("ecall_generateData failed");
 }
 
 void LocalTable::soda_shuffleByKey(int num_partitions, const std::vector<int>& key, int size_bound) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "soda_shuffleByKey"       },
-            {"key",       utils::vectorToString(key)},
-            {"global_id", std::to_string(global_id) }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::SODA_SHUFFLE_BY_KEY).put(global_id).put(num_partitions).put(key).put(size_bound));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_soda_shuffleByKey(global_eid, &ret, global_id, id, num_partitions, const_cast<int*>(key.data()), key.size(), 0, size_bound);
@@ -769,20 +728,14 @@ void LocalTable::soda_shuffleByKey(int num_partitions, const std::vector<int>& k
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_soda_shuffleByKey failed");
     }
 }
 
 int LocalTable::max(int column) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "max"                    },
-            {"column",    std::to_string(column)   },
-            {"global_id", std::to_string(global_id)}
-        };
-        std::string ret = utils::extractRet(send_get_request(url_, header_map));
-        log_debug("max ret is %d", ret);
-
-        return std::stoi(ret);
+        return rpc::call(url_, rpc::Writer(rpc::MAX).put(global_id).put(column)).get_int();
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_max(global_eid, &ret, global_id, id, column);
@@ -801,13 +754,7 @@ int LocalTable::union_table(int table_global_id, int table_id) {
         throw;
     }
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",            "union_table"                  },
-            {"global_id",       std::to_string(global_id)      },
-            {"table_global_id", std::to_string(table_global_id)},
-            {"table_id",        std::to_string(table_id)       }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::UNION_TABLE).put(global_id).put(table_global_id).put(table_id));
         return 0;
     } else {
         int ret;
@@ -816,6 +763,8 @@ int LocalTable::union_table(int table_global_id, int table_id) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_union failed");
 
         return ret;
     }
@@ -823,16 +772,7 @@ int LocalTable::union_table(int table_global_id, int table_id) {
 
 long long LocalTable::SODA_step1(std::vector<int> columns, int aggCol) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "SODA_step1"                  },
-            {"columns",   utils::vectorToString(columns)},
-            {"aggCol",    std::to_string(aggCol)        },
-            {"global_id", std::to_string(global_id)     }
-        };
-        std::string ret = utils::extractRet(send_get_request(url_, header_map));
-        log_debug("SODA_step1 ret is %s", ret.c_str());
-
-        return std::stoll(ret);
+        return rpc::call(url_, rpc::Writer(rpc::SODA_STEP1).put(global_id).put(columns).put(aggCol)).get_long();
     } else {
         long long ret;
 
@@ -841,6 +781,8 @@ long long LocalTable::SODA_step1(std::vector<int> columns, int aggCol) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_SODA_step1 failed");
 
         return ret;
     }
@@ -848,12 +790,7 @@ long long LocalTable::SODA_step1(std::vector<int> columns, int aggCol) {
 
 void LocalTable::SODA_step2(int p) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "SODA_step2"             },
-            {"global_id", std::to_string(global_id)},
-            {"p",         std::to_string(p)        }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::SODA_STEP2).put(global_id).put(p));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_SODA_step2(global_eid, &ret, global_id, id, p);
@@ -861,17 +798,14 @@ void LocalTable::SODA_step2(int p) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_SODA_step2 failed");
     }
 }
 
 void LocalTable::SODA_step3(int p) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "SODA_step3"             },
-            {"global_id", std::to_string(global_id)},
-            {"p",         std::to_string(p)        }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::SODA_STEP3).put(global_id).put(p));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_SODA_step3(global_eid, &ret, global_id, id, p);
@@ -879,23 +813,15 @@ void LocalTable::SODA_step3(int p) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_SODA_step3 failed");
     }
 }
 
 // this function only works in standalone setting
 int LocalTable::localJoin(int other_global_id, int other_id, int join_col_num, int output_bound) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",            "localJoin"                    },
-            {"join_col_num",    std::to_string(join_col_num)   },
-            {"output_bound",    std::to_string(output_bound)   },
-            {"global_id",       std::to_string(global_id)      },
-            {"other_global_id", std::to_string(other_global_id)},
-            {"other_id",        std::to_string(other_id)       }
-        };
-        std::string ret = utils::extractRet(send_get_request(url_, header_map));
-
-        return std::stoi(ret);
+        return rpc::call(url_, rpc::Writer(rpc::LOCAL_JOIN).put(global_id).put(other_global_id).put(other_id).put(join_col_num).put(output_bound)).get_int();
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_localJoin(global_eid, &ret, global_id, id, other_global_id, other_id, join_col_num, output_bound);
@@ -903,18 +829,15 @@ int LocalTable::localJoin(int other_global_id, int other_id, int join_col_num, i
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_localJoin failed");
         return ret;
     }
 }
 
 void LocalTable::SODA_step5() {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "SODA_step5"             },
-            {"global_id", std::to_string(global_id)}
-        };
-        utils::extractRet(send_get_request(url_, header_map));
-
+        rpc::call(url_, rpc::Writer(rpc::SODA_STEP5).put(global_id));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_SODA_step5(global_eid, &ret, global_id, id);
@@ -922,17 +845,14 @@ void LocalTable::SODA_step5() {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_SODA_step5 failed");
     }
 }
 
 void LocalTable::assignColE(int col) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "assignColE"             },
-            {"global_id", std::to_string(global_id)},
-            {"col",       std::to_string(col)      }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::ASSIGN_COL_E).put(global_id).put(col));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_assignColE(global_eid, &ret, global_id, id, col);
@@ -940,17 +860,14 @@ void LocalTable::assignColE(int col) {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_assignColE failed");
     }
 }
 
 void LocalTable::groupByAggregate(AssociateOperator& op) {
     if (is_handle_) {
-        unordered_map<string, string> header_map = {
-            {"task",      "groupByAggregate"          },
-            {"op",        utils::serializeOperator(op)},
-            {"global_id", std::to_string(global_id)   }
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::GROUP_BY_AGGREGATE).put(global_id).put(op));
     } else {
         groupByAggregateBase(op, false);
     }
@@ -966,11 +883,7 @@ void LocalTable::removeDummy() {
 
 void LocalTable::destroy() {
     if (is_handle_) {
-        std::unordered_map<std::string, std::string> header_map = {
-            {"task",      "destroy"                },
-            {"global_id", std::to_string(global_id)}
-        };
-        send_get_request(url_, header_map);
+        rpc::call(url_, rpc::Writer(rpc::DESTROY).put(global_id));
     } else {
         int ret;
         sgx_status_t ecall_status = ecall_destroy(global_eid, &ret, global_id, utils::num_partitions);
@@ -978,5 +891,7 @@ void LocalTable::destroy() {
             print_error_message(ecall_status);
             log_error("ecall failed");
         }
+        if (ret < 0)
+            throw std::runtime_error("ecall_destroy failed");
     }
 }
\ No newline at end of file
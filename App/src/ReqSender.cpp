@@ -1,4 +1,5 @@
 #include "ReqSender.h"
+#include "ConnectionPool.h"
 
 using namespace CurlService;
 using namespace folly;
@@ -59,6 +60,41 @@ std::string send_request(HTTPMethod httpMethod,
 
     HTTPHeaders headers = CurlClient::parseHeaders(headers_map);
 
+    // plain requests reuse a pooled keep-alive session; a stale one can fail before any response, so
+    // the request is retried once on a fresh connection
+    if (proxy_str.empty() && !h2c && plaintext_proto_str.empty() && !url.isSecure()) {
+        SocketAddress addr(url.getHost(), url.getPort(), true);
+        for (int attempt = 0; attempt < 2; attempt++) {
+            std::unique_ptr<PooledConnection> conn = connection_pool->acquire(addr, http_client_connect_timeout);
+            if (!conn)
+                break;
+            CurlClient curlClient(&conn->evb,
+                                  httpMethod,
+                                  url,
+                                  nullptr,
+                                  headers,
+                                  input_filename_str,
+                                  false,
+                                  1,
+                                  1,
+                                  post_content,
+                                  post_content_len);
+            curlClient.setLogging(log_response);
+            HTTPTransaction* txn = conn->session->newTransaction(&curlClient);
+            if (!txn)
+                continue;
+            curlClient.sendRequest(txn);
+            while (!curlClient.isDone())
+                conn->evb.loopOnce();
+            bool answered = curlClient.getResponse() != nullptr;
+            connection_pool->release(std::move(conn));
+            if (answered)
+                return curlClient.getTaskRet();
+        }
+        log_error("Request to %s failed", url_str.c_str());
+        return "";
+    }
+
     CurlClient curlClient(&evb,
                           httpMethod,
                           url,
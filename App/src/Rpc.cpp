@@ -0,0 +1,192 @@
+#include "Rpc.h"
+#include <cstring>
+#include <stdexcept>
+#include "ReqSender.h"
+#include "log.h"
+
+namespace rpc {
+
+const char* const op_names[NUM_OPS] = {
+    "read_config_file",
+    "create_local_table",
+    "copy",
+    "size",
+    "sum",
+    "max",
+    "SODA_step1",
+    "SODA_step2",
+    "SODA_step3",
+    "localJoin",
+    "SODA_step5",
+    "assignColE",
+    "num_columns",
+    "print",
+    "union_table",
+    "pad_to_size",
+    "opaque_prepare_shuffle_col",
+    "shuffleMerge",
+    "randomShuffle",
+    "shuffleByKey",
+    "shuffleByKeyTwoRound",
+    "shuffleRelay",
+    "shuffleByCol",
+    "partitionByPivots",
+    "groupByPrefixAggregate",
+    "groupByAggregate",
+    "mvJoinColsAhead",
+    "pkJoinCombine",
+    "foreignTableModifyColZ",
+    "remove_dup_after_prefix",
+    "finalizePkjoinResult",
+    "joinComputeAlignment",
+    "joinFinalCombine",
+    "sortMerge",
+    "project",
+    "samplePivots",
+    "getPivots",
+    "localSort",
+    "expansion_prepare",
+    "copyCol",
+    "addCol",
+    "add_and_calculate_col_t_p",
+    "expansion_distribute_and_clear",
+    "deleteCol",
+    "soda_shuffleByKey",
+    "destroy",
+    "get_comm_and_reset",
+    "run_plan",
+};
+
+enum FieldType : uint8_t { INT, LONG, INTS, STRING };
+
+void Writer::field(uint8_t type, const void* payload, uint32_t length) {
+    buf.push_back((char)type);
+    buf.append((const char*)&length, sizeof(length));
+    buf.append((const char*)payload, length);
+}
+
+Writer& Writer::put(int value) {
+    field(INT, &value, sizeof(value));
+    return *this;
+}
+
+Writer& Writer::put(long long value) {
+    field(LONG, &value, sizeof(value));
+    return *this;
+}
+
+Writer& Writer::put(const std::vector<int>& values) {
+    field(INTS, values.data(), values.size() * sizeof(int));
+    return *this;
+}
+
+Writer& Writer::put(const std::string& value) {
+    field(STRING, value.data(), value.size());
+    return *this;
+}
+
+// the operator id and the aggregate column, then the group-by columns
+Writer& Writer::put(const AssociateOperator& op) {
+    std::vector<int> values = {(int)op.op_id, op.aggregate_column};
+    values.insert(values.end(), op.group_by_columns.begin(), op.group_by_columns.end());
+    return put(values);
+}
+
+uint8_t Reader::head() {
+    if (pos >= buf.size())
+        throw std::runtime_error("rpc message is empty");
+    return (uint8_t)buf[pos++];
+}
+
+const char* Reader::field(uint8_t type, uint32_t* length) {
+    if (buf.size() - pos < 1 + sizeof(uint32_t))
+        throw std::runtime_error("rpc message has fewer fields than expected");
+    if ((uint8_t)buf[pos] != type)
+        throw std::runtime_error("rpc field has an unexpected type");
+    memcpy(length, buf.data() + pos + 1, sizeof(uint32_t));
+    pos += 1 + sizeof(uint32_t);
+    if (buf.size() - pos < *length)
+        throw std::runtime_error("rpc field is truncated");
+    const char* payload = buf.data() + pos;
+    pos += *length;
+    return payload;
+}
+
+int Reader::get_int() {
+    uint32_t length;
+    const char* payload = field(INT, &length);
+    int value;
+    if (length != sizeof(value))
+        throw std::runtime_error("rpc int field has a wrong length");
+    memcpy(&value, payload, sizeof(value));
+    return value;
+}
+
+long long Reader::get_long() {
+    uint32_t length;
+    const char* payload = field(LONG, &length);
+    long long value;
+    if (length != sizeof(value))
+        throw std::runtime_error("rpc long field has a wrong length");
+    memcpy(&value, payload, sizeof(value));
+    return value;
+}
+
+std::vector<int> Reader::get_ints() {
+    uint32_t length;
+    const char* payload = field(INTS, &length);
+    if (length % sizeof(int) != 0)
+        throw std::runtime_error("rpc int list field has a wrong length");
+    std::vector<int> values(length / sizeof(int));
+    memcpy(values.data(), payload, length);
+    return values;
+}
+
+std::string Reader::get_string() {
+    uint32_t length;
+    const char* payload = field(STRING, &length);
+    return std::string(payload, length);
+}
+
+std::unique_ptr<AssociateOperator> Reader::get_operator() {
+    std::vector<int> values = get_ints();
+    if (values.size() < 2)
+        throw std::runtime_error("rpc operator field is truncated");
+    std::vector<int> group_by_columns(values.begin() + 2, values.end());
+    int aggregate_column = values[1];
+    switch (values[0]) {
+        case AssociateOperator::ADD:
+            return std::unique_ptr<AssociateOperator>(new OperatorAdd(group_by_columns, aggregate_column));
+        case AssociateOperator::MUL:
+            return std::unique_ptr<AssociateOperator>(new OperatorMul(group_by_columns, aggregate_column));
+        case AssociateOperator::MAX:
+            return std::unique_ptr<AssociateOperator>(new OperatorMax(group_by_columns, aggregate_column));
+        case AssociateOperator::MIN:
+            return std::unique_ptr<AssociateOperator>(new OperatorMin(group_by_columns, aggregate_column));
+        case AssociateOperator::COPY:
+            return std::unique_ptr<AssociateOperator>(new OperatorCopy());
+        default:
+            throw std::runtime_error("rpc operator field has an unknown operator");
+    }
+}
+
+Reader call(const std::string& url, const Writer& request) {
+    const std::string& data = request.data();
+    std::unordered_map<std::string, std::string> header_map = {
+        {"task", "rpc"}
+    };
+    Reader response(send_post_request(url, header_map, "", timeout_const, data.data(), data.size()));
+    uint8_t status;
+    try {
+        status = response.head();
+    } catch (const std::runtime_error&) {
+        status = FAILED;
+    }
+    if (status != OK) {
+        log_error("Task %s failed on %s", op_names[(uint8_t)data[0]], url.c_str());
+        throw std::runtime_error("rpc failed");
+    }
+    return response;
+}
+
+}  // namespace rpc
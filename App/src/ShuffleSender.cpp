@@ -0,0 +1,53 @@
+#include "ShuffleSender.h"
+#include <unordered_map>
+#include "ReqSender.h"
+#include "log.h"
+
+void ShuffleSender::send(const std::string& url, const std::string& file_name, uint8_t* content, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Destination* destination = nullptr;
+    for (Destination* d : destinations) {
+        if (d->url == url) {
+            destination = d;
+            break;
+        }
+    }
+    if (!destination) {
+        // the threads wait for chunks for as long as the process lives
+        destination = new Destination;
+        destination->url = url;
+        destination->thread = std::thread(&ShuffleSender::run, this, destination);
+        destination->thread.detach();
+        destinations.push_back(destination);
+    }
+    destination->queue.push_back({file_name, content, length});
+    pending++;
+    queued.notify_all();
+}
+
+void ShuffleSender::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    delivered.wait(lock, [this] { return pending == 0; });
+}
+
+void ShuffleSender::run(Destination* destination) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queued.wait(lock, [destination] { return !destination->queue.empty(); });
+        Chunk chunk = destination->queue.front();
+        destination->queue.pop_front();
+        lock.unlock();
+
+        std::unordered_map<std::string, std::string> header_map = {
+            {"task",           "shuffle_chunk"                },
+            {"file_name",      chunk.file_name                },
+            {"Content-Length", std::to_string(chunk.length)}
+        };
+        send_post_request(destination->url, header_map, "", timeout_const, (const char*)chunk.content, chunk.length);
+        buffers->release(chunk.content);
+
+        lock.lock();
+        if (--pending == 0)
+            delivered.notify_all();
+    }
+}
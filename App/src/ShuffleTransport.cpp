@@ -0,0 +1,99 @@
+#include "ShuffleTransport.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include "log.h"
+
+void FileTransport::put(const std::string& file_name, uint8_t* content, size_t length) {
+    std::ofstream fout(file_name, std::ios::binary);
+    if (!fout || !fout.is_open()) {
+        log_error("Cannot open file %s", file_name.c_str());
+    }
+    fout.write((const char*)content, length);
+    fout.close();
+    buffers->release(content);
+}
+
+bool FileTransport::take(const std::string& file_name, uint8_t** content, size_t* length) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        log_error("Cannot open file %s", file_name.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        log_error("Cannot stat file %s", file_name.c_str());
+        return false;
+    }
+    *length = (size_t)st.st_size;
+    *content = nullptr;
+    if (*length == 0) {
+        close(fd);
+        return true;
+    }
+    // the mapping stays valid after the descriptor is closed
+    void* mapped = mmap(nullptr, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        log_error("Cannot map file %s", file_name.c_str());
+        return false;
+    }
+    madvise(mapped, *length, MADV_SEQUENTIAL);
+    *content = (uint8_t*)mapped;
+    return true;
+}
+
+void FileTransport::release(uint8_t* content, size_t length) {
+    if (content != nullptr)
+        munmap(content, length);
+}
+
+MemoryTransport::~MemoryTransport() {
+    for (auto& it : mailbox)
+        buffers->release(it.second.content);
+}
+
+void MemoryTransport::put(const std::string& file_name, uint8_t* content, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = mailbox.find(file_name);
+    if (it != mailbox.end()) {
+        buffers->release(it->second.content);
+        it->second = {content, length};
+    } else {
+        mailbox[file_name] = {content, length};
+    }
+    arrived.notify_all();
+}
+
+bool MemoryTransport::take(const std::string& file_name, uint8_t** content, size_t* length) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto deadline = std::chrono::steady_clock::now() + mail_timeout;
+    auto it = mailbox.find(file_name);
+    while (it == mailbox.end() && wait_for_mail && std::chrono::steady_clock::now() < deadline) {
+        auto wake = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::seconds(60));
+        if (arrived.wait_until(lock, wake) == std::cv_status::timeout && wake < deadline)
+            log_warn("Still waiting for shuffle buffer %s", file_name.c_str());
+        it = mailbox.find(file_name);
+    }
+    if (it == mailbox.end()) {
+        if (wait_for_mail)
+            log_error("Shuffle buffer %s did not arrive within %lld s", file_name.c_str(), (long long)mail_timeout.count());
+        else
+            log_error("No shuffle buffer for %s", file_name.c_str());
+        return false;
+    }
+    *content = it->second.content;
+    *length = it->second.length;
+    mailbox.erase(it);
+    return true;
+}
+
+void MemoryTransport::release(uint8_t* content, size_t length) {
+    buffers->release(content);
+}
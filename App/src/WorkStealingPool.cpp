@@ -0,0 +1,102 @@
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(int num_threads) {
+    if (num_threads < 0)
+        num_threads = 0;
+    for (int i = 0; i <= num_threads; i++)
+        queues.emplace_back(new Queue);
+    for (int i = 0; i < num_threads; i++)
+        threads.emplace_back(&WorkStealingPool::work, this, (size_t)i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void WorkStealingPool::run(int n, const std::function<void(int)>& func) {
+    if (n <= 0)
+        return;
+    if (n == 1 || threads.empty()) {
+        for (int i = 0; i < n; i++)
+            func(i);
+        return;
+    }
+    Section section;
+    section.func = &func;
+    section.remaining = n;
+    for (int i = 0; i < n; i++) {
+        Queue& queue = *queues[i % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({&section, i});
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks += n;
+    }
+    queued.notify_all();
+
+    // help until nothing is left to take, then wait for the tasks still running elsewhere
+    size_t self = queues.size() - 1;
+    Task task;
+    while (section.remaining > 0 && pop(self, &task))
+        execute(task);
+    std::unique_lock<std::mutex> lock(section.mutex);
+    section.done.wait(lock, [&section] { return section.remaining == 0; });
+    if (section.error)
+        std::rethrow_exception(section.error);
+}
+
+bool WorkStealingPool::pop(size_t self, Task* task) {
+    for (size_t k = 0; k < queues.size(); k++) {
+        size_t i = (self + k) % queues.size();
+        Queue& queue = *queues[i];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == self) {
+            *task = queue.tasks.front();
+            queue.tasks.pop_front();
+        } else {
+            *task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        tasks--;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::execute(const Task& task) {
+    Section& section = *task.section;
+    try {
+        (*section.func)(task.index);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(section.mutex);
+        if (!section.error)
+            section.error = std::current_exception();
+    }
+    // the owner of section may return as soon as remaining is 0, so it is only touched under its mutex
+    std::lock_guard<std::mutex> lock(section.mutex);
+    if (--section.remaining == 0)
+        section.done.notify_all();
+}
+
+void WorkStealingPool::work(size_t self) {
+    Task task;
+    while (true) {
+        if (pop(self, &task)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        queued.wait(lock, [this] { return tasks > 0 || stopping; });
+        if (stopping)
+            return;
+    }
+}
@@ -9,16 +9,27 @@
 #include "include/log.h"
 #include "include/utils.h"
 
+// I/O and profiling ocalls, counted for the benchmark report
+static inline void count_ocall() {
+    utils::ocall_count++;
+    if (utils::is_switchless_worker)
+        utils::switchless_ocall_count++;
+}
+
 void ocall_log(int level, const char* file, int line, const char* msg) {
     log_log(level, file, line, msg);
 }
 
-void unsafe_ocall_malloc(size_t size, char** ret) {
-    *ret = (char*)(malloc(size));
+// a host buffer for the enclave to seal a file into; ocall_write_file takes it back
+void ocall_acquire_buffer(size_t size, char** ret) {
+    count_ocall();
+    *ret = (char*)utils::host_buffers.acquire(size);
 }
 
-void ocall_free(char* buf) {
-    free(buf);
+// a buffer from ocall_acquire_buffer that the enclave kept for itself, e.g. a spilled run
+void ocall_release_buffer(char* buf) {
+    count_ocall();
+    utils::host_buffers.release((uint8_t*)buf);
 }
 
 /* OCall functions */
@@ -28,7 +39,11 @@ void ocall_print_string(const char* str) {
 
 //int gid = 0xabcde;
 void ocall_write_file(const char* file_name, char* content, size_t length, int row_num, int global_id, int source_local_id, int target_local_id) {
-    if (utils::is_distributed && source_local_id != target_local_id) {
+    count_ocall();
+    if (utils::streaming_shuffle() && source_local_id != target_local_id) {
+        // returns at once, the buffer goes back to the pool once the target has it
+        utils::shuffle_sender->send(utils::worker_urls[target_local_id], file_name, (uint8_t*)content, length);
+    } else if (utils::is_distributed && source_local_id != target_local_id) {
         unordered_map<string, string> header_map = {
             {"task",           "write_file"             },
             {"global_id",      std::to_string(global_id)},
@@ -40,15 +55,11 @@ void ocall_write_file(const char* file_name, char* content, size_t length, int r
             header_map,
             "", timeout_const,
             content, length);
+        utils::host_buffers.release((uint8_t*)content);
     } else {
-        std::ofstream fout(file_name, std::ios::binary);  // 打开文件用于写入，使用二进制模式
-        if (!fout || !fout.is_open()) {
-            log_error("Cannot open file %s", file_name);
-        }
-        // fout << content;
-        fout.write(content, length);
-        fout.close();
+        utils::shuffle_transport->put(file_name, (uint8_t*)content, length);
 
+        std::lock_guard<std::mutex> lock(utils::timing_mutex);
         if (utils::comm_map.count(global_id) > 0)
             utils::comm_map[global_id] = utils::comm_map[global_id] + row_num;
         else
@@ -60,15 +71,20 @@ void ocall_write_file(const char* file_name, char* content, size_t length, int r
     // ocall_record_time_end(label, gid, 0, source_local_id);
 }
 
+// the enclave reads the first two members, see Enclave.h
 struct FileInfo {
     uint8_t* file_content;
     uint64_t file_length;
 };
 
-//TODO: figure out how to free the return value, ocall_free?
+// lends the enclave the buffer of file_name; it is given back with ocall_release_file. NULL if the file
+// is missing or did not arrive in time, which fails the enclave's read
 void* ocall_read_file(const char* file_name) {
+    count_ocall();
+    uint8_t* file;
     size_t file_length;
-    uint8_t* file = utils::readPartitionFile(file_name, &file_length);
+    if (!utils::shuffle_transport->take(file_name, &file, &file_length))
+        return nullptr;
     FileInfo* ret = new FileInfo;
     ret->file_content = file;
     ret->file_length = file_length;
@@ -76,9 +92,18 @@ void* ocall_read_file(const char* file_name) {
     return static_cast<void*>(ret);
 }
 
+void ocall_release_file(void* file_info) {
+    count_ocall();
+    FileInfo* info = static_cast<FileInfo*>(file_info);
+    utils::shuffle_transport->release(info->file_content, info->file_length);
+    delete info;
+}
+
 // bool record_start = false;
 void ocall_record_time_start(const char* log, int uniq_counter, int global_id, int local_id) {
+    count_ocall();
     using namespace utils;
+    std::lock_guard<std::mutex> lock(timing_mutex);
     auto it = flag_map.find(uniq_counter);
     if (it != flag_map.end()) {
         log_error("%d already exists in flag_map", uniq_counter);
@@ -90,13 +115,15 @@ void ocall_record_time_start(const char* log, int uniq_counter, int global_id, i
 }
 
 void ocall_record_time_end(const char* log, int uniq_counter, int global_id, int local_id) {
+    count_ocall();
     using namespace utils;
+    auto end = std::chrono::high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(timing_mutex);
     auto it = flag_map.find(uniq_counter);
     if (it == flag_map.end() || flag_map[uniq_counter] == false) {
         log_error("%d not exists in flag_map; or it is false", uniq_counter);
     }
 
-    auto end = std::chrono::high_resolution_clock::now();
     // record_start = false;
     flag_map[uniq_counter] = false;
 
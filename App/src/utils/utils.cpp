@@ -1,12 +1,15 @@
 #include "utils.h"
 #include <boost/program_options.hpp>
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include "App.h"
 #include "Enclave_u.h"
 #include "ReqSender.h"
+#include "Rpc.h"
 #include "log.h"
 
 namespace utils {
@@ -14,7 +17,24 @@ namespace utils {
     float KAPPA = 40.0 * 0.69314718;  // failure probability = exp{-kappa}
 
     int num_partitions;
+    int enclave_threads = 1;
+    int simulation_threads = 1;
+    int sort_algorithm = SORT_BITONIC;
+    bool two_round_shuffle = false;
+    int sort_sample_size = 8192;
+    int sort_budget_mb = 0;
+    int simd_level = SIMD_NONE;
     bool is_distributed = false;
+    bool verify_metadata = false;
+    HostBufferPool host_buffers;
+    ShuffleTransport* shuffle_transport = new FileTransport(&host_buffers);
+    bool memory_transport = false;
+    ShuffleSender* shuffle_sender = new ShuffleSender(&host_buffers);
+    bool switchless = false;
+    int switchless_uworkers = 2;
+    std::atomic<long long> ocall_count(0);
+    std::atomic<long long> switchless_ocall_count(0);
+    thread_local bool is_switchless_worker = false;
     std::vector<std::string> worker_urls;
     long long header_total_size = 0, body_total_size = 0;
     CommStatTransportCallback* _callback = new CommStatTransportCallback();
@@ -55,8 +75,44 @@ namespace utils {
             num_partitions = _num_partitions;
             }))("sigma", po::value<float>()->notifier([](float sigma) {
                 KAPPA = sigma * 0.69314718;
-                }))("real_distributed", po::value<bool>()->notifier([](bool real_distributed) {
+                }))("enclave_threads", po::value<int>()->notifier([](int _enclave_threads) {
+                    enclave_threads = _enclave_threads;
+                    }))("simulation_threads", po::value<int>()->notifier([](int _simulation_threads) {
+                    simulation_threads = _simulation_threads > 0 ? _simulation_threads : 1;
+                    }))("sort_algorithm", po::value<std::string>()->notifier([](const std::string& algorithm) {
+                    if (algorithm == "bitonic")
+                        sort_algorithm = SORT_BITONIC;
+                    else if (algorithm == "bucket")
+                        sort_algorithm = SORT_BUCKET;
+                    else if (algorithm == "tag")
+                        sort_algorithm = SORT_TAG;
+                    else
+                        log_error("Unknown sort_algorithm");
+                    if (sort_algorithm != SORT_BITONIC)
+                        log_warn("sort_algorithm = %s is experimental and currently slower than bitonic", algorithm.c_str());
+                    }))("two_round_shuffle", po::value<bool>()->notifier([](bool _two_round_shuffle) {
+                    two_round_shuffle = _two_round_shuffle;
+                    }))("sort_sample_size", po::value<int>()->notifier([](int _sort_sample_size) {
+                    sort_sample_size = _sort_sample_size > 0 ? _sort_sample_size : 1;
+                    }))("sort_budget_mb", po::value<int>()->notifier([](int _sort_budget_mb) {
+                    sort_budget_mb = _sort_budget_mb;
+                    }))("host_buffer_cache_mb", po::value<int>()->notifier([](int _host_buffer_cache_mb) {
+                    host_buffers.setMaxIdleBytes((size_t)std::max(_host_buffer_cache_mb, 0) << 20);
+                    }))("switchless", po::value<bool>()->notifier([](bool _switchless) {
+                    switchless = _switchless;
+                    }))("switchless_uworkers", po::value<int>()->notifier([](int _switchless_uworkers) {
+                    switchless_uworkers = _switchless_uworkers;
+                    }))("shuffle_transport", po::value<std::string>()->notifier([](const std::string& transport) {
+                    if (transport == "file")
+                        memory_transport = false;
+                    else if (transport == "memory")
+                        memory_transport = true;
+                    else
+                        log_error("Unknown shuffle_transport");
+                    }))("real_distributed", po::value<bool>()->notifier([](bool real_distributed) {
                     is_distributed = real_distributed;
+                    }))("verify_metadata", po::value<bool>()->notifier([](bool _verify_metadata) {
+                    verify_metadata = _verify_metadata;
                     }))("worker_urls", po::value<std::vector<std::string>>()->composing()->notifier([](const std::vector<std::string>& _worker_urls) {
                         worker_urls = _worker_urls;
                         }))("log_level", po::value<std::string>()->notifier([](const std::string& level) {
@@ -78,6 +134,13 @@ namespace utils {
                         po::notify(vm);
                         //log_info("Read config finished");
                         log_info("num_partitions = %d, sigma = %.1f", num_partitions, vm["sigma"].as<float>());
+                        // in real distributed mode the files for another worker go to its mailbox through
+                        // shuffle_sender, see ocall_write_file
+                        delete shuffle_transport;
+                        if (memory_transport)
+                            shuffle_transport = new MemoryTransport(&host_buffers, is_distributed);
+                        else
+                            shuffle_transport = new FileTransport(&host_buffers);
     }
 
     void read_config_file(const std::string& config_file, bool is_worker) {
@@ -85,21 +148,19 @@ namespace utils {
             parse_config(config_file);
             if (is_distributed) {  // send config to workers and let them read config
                 send_config_file(config_file);
-                for (int i = 0; i < num_partitions; i++) {
-                    std::unordered_map<std::string, std::string> header_map = {
-                        {"task",      "read_config_file"},
-                        {"worker_id", std::to_string(i) }
-                    };
-                    send_get_request(worker_urls[i], header_map);
-                }
+                for (int i = 0; i < num_partitions; i++)
+                    rpc::call(worker_urls[i], rpc::Writer(rpc::READ_CONFIG_FILE).put(i));
             }
         }
         else {
             parse_config(config_file);
         }
-        // initialize enclave
-        if (!is_distributed) {
-            if (initialize_enclave(false) < 0) {
+        // initialize enclave; a worker created its enclave at startup, before it had the config, so it
+        // is recreated if the switchless setting differs
+        if (is_worker && enclave_created && enclave_switchless != switchless)
+            destroy_enclave();
+        if (!is_distributed || (is_worker && !enclave_created)) {
+            if (initialize_enclave(switchless, switchless_uworkers) < 0) {
                 log_error("Enclave initialization failed");
             }
         }
@@ -111,64 +172,22 @@ namespace utils {
                 print_error_message(ecall_status);
                 log_error("ecall failed");
             }
-        }
-    }
-
-    // 将 vector<int> 转换为由逗号分隔的 string
-    std::string vectorToString(const std::vector<int>& vec) {
-        std::ostringstream oss;
-        for (size_t i = 0; i < vec.size(); ++i) {
-            if (i != 0) {
-                oss << "_";  // 添加分隔符，除了第一个元素前
-            }
-            oss << vec[i];
-        }
-        return oss.str();
-    }
-
-    // 将由逗号分隔的 string 转换为 vector<int>
-    std::vector<int> stringToVector(const std::string& str) {
-        std::vector<int> vec;
-        std::istringstream iss(str);
-        std::string token;
-        while (std::getline(iss, token, '_')) {  // 使用逗号作为分隔符
-            try {
-                int num = std::stoi(token);
-                vec.push_back(num);
-            }
-            catch (const std::invalid_argument& e) {
-                // Handle the exception, e.g., you can continue or return an empty vector
-                std::cerr << "Invalid number: " << token << std::endl;
-                continue;  // Optionally skip this token
-                //return std::vector<int>(); // Or return an empty vector
+            ecall_status = ecall_setup_sort(global_eid, &ret, sort_algorithm, KAPPA, (uint64_t)sort_budget_mb << 20);
+            if (ecall_status) {
+                print_error_message(ecall_status);
+                log_error("ecall failed");
             }
-            catch (const std::out_of_range& e) {
-                // Handle the large number or negative overflow
-                std::cerr << "Number out of range: " << token << std::endl;
-                continue;
+            // cpuid is not available inside the enclave, so the host reports what the CPU supports
+            int cpu_simd = __builtin_cpu_supports("avx512f") ? SIMD_AVX512 : __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE;
+            ecall_status = ecall_setup_simd(global_eid, &simd_level, cpu_simd);
+            if (ecall_status) {
+                print_error_message(ecall_status);
+                log_error("ecall failed");
             }
+            log_info("cpu simd level = %d, enclave simd level = %d", cpu_simd, simd_level);
+            // the calling thread takes part in every parallel section, so start one worker less
+            start_enclave_workers(enclave_threads - 1);
         }
-        return vec;
-    }
-
-    /* ret format is (ret:xxx), extract xxx from ret */
-    std::string extractRet(const std::string& str) {
-        size_t startPos = str.find("ret:");
-        if (startPos == std::string::npos) {
-            // "ret:" 没有找到，返回空字符串或适当的错误值
-            return "";
-        }
-        startPos += 4;  // 移动到 "ret:" 的后面，即 "xxx" 的起始位置
-
-        // 我们假设结尾是闭的括号 ')'
-        size_t endPos = str.find(")", startPos);
-        if (endPos == std::string::npos) {
-            // 没有闭括号找到，返回从 "ret:" 开始到字符串结尾的子字符串
-            return str.substr(startPos);
-        }
-
-        // 提取并返回从startPos到endPos的子字符串
-        return str.substr(startPos, endPos - startPos);
     }
 
     int extractPort(const std::string& addr) {
@@ -215,7 +234,7 @@ namespace utils {
 
         // 获取文件长度
         file.seekg(0, std::ios::end);
-        int file_size = (int)file.tellg();
+        size_t file_size = (size_t)file.tellg();
         file.seekg(0, std::ios::beg);
 
         char* buffer = new char[file_size + 1];  // 需要 +1 来存储结尾的空字符
@@ -233,6 +252,7 @@ namespace utils {
     std::unordered_map<int, std::unordered_map<std::string, double>> duration_matrix;
     std::unordered_map<int, long long> comm_map;
     long long total_comm = 0;
+    std::mutex timing_mutex;
     int time_phase = 0;
     double read_write_ms = 0;
     double comp_ms = 0;
@@ -240,6 +260,7 @@ namespace utils {
     long long total_bytes_sent = 0;
 
     void update_phase(std::string phase_name) {
+        std::lock_guard<std::mutex> lock(timing_mutex);
         time_phase++;
         double max_read_write = 0;
         double max_comp = 0;
@@ -283,6 +304,7 @@ namespace utils {
     }
 
     void reset() {
+        std::lock_guard<std::mutex> lock(timing_mutex);
         total_comm = 0;
         time_phase = 0;
         read_write_ms = 0;
@@ -290,6 +312,8 @@ namespace utils {
         flag_map.clear();
         duration_matrix.clear();
         comm_map.clear();
+        ocall_count = 0;
+        switchless_ocall_count = 0;
     }
 
     int getSizeBound(int n, int p) {
@@ -301,85 +325,75 @@ namespace utils {
         return (int)ceil((1 + x) * n / p);
     }
 
-    std::string serializeOperator(const AssociateOperator& op) {
-        std::ostringstream out;
-        out << "(" << op.op_id;
-
-        if (op.op_id != AssociateOperator::COPY) {
-            out << " " << op.group_by_columns.size();
-            for (int col : op.group_by_columns) {
-                out << " " << col;
+    // smallest B with P(sum of p copies of max(0, X - U) > B) <= exp(-kappa) / (2p), X ~ Bin(n, 1/p),
+    // by the Chernoff bound exp(-lambda B) E[exp(lambda max(0, X - U))]^p over a grid of lambda (the
+    // bound is quasi-convex in lambda, so the search stops once it grows). The
+    // overflow of one source sums over its p targets (negatively associated), and that of one target
+    // over the p sources (independent), so the bound holds for all 2p sums at once.
+    static int overflowBound(int n, int p, int U) {
+        double q = 1.0 / p;
+        double log_n = lgamma(n + 1.0);
+        auto log_pmf = [&](int k) {
+            return log_n - lgamma(k + 1.0) - lgamma(n - k + 1.0) + k * log(q) + (n - k) * log1p(-q);
+        };
+        double target = KAPPA + log(2.0 * p);
+        double best = n, last = INFINITY;
+        for (double lambda = 1e-4; lambda < 100; lambda *= 1.25) {
+            // log of sum_{k > U} pmf(k) exp(lambda (k - U)), and sum_{k > U} pmf(k); the terms are
+            // log-concave in k, so stop once they fall far below the largest one
+            double max_term = -INFINITY, sum = 0, tail = 0;
+            for (int k = U + 1; k <= n; k++) {
+                double lp = log_pmf(k);
+                double term = lp + lambda * (k - U);
+                if (term > max_term) {
+                    sum = sum * exp(max_term - term) + 1;
+                    max_term = term;
+                } else {
+                    sum += exp(term - max_term);
+                }
+                tail += exp(lp);
+                if (term < max_term - 50 && k > n * q)
+                    break;
             }
-            out << " " << op.aggregate_column;
+            double log_mgf = 0;
+            if (max_term > -INFINITY) {
+                double log_sum = max_term + log(sum);
+                log_mgf = log_sum > 30 ? log_sum : log1p(exp(log_sum) - tail);
+            }
+            double bound = (p * log_mgf + target) / lambda;
+            if (bound > last)
+                break;
+            best = std::min(best, bound);
+            last = bound;
         }
-
-        out << ")";
-        return out.str();
+        return (int)ceil(best);
     }
 
-    AssociateOperator* deserializeOperator(const std::string& data) {
-        // Ensure the data starts with '(' and ends with ')'
-        if (data.front() != '(' || data.back() != ')') {
-            throw std::invalid_argument("Invalid serialization format");
+    void getTwoRoundBounds(int n, int p, int* first_bound, int* overflow_bound) {
+        static std::map<std::pair<int, int>, std::pair<int, int>> cache;
+        auto it = cache.find({n, p});
+        if (it != cache.end()) {
+            *first_bound = it->second.first;
+            *overflow_bound = it->second.second;
+            return;
         }
-
-        // Remove the parentheses
-        std::string trimmed_data = data.substr(1, data.size() - 2);
-
-        std::istringstream in(trimmed_data);
-        int opId;
-        in >> opId;
-
-        if (opId == AssociateOperator::ADD) {
-            int num_group_by;
-            in >> num_group_by;
-            std::vector<int> group_by_columns(num_group_by);
-            for (int i = 0; i < num_group_by; ++i) {
-                in >> group_by_columns[i];
+        int one_round = std::min(getSizeBound(n, p), n);
+        *first_bound = one_round;
+        *overflow_bound = 0;
+        // a source sends p * U rows and B rows of overflow, a target receives as many
+        long long best = (long long)p * one_round;
+        int lo = (n + p - 1) / p;
+        const int candidates = 16;
+        for (int i = 0; p > 1 && i < candidates; i++) {
+            int U = lo + (long long)(one_round - lo) * i / candidates;
+            int B = overflowBound(n, p, U);
+            if ((long long)p * U + 2 * B < best) {
+                best = (long long)p * U + 2 * B;
+                *first_bound = U;
+                *overflow_bound = B;
             }
-            int aggregate_column;
-            in >> aggregate_column;
-            return new OperatorAdd(group_by_columns, aggregate_column);
-        }
-        else if (opId == AssociateOperator::MUL) {
-            int num_group_by;
-            in >> num_group_by;
-            std::vector<int> group_by_columns(num_group_by);
-            for (int i = 0; i < num_group_by; ++i) {
-                in >> group_by_columns[i];
-            }
-            int aggregate_column;
-            in >> aggregate_column;
-            return new OperatorMul(group_by_columns, aggregate_column);
-        }
-        else if (opId == AssociateOperator::MAX) {
-            int num_group_by;
-            in >> num_group_by;
-            std::vector<int> group_by_columns(num_group_by);
-            for (int i = 0; i < num_group_by; ++i) {
-                in >> group_by_columns[i];
-            }
-            int aggregate_column;
-            in >> aggregate_column;
-            return new OperatorMax(group_by_columns, aggregate_column);
-        }
-        else if (opId == AssociateOperator::MIN) {
-            int num_group_by;
-            in >> num_group_by;
-            std::vector<int> group_by_columns(num_group_by);
-            for (int i = 0; i < num_group_by; ++i) {
-                in >> group_by_columns[i];
-            }
-            int aggregate_column;
-            in >> aggregate_column;
-            return new OperatorMin(group_by_columns, aggregate_column);
-        }
-        else if (opId == AssociateOperator::COPY) {
-            return new OperatorCopy();
-        }
-        else {
-            throw std::invalid_argument("Unknown OperatorList value");
         }
+        cache[{n, p}] = {*first_bound, *overflow_bound};
     }
 
     long long coordinator_get_comm_and_reset()
@@ -387,13 +401,8 @@ namespace utils {
         log_info("header size = %d, body size = %d", utils::header_total_size, utils::body_total_size);
         long long ret = utils::body_total_size + utils::header_total_size;
         utils::body_total_size = utils::header_total_size = 0;
-        for (int i = 0; i < num_partitions; i++) {
-            std::unordered_map<std::string, std::string> header_map = {
-                {"task",  "get_comm_and_reset"  },
-            };
-            auto ret_str = utils::extractRet(send_get_request(worker_urls[i], header_map));
-            ret += std::stoll(ret_str);
-        }
+        for (int i = 0; i < num_partitions; i++)
+            ret += rpc::call(worker_urls[i], rpc::Writer(rpc::GET_COMM_AND_RESET)).get_long();
         return ret;
     }
 }  // namespace utils
\ No newline at end of file
@@ -0,0 +1,179 @@
+#pragma once
+
+// Branch-free conditional swap / move of int arrays. The SSE2 kernel is always built, SSE2 being part
+// of x86-64. The wider kernels are only compiled in when the enclave is built with ENCLAVE_SIMD=avx2 or
+// avx512 (see CMakeLists.txt); they carry their own target attribute, so the rest of the enclave keeps
+// the baseline ISA and the scalar loop stays usable on CPUs without the extension. Which kernel runs is
+// picked once at setup (set_simd_level) and only depends on n, never on cond: all of them read and write
+// every element. What is left after the widest kernel goes to the next narrower one, down to the scalar
+// loop for the last int.
+
+#include <emmintrin.h>
+#if defined(OBLIV_SIMD_AVX2) || defined(OBLIV_SIMD_AVX512)
+#include <immintrin.h>
+#endif
+
+namespace obliv {
+
+enum SimdLevel {
+    SIMD_NONE = 0,
+    SIMD_SSE = 1,
+    SIMD_AVX2 = 2,
+    SIMD_AVX512 = 3
+};
+
+extern int simd_level;
+
+// highest level compiled into this enclave
+inline int simd_built_level() {
+#if defined(OBLIV_SIMD_AVX512)
+    return SIMD_AVX512;
+#elif defined(OBLIV_SIMD_AVX2)
+    return SIMD_AVX2;
+#else
+    return SIMD_SSE;
+#endif
+}
+
+inline void cswapIntsScalar(int* x, int* y, int n, int cond) {
+    int mask = -cond;
+    for (int i = 0; i < n; i++) {
+        int xored = mask & (x[i] ^ y[i]);
+        x[i] ^= xored;
+        y[i] ^= xored;
+    }
+}
+
+inline void cmoveIntsScalar(int* x, const int* y, int n, int cond) {
+    int mask = -cond;
+    for (int i = 0; i < n; i++)
+        x[i] ^= mask & (y[i] ^ x[i]);
+}
+
+// 4 ints per 128-bit register, then one last pair through the low 64 bits, so rows of 3 and 5 ints
+// (2 and 4 columns plus the dummy flag) are left with a single int for the scalar loop
+inline int cswapIntsSse(int* x, int* y, int n, int cond) {
+    __m128i mask = _mm_set1_epi32(-cond);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((__m128i*)(x + i));
+        __m128i b = _mm_loadu_si128((__m128i*)(y + i));
+        __m128i xored = _mm_and_si128(mask, _mm_xor_si128(a, b));
+        _mm_storeu_si128((__m128i*)(x + i), _mm_xor_si128(a, xored));
+        _mm_storeu_si128((__m128i*)(y + i), _mm_xor_si128(b, xored));
+    }
+    if (i + 2 <= n) {
+        __m128i a = _mm_loadl_epi64((__m128i*)(x + i));
+        __m128i b = _mm_loadl_epi64((__m128i*)(y + i));
+        __m128i xored = _mm_and_si128(mask, _mm_xor_si128(a, b));
+        _mm_storel_epi64((__m128i*)(x + i), _mm_xor_si128(a, xored));
+        _mm_storel_epi64((__m128i*)(y + i), _mm_xor_si128(b, xored));
+        i += 2;
+    }
+    return i;
+}
+
+inline int cmoveIntsSse(int* x, const int* y, int n, int cond) {
+    __m128i mask = _mm_set1_epi32(-cond);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((__m128i*)(x + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(y + i));
+        _mm_storeu_si128((__m128i*)(x + i), _mm_xor_si128(a, _mm_and_si128(mask, _mm_xor_si128(a, b))));
+    }
+    if (i + 2 <= n) {
+        __m128i a = _mm_loadl_epi64((__m128i*)(x + i));
+        __m128i b = _mm_loadl_epi64((const __m128i*)(y + i));
+        _mm_storel_epi64((__m128i*)(x + i), _mm_xor_si128(a, _mm_and_si128(mask, _mm_xor_si128(a, b))));
+        i += 2;
+    }
+    return i;
+}
+
+#if defined(OBLIV_SIMD_AVX2) || defined(OBLIV_SIMD_AVX512)
+// the vector kernels only handle whole registers and return how many ints they processed; masked
+// loads/stores for the tail cost more than the scalar loop on the few remaining ints
+__attribute__((target("avx2"))) inline int cswapIntsAvx2(int* x, int* y, int n, int cond) {
+    __m256i mask = _mm256_set1_epi32(-cond);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((__m256i*)(x + i));
+        __m256i b = _mm256_loadu_si256((__m256i*)(y + i));
+        __m256i xored = _mm256_and_si256(mask, _mm256_xor_si256(a, b));
+        _mm256_storeu_si256((__m256i*)(x + i), _mm256_xor_si256(a, xored));
+        _mm256_storeu_si256((__m256i*)(y + i), _mm256_xor_si256(b, xored));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) inline int cmoveIntsAvx2(int* x, const int* y, int n, int cond) {
+    __m256i mask = _mm256_set1_epi32(-cond);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((__m256i*)(x + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(y + i));
+        _mm256_storeu_si256((__m256i*)(x + i), _mm256_xor_si256(a, _mm256_and_si256(mask, _mm256_xor_si256(a, b))));
+    }
+    return i;
+}
+#endif
+
+#if defined(OBLIV_SIMD_AVX512)
+__attribute__((target("avx512f"))) inline int cswapIntsAvx512(int* x, int* y, int n, int cond) {
+    __m512i mask = _mm512_set1_epi32(-cond);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i a = _mm512_loadu_si512(x + i);
+        __m512i b = _mm512_loadu_si512(y + i);
+        __m512i xored = _mm512_and_si512(mask, _mm512_xor_si512(a, b));
+        _mm512_storeu_si512(x + i, _mm512_xor_si512(a, xored));
+        _mm512_storeu_si512(y + i, _mm512_xor_si512(b, xored));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f"))) inline int cmoveIntsAvx512(int* x, const int* y, int n, int cond) {
+    __m512i mask = _mm512_set1_epi32(-cond);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i a = _mm512_loadu_si512(x + i);
+        __m512i b = _mm512_loadu_si512(y + i);
+        _mm512_storeu_si512(x + i, _mm512_xor_si512(a, _mm512_and_si512(mask, _mm512_xor_si512(a, b))));
+    }
+    return i;
+}
+#endif
+
+// swap x[0, n) and y[0, n) if cond
+inline void cswapInts(int* x, int* y, int n, int cond) {
+    int i = 0;
+#if defined(OBLIV_SIMD_AVX512)
+    if (simd_level >= SIMD_AVX512 && n >= 16)
+        i = cswapIntsAvx512(x, y, n, cond);
+#endif
+#if defined(OBLIV_SIMD_AVX2) || defined(OBLIV_SIMD_AVX512)
+    if (simd_level >= SIMD_AVX2 && n - i >= 8)
+        i += cswapIntsAvx2(x + i, y + i, n - i, cond);
+#endif
+    if (simd_level >= SIMD_SSE && n - i >= 2)
+        i += cswapIntsSse(x + i, y + i, n - i, cond);
+    cswapIntsScalar(x + i, y + i, n - i, cond);
+}
+
+// copy y[0, n) into x[0, n) if cond
+inline void cmoveInts(int* x, const int* y, int n, int cond) {
+    int i = 0;
+#if defined(OBLIV_SIMD_AVX512)
+    if (simd_level >= SIMD_AVX512 && n >= 16)
+        i = cmoveIntsAvx512(x, y, n, cond);
+#endif
+#if defined(OBLIV_SIMD_AVX2) || defined(OBLIV_SIMD_AVX512)
+    if (simd_level >= SIMD_AVX2 && n - i >= 8)
+        i += cmoveIntsAvx2(x + i, y + i, n - i, cond);
+#endif
+    if (simd_level >= SIMD_SSE && n - i >= 2)
+        i += cmoveIntsSse(x + i, y + i, n - i, cond);
+    cmoveIntsScalar(x + i, y + i, n - i, cond);
+}
+
+};  // namespace obliv
@@ -29,80 +29,43 @@
  *
  */
 
+#include <algorithm>
 #include <memory>
 #include <string>
 
 #include <atomic>
 #include <set>
+#include <stdexcept>
 #include <unordered_map>
 #include "Enclave.h"
 #include "Enclave_t.h"
 #include "LocalTable.h"
+#include "ThreadPool.h"
 #include "sgx_tcrypto.h"
 #include "sgx_trts.h"
+#include "sgx_thread.h"
 
 #define BUFLEN 800000
 static sgx_aes_gcm_128bit_key_t key = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0x9, 0xa, 0xb, 0xc, 0xd, 0xe, 0xf};
-int globalTimingCounter = 0;
+std::atomic<int> globalTimingCounter(0);
 
 int e_num_partitions = -1;
+size_t sort_budget = 0;
 // std::vector<LocalTable> local_tables;
 std::unordered_map<int, std::vector<LocalTable*>> tableMap;  //key is the global table's id; value corresponds to its local tables
-
-uint8_t* decryptMsg(const char* msg, size_t decMessageLen) {
-    // size_t decMessageLen = strlen(msg) - SGX_AESGCM_MAC_SIZE - SGX_AESGCM_IV_SIZE;
-
-    uint8_t* decMessage = new uint8_t[decMessageLen];
-
-    // ret = decryptMessage(msg,strlen(msg),decMessage,decMessageLen);
-
-    uint8_t* encMessage = (uint8_t*)msg;
-    //uint8_t p_dst[BUFLEN] = {0};
-
-    sgx_rijndael128GCM_decrypt(
-        &key,
-        encMessage + SGX_AESGCM_MAC_SIZE + SGX_AESGCM_IV_SIZE,
-        decMessageLen,
-        decMessage,
-        encMessage + SGX_AESGCM_MAC_SIZE, SGX_AESGCM_IV_SIZE,
-        NULL, 0,
-        (sgx_aes_gcm_128bit_tag_t*)encMessage);
-
-    return decMessage;
-}
-
-uint8_t* encryptMsg(const char* msg, size_t msg_length, size_t* encLen) {
-    // The encrypted message will contain the MAC, the IV, and the encrypted message itself.
-    size_t encMessageLen = (SGX_AESGCM_MAC_SIZE + SGX_AESGCM_IV_SIZE + msg_length);
-    uint8_t* encMessage = new uint8_t[encMessageLen];
-
-    uint8_t* origMessage = (uint8_t*)msg;
-    //uint8_t p_dst[BUFLEN] = {0};
-
-    // Generate the IV (nonce)
-    sgx_read_rand(encMessage + SGX_AESGCM_MAC_SIZE, SGX_AESGCM_IV_SIZE);
-    sgx_status_t sgx_status = sgx_rijndael128GCM_encrypt(
-        &key,
-        origMessage, msg_length,
-        encMessage + SGX_AESGCM_MAC_SIZE + SGX_AESGCM_IV_SIZE,
-        encMessage + SGX_AESGCM_MAC_SIZE, SGX_AESGCM_IV_SIZE,
-        NULL, 0,
-        (sgx_aes_gcm_128bit_tag_t*)(encMessage));
-    //memcpy(encMessage,p_dst,encMessageLen);
-    //encMessage[encMessageLen] = '\0';
-
-    if (SGX_SUCCESS != sgx_status) {
-        log_error("ERROR: SGX_NOT_SUCCESS, sgx_status is %i", sgx_status);
+// the partitions of a simulation run may be in different ecalls at once, see simulation_threads
+static sgx_thread_mutex_t table_mutex = SGX_THREAD_MUTEX_INITIALIZER;
+struct TableLock {
+    TableLock() {
+        sgx_thread_mutex_lock(&table_mutex);
     }
-
-    *encLen = encMessageLen;
-
-    return encMessage;
-
-    // encryptMessage(msg, strlen(msg), encMessage, encMessageLen);
-}
+    ~TableLock() {
+        sgx_thread_mutex_unlock(&table_mutex);
+    }
+};
 
 LocalTable* getLocalTable(int global_id, int local_id) {
+    TableLock lock;
     if (tableMap.find(global_id) == tableMap.end()) {
         log_error("Error, global_id %i not exists", global_id);
     }
@@ -118,6 +81,7 @@ void initGlobalTable(int global_id) {
         return;
     }
 
+    TableLock lock;
     if (tableMap.find(global_id) == tableMap.end()) {
         //the global id not exist in tableMap, will create one
         std::vector<LocalTable*> local_tables(e_num_partitions);
@@ -148,57 +112,162 @@ int printf(const char* fmt, ...) {
     return (int)strnlen(buf, BUFSIZ - 1) + 1;
 }
 
-//TODO: free a lot of malloc/new objects...
-/* encLen is the length of content */
-char* packBlock(size_t plainLen, size_t encLen, char* encData, size_t* blockSize) {
-    char* block = (char*)malloc((encLen + 16 + 1) * sizeof(char));
-    memcpy(block, &plainLen, sizeof(size_t));
-    memcpy(block + sizeof(size_t), &encLen, sizeof(size_t));
-    // ((size_t *)block)[0] = plainLen;
-    // ((size_t *)block)[1] = encLen;
-    memcpy(block + 16, encData, encLen);
-    block[encLen + 16] = '\0';
+/*
+    Sealed files: a plain SealedHeader, then num_chunks frames of MAC | IV | ciphertext, where every chunk
+    but the last holds SEAL_CHUNK_BYTES of plaintext. Each chunk has a fresh IV, and its AAD binds the
+    header, the chunk index and a binding value, so chunks can not be reordered, dropped or spliced between
+    files. The binding of a shuffle file is derived from its name, which names the table, the source and
+    the target, and from how many files of that name were written before it: every file is read once, in
+    the order of writing, so the reader counts along and a file replayed from an earlier shuffle fails.
+    Spilled runs use a random binding that only the enclave knows. Writing
+    seals the caller's rows chunk by chunk straight into a pooled host buffer; reading decrypts chunk by
+    chunk straight into the TupleBlock. The enclave never stages more than one chunk.
+*/
+const size_t SEAL_CHUNK_BYTES = 1 << 20;
+const size_t SEAL_FRAME_OVERHEAD = SGX_AESGCM_MAC_SIZE + SGX_AESGCM_IV_SIZE;
+
+struct SealedHeader {
+    uint64_t plain_length;
+    uint64_t num_chunks;
+};
 
-    *blockSize = encLen + 16 + 1;
+struct SealedChunkAad {
+    SealedHeader header;
+    uint64_t binding;
+    uint64_t index;
+};
 
-    free(encData);
-    return block;
+// how many files of each name this enclave has written, and read; see fileBinding
+static std::unordered_map<std::string, uint64_t> written_files, read_files;
+static sgx_thread_mutex_t file_count_mutex = SGX_THREAD_MUTEX_INITIALIZER;
+
+// how many files named file_name are counted in counts, before counting advance more
+static uint64_t fileCount(const char* file_name, std::unordered_map<std::string, uint64_t>& counts, int advance) {
+    sgx_thread_mutex_lock(&file_count_mutex);
+    uint64_t count = counts[file_name];
+    counts[file_name] += advance;
+    sgx_thread_mutex_unlock(&file_count_mutex);
+    return count;
+}
+
+// the binding of the file_name written for the count-th time: the first 8 bytes of SHA-256(count | name)
+static uint64_t fileBinding(const char* file_name, uint64_t count) {
+    std::string message((const char*)&count, sizeof(count));
+    message += file_name;
+    sgx_sha256_hash_t digest;
+    sgx_status_t sgx_status = sgx_sha256_msg((const uint8_t*)message.data(), (uint32_t)message.size(), &digest);
+    if (SGX_SUCCESS != sgx_status) {
+        log_error("ERROR: SGX_NOT_SUCCESS, sgx_status is %i", sgx_status);
+        throw std::runtime_error("cannot hash the binding of a sealed file");
+    }
+    uint64_t binding;
+    memcpy(&binding, digest, sizeof(binding));
+    return binding;
 }
 
-/* return: the enc data */
-char* unpackBlock(char* block, size_t* plainLen, size_t* encLen) {
-    *plainLen = ((size_t*)block)[0];
-    *encLen = ((size_t*)block)[1];
+static size_t sealedLength(const SealedHeader& header) {
+    return sizeof(SealedHeader) + header.num_chunks * SEAL_FRAME_OVERHEAD + header.plain_length;
+}
 
-    return block + 16;
+// seal content_length bytes of content into a fresh host buffer; its length goes to *sealed_length
+static char* seal(const char* content, size_t content_length, uint64_t binding, size_t* sealed_length) {
+    SealedHeader header = {content_length, (content_length + SEAL_CHUNK_BYTES - 1) / SEAL_CHUNK_BYTES};
+    *sealed_length = sealedLength(header);
+    char* unsafe_buf;
+    ocall_acquire_buffer(*sealed_length, &unsafe_buf);
+    if (unsafe_buf == NULL || !sgx_is_outside_enclave(unsafe_buf, *sealed_length)) {
+        log_error("Error: cannot allocate %llu bytes of host memory", *sealed_length);
+        throw std::runtime_error("cannot allocate host memory for a sealed buffer");
+    }
+    memcpy(unsafe_buf, &header, sizeof(header));
+    uint8_t* frame = (uint8_t*)unsafe_buf + sizeof(header);
+    for (uint64_t i = 0; i < header.num_chunks; i++) {
+        size_t offset = i * SEAL_CHUNK_BYTES;
+        size_t length = std::min(SEAL_CHUNK_BYTES, content_length - offset);
+        SealedChunkAad aad = {header, binding, i};
+        uint8_t iv[SGX_AESGCM_IV_SIZE];
+        sgx_aes_gcm_128bit_tag_t mac;
+        sgx_read_rand(iv, SGX_AESGCM_IV_SIZE);
+        sgx_status_t sgx_status = sgx_rijndael128GCM_encrypt(
+            &key,
+            (const uint8_t*)content + offset, length,
+            frame + SEAL_FRAME_OVERHEAD,
+            iv, SGX_AESGCM_IV_SIZE,
+            (const uint8_t*)&aad, sizeof(aad),
+            &mac);
+        if (SGX_SUCCESS != sgx_status) {
+            log_error("ERROR: SGX_NOT_SUCCESS, sgx_status is %i", sgx_status);
+        }
+        memcpy(frame, mac, SGX_AESGCM_MAC_SIZE);
+        memcpy(frame + SGX_AESGCM_MAC_SIZE, iv, SGX_AESGCM_IV_SIZE);
+        frame += SEAL_FRAME_OVERHEAD + length;
+    }
+    return unsafe_buf;
 }
 
-/* Currently we only read and write 1 block each time */
+// decrypt the sealed rows in host memory and append them to tuples; returns how many, or -1 if the
+// buffer is malformed or fails to authenticate
+static int unseal(const uint8_t* file, size_t file_length, uint64_t binding, TupleBlock* tuples, const char* name) {
+    if (file_length < sizeof(SealedHeader) || !sgx_is_outside_enclave(file, file_length)) {
+        log_error("Error: sealed file %s is truncated", name);
+        return -1;
+    }
+    SealedHeader header;
+    memcpy(&header, file, sizeof(header));
+    if (header.num_chunks != (header.plain_length + SEAL_CHUNK_BYTES - 1) / SEAL_CHUNK_BYTES || sealedLength(header) != file_length) {
+        log_error("Error: sealed file %s has a malformed header", name);
+        return -1;
+    }
+    size_t row_length = Tuple::rowLength(tuples->num_columns());
+    if (header.plain_length % row_length != 0) {
+        log_error("Error: %llu can not be divided by row_length %llu", header.plain_length, row_length);
+        return -1;
+    }
+
+    //the rows of the file are laid out as in the block, dummy rows included
+    int num_rows = header.plain_length / row_length;
+    if (num_rows == 0)
+        return 0;
+    int first = tuples->size();
+    tuples->resize(first + num_rows);
+    uint8_t* rows = (uint8_t*)tuples->row(first);
+    // frames are read straight from the host buffer (the file mapping for FileTransport), but each one
+    // is copied in before it is checked, so the host can not change it between authentication and
+    // decryption
+    std::vector<uint8_t> staging(SEAL_FRAME_OVERHEAD + std::min(SEAL_CHUNK_BYTES, (size_t)header.plain_length));
+    const uint8_t* frame = file + sizeof(header);
+    for (uint64_t i = 0; i < header.num_chunks; i++) {
+        size_t offset = i * SEAL_CHUNK_BYTES;
+        size_t length = std::min(SEAL_CHUNK_BYTES, (size_t)header.plain_length - offset);
+        memcpy(&staging[0], frame, SEAL_FRAME_OVERHEAD + length);
+        SealedChunkAad aad = {header, binding, i};
+        sgx_status_t sgx_status = sgx_rijndael128GCM_decrypt(
+            &key,
+            &staging[SEAL_FRAME_OVERHEAD], length,
+            rows + offset,
+            &staging[SGX_AESGCM_MAC_SIZE], SGX_AESGCM_IV_SIZE,
+            (const uint8_t*)&aad, sizeof(aad),
+            (const sgx_aes_gcm_128bit_tag_t*)&staging[0]);
+        if (SGX_SUCCESS != sgx_status) {
+            log_error("Error: chunk %llu of %s failed to authenticate, sgx_status is %i", i, name, sgx_status);
+            return -1;
+        }
+        frame += SEAL_FRAME_OVERHEAD + length;
+    }
+    return num_rows;
+}
 
 void write_file(const char* file_name, const char* content, size_t content_length, int row_num, int global_id, int local_id, int target_local_id) {
     int uniq_counter = globalTimingCounter++;
-    size_t plainLen = content_length;
-    size_t encLen = 0;
     ocall_record_time_start("read_write", uniq_counter, global_id, local_id);
-    auto encData = encryptMsg(content, content_length, &encLen);
 
-    free((void*)content);
-    size_t blockSize = 0;
-    char* block = packBlock(plainLen, encLen, (char*)encData, &blockSize);
-    char* unsafe_buf;
-    unsafe_ocall_malloc(blockSize, &unsafe_buf);
-    memcpy(unsafe_buf, block, blockSize);
-    ocall_write_file(file_name, unsafe_buf, blockSize, row_num, global_id, local_id, target_local_id);
-    free(block);
-    ocall_free(unsafe_buf);
+    size_t sealed_length;
+    char* unsafe_buf = seal(content, content_length, fileBinding(file_name, fileCount(file_name, written_files, 1)), &sealed_length);
+    // the host owns the buffer again from here and recycles it once the file is delivered
+    ocall_write_file(file_name, unsafe_buf, sealed_length, row_num, global_id, local_id, target_local_id);
     ocall_record_time_end("read_write", uniq_counter, global_id, local_id);
 }
 
-void freeFileInfo(FileInfo* f) {
-    free(f->file_content);
-    free(f);
-};
-
 void profile_record_time_start(const char* log, int uniq_counter, int global_id, int local_id) {
     ocall_record_time_start(log, uniq_counter, global_id, local_id);
 }
@@ -207,49 +276,59 @@ void profile_record_time_end(const char* log, int uniq_counter, int global_id, i
     ocall_record_time_end(log, uniq_counter, global_id, local_id);
 }
 
-void load_file_str(FileInfo* f, std::vector<Tuple>* tuples, int num_columns) {
-    int row_length = Tuple::rowLength(num_columns);
-
-    if (f->file_length % row_length != 0) {
-        log_error("Error: %llu can not be divided by row_length %llu", f->file_length, row_length);
-    }
-
-    //this num_rows contains dummy rows
-    int num_all_rows = f->file_length / row_length;
-    int ori_tuples_size = tuples->size();
-
-    tuples->reserve(num_all_rows + ori_tuples_size);
-
-    //std::vector<int> data(num_columns);
-    char* pointer = (char*)f->file_content;
-    for (int i = 0; i < num_all_rows; i++) {
-        tuples->emplace_back(pointer, num_columns);
-        pointer += row_length;
-    }
-}
-
-FileInfo* read_file(const char* file_name, int global_id, int local_id) {
+int read_file(const char* file_name, int global_id, int local_id, TupleBlock* tuples) {
     int uniq_counter = globalTimingCounter++;
     ocall_record_time_start("read_write", uniq_counter, global_id, local_id);
 
     void* result;
     ocall_read_file(&result, file_name);
-    FileInfo* ret = static_cast<FileInfo*>(result);
-
-    size_t plainLen = 0;
-    size_t encLen = 0;
+    FileInfo info;
+    if (result == NULL || !sgx_is_outside_enclave(result, sizeof(FileInfo))) {
+        log_error("Error: no file info returned for %s", file_name);
+        throw std::runtime_error("shuffle file not available");
+    }
+    memcpy(&info, result, sizeof(info));
+    // the read only counts once the file authenticates, so a failed read can be retried
+    uint64_t count = fileCount(file_name, read_files, 0);
+    int num_rows = unseal(info.file_content, info.file_length, fileBinding(file_name, count), tuples, file_name);
+    ocall_release_file(result);
+    if (num_rows < 0)
+        throw std::runtime_error("shuffle file does not authenticate");
+    fileCount(file_name, read_files, 1);
 
-    char* encData = unpackBlock(reinterpret_cast<char*>(ret->file_content), &plainLen, &encLen);
+    ocall_record_time_end("read_write", uniq_counter, global_id, local_id);
+    return num_rows;
+}
 
-    // size_t decLen = 0;
-    auto decFile = decryptMsg(encData, plainLen);
-    FileInfo* decRet = new FileInfo;
-    decRet->file_content = decFile;
-    decRet->file_length = plainLen;
+SealedRun seal_rows(const TupleBlock& tuples, int begin, int end) {
+    SealedRun run;
+    sgx_read_rand((uint8_t*)&run.binding, sizeof(run.binding));
+    run.buffer = seal(tuples.bytes(begin), tuples.byteLength(begin, end), run.binding, &run.length);
+    return run;
+}
 
-    ocall_record_time_end("read_write", uniq_counter, global_id, local_id);
+int unseal_rows(SealedRun& run, TupleBlock* tuples) {
+    int num_rows = unseal((const uint8_t*)run.buffer, run.length, run.binding, tuples, "spilled run");
+    ocall_release_buffer(run.buffer);
+    run.buffer = NULL;
+    if (num_rows < 0)
+        throw std::runtime_error("spilled run does not authenticate");
+    return num_rows;
+}
 
-    return decRet;
+/*
+    Body of an ecall that runs a table operation. Sealing or reading a file can fail (a file that does not
+    authenticate, host memory that cannot be allocated) and throws; the exception must not leave the
+    enclave, so it is logged here and the ecall returns -1, which the host turns into a failed task.
+*/
+template <typename Body>
+static auto guarded(Body body) -> decltype(body()) {
+    try {
+        return body();
+    } catch (const std::exception& e) {
+        log_error("Error: %s", e.what());
+        return -1;
+    }
 }
 
 int ecall_merge_and_print_string(char* s1, char* s2) {
@@ -272,20 +351,56 @@ int ecall_setup_env(int num_partitions_) {
     return 0;
 }
 
-int ecall_read_file(int global_id, int local_id, uint8_t* file, size_t file_length) {
-    if (tableMap.find(global_id) == tableMap.end()) {
-        // 键不存在
-        if (e_num_partitions < 1) {
-            log_error("Error: num_partitions=%i is invalid, it should be larger than 0", e_num_partitions);
-            return -1;
-        }
+int ecall_setup_sort(int sort_algorithm, double kappa, uint64_t sort_budget_) {
+    obliv::set_sort_algorithm(sort_algorithm, kappa);
+    sort_budget = sort_budget_;
+    return 0;
+}
+
+// simd_level is what the host CPU supports; returns the level actually used
+int ecall_setup_simd(int simd_level) {
+    return obliv::set_simd_level(simd_level);
+}
+
+// microbenchmark of the compare-exchange kernels: rounds passes of cswapRow over num_rows rows,
+// pairing i with i + num_rows / 2. The host times the ecall; the return value only keeps the work alive.
+int ecall_bench_cswap(int num_columns, int num_rows, int rounds) {
+    TupleBlock tuples(num_columns);
+    tuples.resize(num_rows);
+    for (int i = 0; i < num_rows; i++)
+        for (int j = 0; j < num_columns; j++)
+            tuples.row(i)[j] = i + j;
+    int half = num_rows / 2;
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < half; i++)
+            obliv::cswapRow(tuples, i, i + half, (i ^ r) & 1);
+    int check = 0;
+    for (TupleRef tuple : tuples)
+        check ^= tuple.data[0];
+    return check;
+}
+
+// the calling host thread becomes an enclave worker until ecall_thread_pool_stop
+int ecall_thread_pool_worker(int thread_id) {
+    thread_pool::worker_loop(thread_id);
+    return 0;
+}
+
+int ecall_thread_pool_stop() {
+    thread_pool::stop();
+    return 0;
+}
 
-        initGlobalTable(global_id);
-        // std::vector<LocalTable*> local_tables(num_partitions);
-        // tableMap.insert(std::make_pair(global_id, local_tables));
+int ecall_read_file(int global_id, int local_id, uint8_t* file, size_t file_length) {
+    if (e_num_partitions < 1) {
+        log_error("Error: num_partitions=%i is invalid, it should be larger than 0", e_num_partitions);
+        return -1;
     }
+    // creates the local table slots unless another partition already did
+    initGlobalTable(global_id);
 
     LocalTable* local_table = new LocalTable(global_id, local_id, file, file_length);
+    TableLock lock;
     tableMap[global_id][local_id] = local_table;
 
     return 0;
@@ -303,12 +418,14 @@ int ecall_copy(int global_id, int local_id, int new_global_id) {
 
     /* the global id of the copied table is designed to be original table's global id + 1000 */
     initGlobalTable(new_global_id);
+    TableLock lock;
     tableMap[new_global_id][local_id] = local_table;
 
     return 0;
 }
 
 int ecall_destroy(int global_id, int num_partitions) {
+    TableLock lock;
     for (int i = 0; i < num_partitions; i++) {
         delete tableMap[global_id][i];
     }
@@ -348,28 +465,17 @@ int ecall_groupByAggregateBase(int global_id,
                                bool doPrefix,
                                int phase,
                                bool reverse) {
-    // AssociateOperator *aop = static_cast<AssociateOperator *>(op);
-    AssociateOperator* aop = createOp(op);
-
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->groupByAggregateBase(e_num_partitions, aop, doPrefix, phase, reverse);
-    free(aop);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
-}
+    return guarded([&] {
+        // AssociateOperator *aop = static_cast<AssociateOperator *>(op);
+        AssociateOperator* aop = createOp(op);
 
-int ecall_addValueByKey(int global_id,
-                        int local_id,
-                        void* op) {
-    // AssociateOperator *aop = static_cast<AssociateOperator *>(op);
-    AssociateOperator* aop = createOp(op);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->_addValueByKey(aop);
-    free(aop);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->groupByAggregateBase(e_num_partitions, aop, doPrefix, phase, reverse);
+        free(aop);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_shuffleByKey(int global_id,
@@ -379,12 +485,45 @@ int ecall_shuffleByKey(int global_id,
                        size_t key_size,
                        int seed,
                        int size_bound) {
-    std::vector<int> key(key_data, key_data + key_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->shuffleByKey(num_partitions, key, seed, size_bound);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> key(key_data, key_data + key_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->shuffleByKey(num_partitions, key, seed, size_bound);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
+}
+
+int ecall_shuffleByKeyTwoRound(int global_id,
+                               int local_id,
+                               int num_partitions,
+                               int* key_data,
+                               size_t key_size,
+                               int seed,
+                               int size_bound,
+                               int overflow_bound) {
+    return guarded([&] {
+        std::vector<int> key(key_data, key_data + key_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->shuffleByKeyTwoRound(num_partitions, key, seed, size_bound, overflow_bound);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
+}
+
+int ecall_shuffleRelay(int global_id,
+                       int local_id,
+                       int num_partitions,
+                       int overflow_bound) {
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->shuffleRelay(num_partitions, overflow_bound);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_shuffleByCol(int global_id,
@@ -392,45 +531,66 @@ int ecall_shuffleByCol(int global_id,
                        int num_partitions,
                        int i_col_id,
                        int shuffle_by_col_padding_size) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->shuffleByCol(num_partitions, i_col_id, shuffle_by_col_padding_size);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->shuffleByCol(num_partitions, i_col_id, shuffle_by_col_padding_size);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_randomShuffle(int global_id,
                         int local_id,
                         int num_partitions) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->randomShuffle(num_partitions);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->randomShuffle(num_partitions);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
 
-    return 0;
+        return 0;
+    });
 }
 
 int ecall_shuffleMerge(int global_id,
                        int local_id,
-                       int num_partitions) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->shuffleMerge(num_partitions);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+                       int num_partitions,
+                       bool relayed) {
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->shuffleMerge(num_partitions, relayed);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
 
-    return 0;
+        return 0;
+    });
+}
+
+int ecall_samplePivots(int global_id,
+                       int local_id,
+                       int sample_size) {
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->samplePivots(e_num_partitions, sample_size);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_getPivots(int global_id,
                     int local_id,
                     int* columns_data,
                     size_t columns_size) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->getPivots(e_num_partitions, columns);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->getPivots(e_num_partitions, columns);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 long long ecall_sum(int global_id,
@@ -457,11 +617,13 @@ int ecall_union(int global_id,
                 int local_id,
                 int other_table_global_id,
                 int other_table_local_id) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->union_table(*getLocalTable(other_table_global_id, other_table_local_id));
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->union_table(*getLocalTable(other_table_global_id, other_table_local_id));
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 long long ecall_SODA_step1(int global_id,
@@ -469,32 +631,38 @@ long long ecall_SODA_step1(int global_id,
                      int* columns_data,
                      size_t columns_size,
                      int aggCol) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    long long ret = getLocalTable(global_id, local_id)->SODA_step1(columns, e_num_partitions, aggCol);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return ret;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        long long ret = getLocalTable(global_id, local_id)->SODA_step1(columns, e_num_partitions, aggCol);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return ret;
+    });
 }
 
 int ecall_SODA_step2(int global_id,
                      int local_id,
                      int p) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->SODA_step2(e_num_partitions, p);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->SODA_step2(e_num_partitions, p);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_SODA_step3(int global_id,
                      int local_id,
                      int p) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->SODA_step3(e_num_partitions, p);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->SODA_step3(e_num_partitions, p);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_localJoin(int global_id,
@@ -503,42 +671,50 @@ int ecall_localJoin(int global_id,
                     int other_table_local_id,
                     int num_cols,
                     int output_size) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    int ret = getLocalTable(global_id, local_id)->localJoin(*getLocalTable(other_table_global_id, other_table_local_id), num_cols, output_size);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return ret;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        int ret = getLocalTable(global_id, local_id)->localJoin(*getLocalTable(other_table_global_id, other_table_local_id), num_cols, output_size);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return ret;
+    });
 }
 
 int ecall_SODA_step5(int global_id,
                      int local_id) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->SODA_step5(e_num_partitions);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->SODA_step5(e_num_partitions);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_assignColE(int global_id,
                      int local_id,
                      int col) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->assignColE(e_num_partitions, col);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->assignColE(e_num_partitions, col);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_mvJoinColsAhead(int global_id,
                           int local_id,
                           int* columns_data,
                           size_t columns_size) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->mvJoinColsAhead(e_num_partitions, columns);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->mvJoinColsAhead(e_num_partitions, columns);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_partitionByPivots(int global_id,
@@ -546,69 +722,81 @@ int ecall_partitionByPivots(int global_id,
                             int* columns_data,
                             size_t columns_size,
                             int size_bound) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->partitionByPivots(columns, e_num_partitions, size_bound);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->partitionByPivots(columns, e_num_partitions, size_bound);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_sortMerge(int global_id,
                     int local_id,
                     int* columns_data,
                     size_t columns_size) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->sortMerge(e_num_partitions, columns);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->sortMerge(e_num_partitions, columns);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_localSort(int global_id,
                     int local_id,
                     int* columns_data,
                     size_t columns_size) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->localSort(e_num_partitions, columns);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->localSort(e_num_partitions, columns);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_pad_to_size(int global_id,
                       int local_id,
                       int n) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->pad_to_size(e_num_partitions, n);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->pad_to_size(e_num_partitions, n);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_opaque_prepare_shuffle_col(int global_id,
                                      int local_id,
                                      int col_id,
                                      int tuple_num) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->opaque_prepare_shuffle_col(e_num_partitions, col_id, tuple_num);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->opaque_prepare_shuffle_col(e_num_partitions, col_id, tuple_num);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_foreignTableModifyColZ(int global_id,
                                  int local_id,
                                  int* columns_data,
                                  size_t columns_size) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->foreignTableModifyColZ(e_num_partitions, columns);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->foreignTableModifyColZ(e_num_partitions, columns);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_finalizePkjoinResult(int global_id,
@@ -617,12 +805,14 @@ int ecall_finalizePkjoinResult(int global_id,
                                size_t columns_size,
                                int ori_r_col_num,
                                int r_align_col_num) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->finalizePkjoinResult(e_num_partitions, columns, ori_r_col_num, r_align_col_num);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->finalizePkjoinResult(e_num_partitions, columns, ori_r_col_num, r_align_col_num);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_pkJoinCombine(int global_id,
@@ -635,102 +825,124 @@ int ecall_pkJoinCombine(int global_id,
                         size_t combine_sort_cols_size,
                         int* join_cols_data,
                         size_t join_cols_size) {
-    std::vector<int> combine_sort_cols(combine_sort_cols_data, combine_sort_cols_data + combine_sort_cols_size);
-    std::vector<int> join_cols(join_cols_data, join_cols_data + join_cols_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->pkJoinCombine(e_num_partitions, ori_r_col_num, r_align_col_num, combine_sort_cols, join_cols, *getLocalTable(s_table_global_id, s_table_local_id));
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> combine_sort_cols(combine_sort_cols_data, combine_sort_cols_data + combine_sort_cols_size);
+        std::vector<int> join_cols(join_cols_data, join_cols_data + join_cols_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->pkJoinCombine(e_num_partitions, ori_r_col_num, r_align_col_num, combine_sort_cols, join_cols, *getLocalTable(s_table_global_id, s_table_local_id));
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_joinComputeAlignment(int global_id,
                                int local_id,
                                int m) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->joinComputeAlignment(m);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->joinComputeAlignment(m);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_joinFinalCombine(int global_id,
                            int local_id,
                            int r_table_global_id,
                            int num_join_cols) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->joinFinalCombine(*getLocalTable(r_table_global_id, local_id), num_join_cols);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->joinFinalCombine(*getLocalTable(r_table_global_id, local_id), num_join_cols);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
+}
+
+int ecall_run_plan(int global_id,
+                   int local_id,
+                   int* plan_data,
+                   size_t plan_size) {
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        int ret = getLocalTable(global_id, local_id)->runPlan(e_num_partitions, plan_data, plan_size);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return ret;
+    });
 }
 
 int ecall_addCol(int global_id,
                  int local_id,
                  int defaultVal,
                  int col_index) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->addCol(e_num_partitions, defaultVal, col_index);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->addCol(e_num_partitions, defaultVal, col_index);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_copyCol(int global_id,
                   int local_id,
                   int col_index) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->copyCol(e_num_partitions, col_index);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->copyCol(e_num_partitions, col_index);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_expansion_prepare(int global_id,
                             int local_id,
                             int d_index) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->expansion_prepare(e_num_partitions, d_index);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->expansion_prepare(e_num_partitions, d_index);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_add_and_calculate_col_t_p(int global_id,
                                     int local_id, int d_index, int m) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->add_and_calculate_col_t_p(d_index, m);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->add_and_calculate_col_t_p(d_index, m);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_expansion_distribute_and_clear(int global_id,
                                          int local_id, int m) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->expansion_distribute_and_clear(e_num_partitions, m);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
-}
-
-int ecall_expansion_suffix_sum(int global_id,
-                               int local_id, int phase) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->expansion_suffix_sum(e_num_partitions, phase);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->expansion_distribute_and_clear(e_num_partitions, m);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_deleteCol(int global_id,
                     int local_id,
                     int col_index) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->deleteCol(e_num_partitions, col_index);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->deleteCol(e_num_partitions, col_index);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_size(int global_id,
@@ -749,24 +961,28 @@ int ecall_remove_dup_after_prefix(int global_id,
                                   int local_id,
                                   int* columns_data,
                                   size_t columns_size) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->remove_dup_after_prefix(e_num_partitions, columns);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->remove_dup_after_prefix(e_num_partitions, columns);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_project(int global_id,
                   int local_id,
                   int* columns_data,
                   size_t columns_size) {
-    std::vector<int> columns(columns_data, columns_data + columns_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->project(columns);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> columns(columns_data, columns_data + columns_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->project(columns);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_soda_shuffleByKey(int global_id,
@@ -776,21 +992,25 @@ int ecall_soda_shuffleByKey(int global_id,
                             size_t key_size,
                             int seed,
                             int size_bound) {
-    std::vector<int> key(key_data, key_data + key_size);
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->soda_shuffleByKey(num_partitions, key, seed, size_bound);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        std::vector<int> key(key_data, key_data + key_size);
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->soda_shuffleByKey(num_partitions, key, seed, size_bound);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
 
 int ecall_generateData(int global_id,
                        int local_id,
                        int num_cols,
                        int num_rows) {
-    int uniq_counter = globalTimingCounter++;
-    ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
-    getLocalTable(global_id, local_id)->generateData(num_cols, num_rows);
-    ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
-    return 0;
+    return guarded([&] {
+        int uniq_counter = globalTimingCounter++;
+        ocall_record_time_start("TOTAL", uniq_counter, global_id, local_id);
+        getLocalTable(global_id, local_id)->generateData(num_cols, num_rows);
+        ocall_record_time_end("TOTAL", uniq_counter, global_id, local_id);
+        return 0;
+    });
 }
@@ -35,7 +35,8 @@
 
 #include <stdlib.h>
 #include <assert.h>
-#include "Tuple.h"
+#include <atomic>
+#include "TupleBlock.h"
 
 #if defined(__cplusplus)
 extern "C" {
@@ -53,20 +54,38 @@ void log_log(int level, const char *file, int line, const char *fmt, ...);
 
 int printf(const char* fmt, ...);
 
+// content stays owned by the caller, which may pass a pointer into a TupleBlock
 void write_file(const char* file_name, const char *content, size_t content_length, int row_num, int global_id, int local_id, int target_local_id);
 
+// what ocall_read_file returns, in host memory until it is passed to ocall_release_file
 struct FileInfo
 {
     uint8_t *file_content;
     uint64_t file_length;
 };
 
-extern int globalTimingCounter;
+// numbers the timed sections, which partitions in different ecalls start at the same time
+extern std::atomic<int> globalTimingCounter;
 
-void freeFileInfo(FileInfo *f);
+// decrypt the sealed rows of a file and append them to tuples; returns how many were appended
+int read_file(const char* file_name, int global_id, int local_id, TupleBlock *tuples);
 
-FileInfo *read_file(const char* file_name, int global_id, int local_id);
-void load_file_str(FileInfo* f, std::vector<Tuple> *tuples, int num_columns);
+// rows sealed into a host buffer, for data that does not fit the enclave heap. binding is a random
+// value kept in the enclave and authenticated with every chunk, so the host can neither swap two runs
+// nor hand back an older version of one
+struct SealedRun
+{
+    char *buffer;
+    size_t length;
+    uint64_t binding;
+};
+
+SealedRun seal_rows(const TupleBlock& tuples, int begin, int end);
+// append the rows of run to tuples and give its buffer back to the host; returns how many were appended
+int unseal_rows(SealedRun& run, TupleBlock *tuples);
+
+// bytes of rows LocalTable::sort may hold in the enclave; 0 for no limit
+extern size_t sort_budget;
 
 
 void profile_record_time_start(const char* log, int uniq_counter, int global_id, int local_id);
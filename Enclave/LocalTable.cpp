@@ -7,10 +7,12 @@
 #include <memory>
 #include <random>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <unordered_set>
 #include <vector>
 #include "Obliv.h"
+#include "TupleKernel.h"
 #include "define.h"
 
 // compute the p-quatile, i.e., splite {0,1,...,n-1} to p even parts (start included, end included)
@@ -43,10 +45,9 @@ LocalTable::LocalTable(int global_id_, int id_, uint8_t* file, size_t file_lengt
     std::istringstream header(line);
     std::string column_name;
     std::vector<std::string> m_columnNames;
-    while (header >> column_name) {
+    while (header >> column_name)
         m_columnNames.push_back(column_name);
-        m_num_columns++;
-    }
+    m_tuples = TupleBlock(m_columnNames.size());
 
     // read rows
     while (std::getline(ss, line)) {
@@ -66,79 +67,109 @@ LocalTable::LocalTable(int global_id_, int id_, uint8_t* file, size_t file_lengt
 }
 
 const int LocalTable::size() {
-    return (int)m_tuples.size();
+    return m_tuples.size();
 }
 
 const int LocalTable::num_columns() {
-    if (m_tuples.size() == 0) {
-        log_error("Calling num_columns on empty table!");
-    }
-    return m_tuples[0].data.size();
+    return m_tuples.num_columns();
 }
 
-void LocalTable::mvJoinColsAhead(int num_partitions, const std::vector<int> join_cols) {
+// column mapping for TupleBlock::reshape that puts join_cols first and keeps the order of the others
+static std::vector<int> joinColsAhead(int num_columns, const std::vector<int>& join_cols) {
     std::unordered_set<int> join_cols_set(join_cols.begin(), join_cols.end());
-    for (int i = 0; i < m_tuples.size(); i++) {
-        auto bak_data = m_tuples[i].data;
-        for (int j = 0; j < join_cols.size(); j++)
-            m_tuples[i].data[j] = bak_data[join_cols[j]];
-        int id = join_cols.size();
-        for (int j = 0; j < num_columns(); j++)
-            if (join_cols_set.find(j) == join_cols_set.end())
-                m_tuples[i].data[id++] = bak_data[j];
-    }
+    std::vector<int> order = join_cols;
+    for (int j = 0; j < num_columns; j++)
+        if (join_cols_set.find(j) == join_cols_set.end())
+            order.push_back(j);
+    return order;
+}
+
+void LocalTable::mvJoinColsAhead(int num_partitions, const std::vector<int> join_cols) {
+    m_tuples.reshape(joinColsAhead(num_columns(), join_cols));
+}
+
+// column mapping for TupleBlock::reshape: the old columns with src inserted at pos (-1 for a fill value)
+static std::vector<int> insertColumn(int num_columns, int pos, int src) {
+    std::vector<int> columns;
+    for (int j = 0; j < num_columns; j++) {
+        if (j == pos)
+            columns.push_back(src);
+        columns.push_back(j);
+    }
+    if (pos == num_columns)
+        columns.push_back(src);
+    return columns;
+}
+
+// column mapping for TupleBlock::reshape: the old columns with a copy of col next to it (at the end for -1)
+static std::vector<int> copyColumn(int num_columns, int col) {
+    if (col == -1)
+        return insertColumn(num_columns, num_columns, num_columns - 1);
+    return insertColumn(num_columns, col, col);
+}
+
+// column mapping for TupleBlock::reshape: the old columns without col (-1 for the last one)
+static std::vector<int> deleteColumn(int num_columns, int col) {
+    if (col == -1)
+        col = num_columns - 1;
+    std::vector<int> columns;
+    for (int j = 0; j < num_columns; j++)
+        if (j != col)
+            columns.push_back(j);
+    return columns;
 }
 
 void LocalTable::print(int limit_size, bool show_dummy) {
     printf("****** global_id: %i, m_tuples size: %i, m_num_rows: %i, show_dummy is %d\n", global_id, m_tuples.size(), getNumRows(), show_dummy);
-    int counter = 0;
-    for (auto& tuple : m_tuples) {
-        if (counter > limit_size) {
-            printf("%s...\n", " ");
-            break;
-        }
-        if (tuple.is_dummy) {
-            if (show_dummy) {
-                printf("dummy%s", "\n");
-                counter++;
-            }
-        } else {
-            for (int v : tuple.data)
-                printf(" %i", v);
-
-            printf(";%s\n", " ");
-            counter++;
-        }
-    }
+    print_tuples(m_tuples, limit_size, show_dummy);
 }
 
 LocalTable* LocalTable::copy(int new_global_id) {
     /* the global id of the copied table is designed to be original table's global id + 1000 */
     LocalTable* ret = new LocalTable(new_global_id, id, m_tuples);
-    ret->m_num_columns = m_num_columns;
 
     return ret;
 }
 
-void LocalTable::shuffleByKey(int num_partitions, const std::vector<int>& key, int seed, int size_bound) {
-    if (m_tuples.size() == 0) {
-        log_warn("m_tuples size is 0, skip shuffle");
-        return;
+// index_list[i] = hash of the key columns of row i, modulo num_partitions
+struct HashPartition {
+    TupleBlock& tuples;
+    int seed, num_partitions;
+    std::vector<int>& index_list;
+    HashPartition(TupleBlock& tuples, int seed, int num_partitions, std::vector<int>& index_list)
+        : tuples(tuples), seed(seed), num_partitions(num_partitions), index_list(index_list) {}
+
+    template <typename Kernel>
+    void operator()(const Kernel& kernel) {
+        for (int i = 0; i < tuples.size(); i++)
+            index_list[i] = (unsigned long long int)kernel.hash(tuples.row(i), seed) % num_partitions;
     }
+};
 
+// the target partition of every tuple by the hash of key; dummy tuples get a random one
+std::vector<int> LocalTable::targetsByKey(int num_partitions, const std::vector<int>& key, int seed) {
     std::random_device rd;
     std::mt19937 rng(rd());
     std::uniform_int_distribution<> distr(0, num_partitions - 1);
 
-    std::vector<int> index_list;
-    for (auto& tuple : m_tuples) {
-        int index = (unsigned long long int)tuple.hash(key, seed) % num_partitions;
-        obliv::cmove(index, distr(rng), tuple.is_dummy);
+    std::vector<int> index_list(m_tuples.size());
+    HashPartition hasher(m_tuples, seed, num_partitions, index_list);
+    dispatchKernel(key, num_columns(), hasher);
+    for (int i = 0; i < m_tuples.size(); i++) {
+        obliv::cmove(index_list[i], distr(rng), m_tuples[i].is_dummy);
         // if (tuple.is_dummy)
         //     index = distr(rng);
-        index_list.push_back(index);
     }
+    return index_list;
+}
 
+void LocalTable::shuffleByKey(int num_partitions, const std::vector<int>& key, int seed, int size_bound) {
+    if (m_tuples.size() == 0) {
+        log_warn("m_tuples size is 0, skip shuffle");
+        return;
+    }
+
+    std::vector<int> index_list = targetsByKey(num_partitions, key, seed);
     shuffle(num_partitions, index_list, size_bound);
 }
 
@@ -149,7 +180,7 @@ void LocalTable::shuffleByCol(int num_partitions, int i_col_id, int size_bound)
     log_debug("size bound = %d, p = %d, size = %d", size_bound, num_partitions, m_tuples.size());
     if (size_bound * num_partitions < m_tuples.size()) {
         std::vector<int> M;
-        for (auto& tuple : m_tuples)
+        for (TupleRef tuple : m_tuples)
             M.push_back(!tuple.is_dummy);
         obliv::compact(m_tuples, M);
         m_tuples.resize(size_bound * num_partitions);
@@ -158,7 +189,7 @@ void LocalTable::shuffleByCol(int num_partitions, int i_col_id, int size_bound)
     if (num_columns() <= i_col_id) {
         log_error("ShuffleByCol error: num_cols = %d, i_col_id = %d", num_columns(), i_col_id);
     }
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         int index = tuple.data[i_col_id];
         // if (!tuple.is_dummy && (index >= num_partitions || index < 0)) {
         //     log_error("In shuffleByCol, I column value %i out of index", index);
@@ -180,7 +211,7 @@ void LocalTable::randomShuffle(int num_partitions) {
     std::mt19937 rng(rd());
     std::uniform_int_distribution<> distr(0, num_partitions - 1);
 
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         int index = distr(rng);
         index_list.push_back(index);
     }
@@ -199,30 +230,108 @@ std::string genPivotsFileName(int gid, int lid, int tlid) {
     return file_name;
 }
 
+std::string genOverflowFileName(int gid, int lid, int tlid) {
+    std::string file_name = "../data/shuffle_buffer/gid" + std::to_string(gid) + "_lid" + std::to_string(lid) + "_tlid" + std::to_string(tlid) + "_overflow";
+    return file_name;
+}
+
+std::string genRelayFileName(int gid, int lid, int tlid) {
+    std::string file_name = "../data/shuffle_buffer/gid" + std::to_string(gid) + "_lid" + std::to_string(lid) + "_tlid" + std::to_string(tlid) + "_relay";
+    return file_name;
+}
+
+std::string genSampleFileName(int gid, int lid, int tlid) {
+    std::string file_name = "../data/shuffle_buffer/gid" + std::to_string(gid) + "_lid" + std::to_string(lid) + "_tlid" + std::to_string(tlid) + "_sample";
+    return file_name;
+}
+
 void LocalTable::refresh() {
     m_tuples.clear();
     // m_num_rows = 0;
 }
 
-void LocalTable::refreshAndMerge(int num_partitions) {
+// runs, if given, receives the number of rows read from each source partition
+void LocalTable::refreshAndMerge(int num_partitions, std::vector<int>* runs) {
     int uniq_counter = globalTimingCounter++;
     // profile_record_time_start("read_write", uniq_counter, global_id, id);
     refresh();
     for (int i = 0; i < num_partitions; i++) {
-        FileInfo* ret = read_file(genFileName(global_id, i, id).c_str(), global_id, id);
-        load_file_str(ret, &m_tuples, m_num_columns);
-        freeFileInfo(ret);
+        int rows = read_file(genFileName(global_id, i, id).c_str(), global_id, id, &m_tuples);
+        if (runs)
+            runs->push_back(rows);
     }
     // profile_record_time_end("read_write", uniq_counter, global_id, id);
 }
 
-void LocalTable::shuffleMerge(int num_partitions) {
+// relayed: also read what partition 0 relayed in round 2 of a two-round shuffle
+void LocalTable::shuffleMerge(int num_partitions, bool relayed) {
     refreshAndMerge(num_partitions);
+    if (relayed)
+        read_file(genRelayFileName(global_id, 0, id).c_str(), global_id, id, &m_tuples);
+}
+
+/* Round 1 of a two-round shuffle: each partition gets at most size_bound tuples from here, and the
+ * tuples beyond that go to partition 0 in one file of overflow_bound rows, see shuffleRelay */
+void LocalTable::shuffleByKeyTwoRound(int num_partitions, const std::vector<int>& key, int seed, int size_bound, int overflow_bound) {
+    if (m_tuples.size() == 0) {
+        log_warn("m_tuples size is 0, skip shuffle");
+        return;
+    }
+
+    std::vector<int> index_list = targetsByKey(num_partitions, key, seed);
+    if (size_bound > size()) size_bound = size();
+    Tuple dummy = m_tuples[0].copy();
+    dummy.is_dummy = true;
+    TupleBlock overflow;
+    int overflowed = obliv::shuffle_two_round(m_tuples, index_list, num_partitions, size_bound, overflow_bound, overflow, dummy);
+    if (overflowed > overflow_bound) {
+        log_error("Error: %d tuples overflow in the first round of the shuffle, but the bound is %d", overflowed, overflow_bound);
+    }
+    shuffleWrite(num_partitions, size_bound);
+
+    size_t ser_length = -1;
+    int ser_row_num = -1;
+    const char* ser = serialize_tuple_block(overflow, 0, overflow.size(), &ser_length, &ser_row_num);
+    write_file(genOverflowFileName(global_id, id, 0).c_str(), ser, ser_length, ser_row_num, global_id, id, 0);
 }
 
+/* Round 2, on partition 0: route the overflow of all partitions, overflow_bound rows to each of them */
+void LocalTable::shuffleRelay(int num_partitions, int overflow_bound) {
+    if (id != 0) {
+        log_error("Error: in shuffleRelay, only local_table with local_id 0 can perform, not %i", id);
+        throw std::runtime_error("shuffleRelay on a partition other than 0");
+    }
+    int k = num_columns();
+    TupleBlock overflow(k + 1);
+    for (int i = 0; i < num_partitions; i++)
+        read_file(genOverflowFileName(global_id, i, id).c_str(), global_id, id, &overflow);
+
+    std::vector<int> targets(overflow.size());
+    for (int i = 0; i < overflow.size(); i++)
+        targets[i] = overflow[i].data[k];
+    Tuple dummy = overflow[0].copy();
+    dummy.is_dummy = true;
+    obliv::shuffle(overflow, targets, num_partitions, overflow_bound, dummy);
+    overflow.resizeColumns(k);
+
+    for (int i = 0; i < num_partitions; i++) {
+        size_t ser_length = -1;
+        int ser_row_num = -1;
+        const char* ser = serialize_tuple_block(overflow, i * overflow_bound, (i + 1) * overflow_bound, &ser_length, &ser_row_num);
+        write_file(genRelayFileName(global_id, id, i).c_str(), ser, ser_length, ser_row_num, global_id, id, i);
+    }
+}
+
+// every source partition sends its rows already sorted (see partitionByPivots), so the runs only need
+// to be merged
 void LocalTable::sortMerge(int num_partitions, const std::vector<int>& columns) {
-    refreshAndMerge(num_partitions);
-    sort(columns);
+    std::vector<int> runs;
+    refreshAndMerge(num_partitions, &runs);
+    if (m_tuples.size() == 0)
+        return;
+    Tuple dummy = m_tuples[0].copy();
+    dummy.is_dummy = true;
+    obliv::merge(m_tuples, runs, columns, dummy);
 }
 
 void LocalTable::localSort(int num_partitions, const std::vector<int>& columns) {
@@ -236,7 +345,7 @@ void LocalTable::pad_to_size(int num_partitions, int n) {
     }
     Tuple dummy = m_tuples[0].copy();
     dummy.is_dummy = true;
-    m_tuples.insert(m_tuples.end(), n - m_tuples.size(), dummy);
+    m_tuples.resize(n, dummy);
 }
 
 /* parameter columns records the col id to be joined (col B in paper)
@@ -244,7 +353,7 @@ void LocalTable::pad_to_size(int num_partitions, int n) {
 void LocalTable::foreignTableModifyColZ(int num_partitions, const std::vector<int>& columns) {
     for (int i = 1; i < m_tuples.size(); i++) {
         int cond = m_tuples[i].equal_in_cols(m_tuples[i - 1], columns);
-        obliv::cmove(m_tuples[i].data[m_num_columns - 1], i, cond);
+        obliv::cmove(m_tuples[i].data[num_columns() - 1], i, cond);
     }
 }
 
@@ -261,8 +370,8 @@ void LocalTable::finalizePkjoinResult(int num_partitions, const std::vector<int>
     int Z_col = n_cols - 1;
     m_tuples[0].is_dummy |= m_tuples[0].data[Z_col] != 0;
     for (int i = 1; i < m_tuples.size(); i++) {
-        Tuple& this_tuple = m_tuples[i - 1];
-        Tuple& next_tuple = m_tuples[i];
+        TupleRef this_tuple = m_tuples[i - 1];
+        TupleRef next_tuple = m_tuples[i];
         int equal_key = next_tuple.equal_in_cols(this_tuple, join_cols);
         int cond = (!this_tuple.is_dummy) & equal_key;
         for (int j = ori_r_col_num; j < ori_r_col_num + r_align_col_num; j++) {
@@ -273,22 +382,46 @@ void LocalTable::finalizePkjoinResult(int num_partitions, const std::vector<int>
     }
 }
 
-std::vector<Tuple> LocalTable::getTuples() {
+TupleBlock LocalTable::getTuples() {
     return m_tuples;
 }
 
 int LocalTable::getNumRows() {
     int n = 0;
-    for (auto& tuple : m_tuples)
+    for (TupleRef tuple : m_tuples)
         n += !tuple.is_dummy;
     return n;
 }
 
+// the scan of pkJoinCombine over rows sorted by (join key, Z, I): copy the aligned columns
+// [first_col, end_col) of R's rows to the following rows with the same join key
+struct PkJoinScan {
+    TupleBlock& tuples;
+    int first_col, end_col, Z_col, I_col;
+    PkJoinScan(TupleBlock& tuples, int first_col, int end_col, int Z_col, int I_col)
+        : tuples(tuples), first_col(first_col), end_col(end_col), Z_col(Z_col), I_col(I_col) {}
+
+    template <typename Kernel>
+    void operator()(const Kernel& kernel) {
+        for (int i = 1; i < tuples.size(); i++) {
+            TupleRef this_tuple = tuples[i - 1];
+            TupleRef next_tuple = tuples[i];
+            int equal_key = kernel.equal(next_tuple.data, this_tuple.data);
+            int cond = (!this_tuple.is_dummy) & equal_key & (next_tuple.data[Z_col] == 0);
+            for (int j = first_col; j < end_col; j++) {
+                obliv::cmove(next_tuple.data[j], this_tuple.data[j], cond);
+            }
+            // mark representatives from R as dummy if its previous tuple is dummy, or it has different key from the previous one
+            next_tuple.is_dummy |= (this_tuple.is_dummy | !equal_key) & next_tuple.data[Z_col] == 0 & next_tuple.data[I_col] != -1;
+        }
+    }
+};
+
 void LocalTable::pkJoinCombine(int num_partitions, int ori_r_col_num, int r_align_col_num, std::vector<int>& combine_sort_cols, std::vector<int>& join_cols, LocalTable& s_table_local) {
-    std::vector<Tuple> s_tuples = s_table_local.getTuples();
+    TupleBlock s_tuples = s_table_local.getTuples();
 
     int r_num_rows = m_tuples.size();
-    m_tuples.insert(m_tuples.end(), s_tuples.begin(), s_tuples.end());
+    m_tuples.append(s_tuples, 0, s_tuples.size());
     if (m_tuples.size() == 0)
         return;
 
@@ -301,17 +434,8 @@ void LocalTable::pkJoinCombine(int num_partitions, int ori_r_col_num, int r_alig
     // sort by (join key, Z, I)
     sort(sort_cols);
     m_tuples[0].is_dummy |= m_tuples[0].data[Z_col] == 0 & m_tuples[0].data[I_col] != -1;
-    for (int i = 1; i < m_tuples.size(); i++) {
-        Tuple& this_tuple = m_tuples[i - 1];
-        Tuple& next_tuple = m_tuples[i];
-        int equal_key = next_tuple.equal_in_cols(this_tuple, join_cols);
-        int cond = (!this_tuple.is_dummy) & equal_key & (next_tuple.data[Z_col] == 0);
-        for (int j = ori_r_col_num; j < ori_r_col_num + r_align_col_num; j++) {
-            obliv::cmove(next_tuple.data[j], this_tuple.data[j], cond);
-        }
-        // mark representatives from R as dummy if its previous tuple is dummy, or it has different key from the previous one
-        next_tuple.is_dummy |= (this_tuple.is_dummy | !equal_key) & next_tuple.data[Z_col] == 0 & next_tuple.data[I_col] != -1;
-    }
+    PkJoinScan scan(m_tuples, ori_r_col_num, ori_r_col_num + r_align_col_num, Z_col, I_col);
+    dispatchKernel(join_cols, n_cols, scan);
 
     std::vector<int> M(m_tuples.size());
     for (int i = 0; i < m_tuples.size(); i++)
@@ -322,7 +446,8 @@ void LocalTable::pkJoinCombine(int num_partitions, int ori_r_col_num, int r_alig
 
 void LocalTable::joinComputeAlignment(int m) {
     int k = num_columns();
-    for (auto& tuple : m_tuples) {
+    m_tuples.resizeColumns(k + 2);
+    for (TupleRef tuple : m_tuples) {
         uint32_t j = (uint32_t)tuple.data[k - 1];
         int q = tuple.data[k - 2] - 1;
         int deg_r = tuple.data[k - 3];
@@ -332,47 +457,31 @@ void LocalTable::joinComputeAlignment(int m) {
             log_error("j=%d, q=%d, deg_r=%d, deg_s=%d", j, q, deg_r, deg_s);
         }
         uint32_t l = q / deg_r + (q % deg_r) * deg_s + j - 1;
-        tuple.data.push_back(l % m);
-        tuple.data.push_back(l / m);
+        tuple.data[k] = l % m;
+        tuple.data[k + 1] = l / m;
     }
-    m_num_columns += 2;
 }
 
 void LocalTable::joinFinalCombine(LocalTable& r_table, int num_join_cols) {
     sort({num_columns() - 2});
+    int r_cols = r_table.num_columns();
+    int extra = num_columns() - 6 - num_join_cols;
+    r_table.m_tuples.resizeColumns(r_cols + extra);
     for (int i = 0; i < r_table.size(); i++)
-        r_table.m_tuples[i].data.insert(r_table.m_tuples[i].data.end(), m_tuples[i].data.begin() + num_join_cols, m_tuples[i].data.end() - 6);
+        memcpy(r_table.m_tuples.row(i) + r_cols, m_tuples.row(i) + num_join_cols, extra * sizeof(int));
 }
 
 void LocalTable::addCol(int num_partitions, int defaultVal, int col_index) {
-    for (auto& tuple : m_tuples) {
-        if (col_index == -1)
-            tuple.add_val(defaultVal);
-        else
-            tuple.insert_val(defaultVal, col_index);
-    }
-    m_num_columns++;
+    int pos = col_index == -1 ? num_columns() : col_index;
+    m_tuples.reshape(insertColumn(num_columns(), pos, -1), defaultVal);
 }
 
 void LocalTable::copyCol(int num_partitions, int col_index) {
-    for (auto& tuple : m_tuples) {
-        if (col_index == -1) {
-            int val = tuple.data[tuple.data.size() - 1];
-            tuple.add_val(val);
-        } else {
-            int val = tuple.data[col_index];
-            tuple.insert_val(val, col_index);
-        }
-    }
-    m_num_columns++;
+    m_tuples.reshape(copyColumn(num_columns(), col_index));
 }
 
 void LocalTable::expansion_prepare(int num_partitions, int d_index) {
-    for (Tuple& t : m_tuples) {
-        if (t.data.size() != num_columns() && !t.is_dummy)
-            log_error("Error: t.data.size() %i != num_columns() %i", t.data.size(), num_columns());
-    }
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         obliv::cmove(tuple.data[d_index], 0, tuple.is_dummy);
     }
 }
@@ -381,10 +490,10 @@ void LocalTable::add_and_calculate_col_t_p(int d_index, int m) {
     if (m_tuples.size() == 0)
         return;
 
-    int num_cols = m_num_columns;
+    int num_cols = num_columns();
+    m_tuples.resizeColumns(num_cols + 2);
 
-    for (auto& tuple : m_tuples) {
-        tuple.data.resize(num_cols + 2);
+    for (TupleRef tuple : m_tuples) {
         tuple.is_dummy |= tuple.data[d_index] == 0;
         int l_val = tuple.data[num_cols - 1] - 1;
         int t_val = l_val / m;
@@ -393,81 +502,9 @@ void LocalTable::add_and_calculate_col_t_p(int d_index, int m) {
         tuple.data[num_cols] = t_val;      // process T
         tuple.data[num_cols + 1] = p_val;  // process P
     }
-    m_num_columns += 2;
-}
-
-void LocalTable::expansion_suffix_sum(int num_partitions, int phase) {
-    if (m_tuples.size() == 0) {
-        log_error("Error: in expansion_suffix_sum phase %d, empty table %d!", phase, id);
-    }
-    // int v_col = num_columns() - 1;
-    size_t ser_length;
-    int ser_row_num;
-    if (phase == 1) {
-        for (int i = m_tuples.size() - 1; i > 0; i--) {
-            Tuple& this_tuple = m_tuples[i - 1];
-            Tuple& next_tuple = m_tuples[i];
-            int cond = this_tuple.is_dummy;
-            // int v_sum = this_tuple.data[v_col] + next_tuple.data[v_col];
-            obliv::cmove(this_tuple, next_tuple, cond);
-            // obliv::cmove(this_tuple.data[v_col], v_sum, cond);
-        }
-        std::vector<Tuple> first_tuple = {m_tuples[0]};
-        const char* ser = serialize_tuple_vector(first_tuple, m_num_columns, &ser_length, &ser_row_num);
-        write_file(genFileName(global_id, id, 0).c_str(), ser, ser_length, ser_row_num, global_id, id, 0);  //TODO: here we write to 0 node for convenience. But may lead to bug in distributed sys
-        return;
-    }
-    // following code with phase=2
-    if (id == 0) {
-        std::vector<Tuple> tups;
-
-        for (int i = 0; i < num_partitions; i++) {
-            FileInfo* f = read_file(genFileName(global_id, i, 0).c_str(), global_id, id);
-            load_file_str(f, &tups, m_num_columns);
-            freeFileInfo(f);
-        }
-
-        int num_rows = tups.size();
-
-        if (num_rows != num_partitions) {
-            log_error("Error: in expansion_suffix_sum phase 2, the num_rows %i is not equal to the num_partitions %i", num_rows, num_partitions);
-        }
-
-        for (int i = num_rows - 1; i > 0; i--) {
-            Tuple& this_tuple = tups[i - 1];
-            Tuple& next_tuple = tups[i];
-            int cond = this_tuple.is_dummy;
-            //int v_sum = this_tuple.data[v_col] + next_tuple.data[v_col];
-            obliv::cmove(this_tuple, next_tuple, cond);
-            //obliv::cmove(this_tuple.data[v_col], v_sum, cond);
-        }
-
-        for (int i = 1; i < num_rows; i++) {
-            std::vector<Tuple> output = {tups[i]};
-            const char* ser = serialize_tuple_vector(output, m_num_columns, &ser_length, &ser_row_num);
-            write_file(genFileName(global_id, 0, i - 1).c_str(), ser, ser_length, ser_row_num, global_id, id, i - 1);
-        }
-    }
-    if (id == num_partitions - 1)
-        return;
-    std::vector<Tuple> tups;
-    FileInfo* f = read_file(genFileName(global_id, 0, id).c_str(), global_id, id);
-    load_file_str(f, &tups, m_num_columns);
-    freeFileInfo(f);
-    if (tups.size() != 1) {
-        log_error("Error: in expansion_suffix_sum phase 2, the num_rows %i is not equal to 1", tups.size());
-        throw;
-    }
-
-    Tuple& next_tuple = tups[0];
-    for (auto& this_tuple : m_tuples) {
-        int cond = this_tuple.is_dummy;
-        obliv::cmove(this_tuple, next_tuple, cond);
-    }
 }
 
 void LocalTable::expansion_distribute_and_clear(int num_partitions, int m) {
-    int num_cols = m_num_columns;
     std::vector<int> non_dummies(m_tuples.size());
     for (int i = 0; i < m_tuples.size(); i++)
         non_dummies[i] = !m_tuples[i].is_dummy;
@@ -480,52 +517,54 @@ void LocalTable::expansion_distribute_and_clear(int num_partitions, int m) {
     if (m < ori_size) {
         m_tuples.resize(m);
     } else {
-        Tuple dummy = m_tuples[0];
+        Tuple dummy = m_tuples[0].copy();
         dummy.is_dummy = true;
-        m_tuples.resize(m);
-        for (int i = ori_size; i < m; i++)
-            m_tuples[i] = dummy;
+        m_tuples.resize(m, dummy);
     }
 
     obliv::distributeByCol(m_tuples, expand_col);
 
-    for (auto& tuple : m_tuples) {
-        tuple.data.resize(tuple.data.size() - 3);  //remove P,T,L
-    }
-    m_num_columns -= 3;
+    m_tuples.resizeColumns(num_columns() - 3);  //remove P,T,L
 }
 
 void LocalTable::deleteCol(int num_partitions, int col_index) {
-    if (col_index == -1)
-        col_index = m_num_columns - 1;
-
-    for (auto& tuple : m_tuples) {
-        tuple.delete_col(col_index);
-    }
-    m_num_columns--;
+    m_tuples.reshape(deleteColumn(num_columns(), col_index));
 }
 
 /* This function is only called inside LocalTable.cpp
  * it padding each layer of output and write each layer
  * to its desitination.
  */
-void LocalTable::shuffleWrite(int num_partitions, std::vector<std::vector<Tuple>>& output) {
+void LocalTable::shuffleWrite(int num_partitions, std::vector<TupleBlock>& output) {
     for (int i = 0; i < num_partitions; i++) {
         size_t ser_length = -1;
         int ser_row_num = -1;
-        const char* ser = serialize_tuple_vector(output[i], num_columns(), &ser_length, &ser_row_num);
+        const char* ser = serialize_tuple_block(output[i], 0, output[i].size(), &ser_length, &ser_row_num);
+        write_file(genFileName(global_id, id, i).c_str(), ser, ser_length, ser_row_num, global_id, id, i);
+    }
+}
+
+// the padded table holds the output of partition i at rows [i * size_bound, (i + 1) * size_bound)
+void LocalTable::shuffleWrite(int num_partitions, int size_bound) {
+    if (size_bound * num_partitions != m_tuples.size()) {
+        log_error("Padding error! size_bound=%d,num_partitions=%d,tuple_size=%d", size_bound, num_partitions, m_tuples.size());
+    }
+    for (int i = 0; i < num_partitions; i++) {
+        size_t ser_length = -1;
+        int ser_row_num = -1;
+        const char* ser = serialize_tuple_block(m_tuples, i * size_bound, (i + 1) * size_bound, &ser_length, &ser_row_num);
         write_file(genFileName(global_id, id, i).c_str(), ser, ser_length, ser_row_num, global_id, id, i);
     }
 }
 
 void LocalTable::union_table(LocalTable& other_table) {
-    std::vector<Tuple> other_tuples = other_table.getTuples();
-    m_tuples.insert(m_tuples.end(), other_tuples.begin(), other_tuples.end());
+    TupleBlock other_tuples = other_table.getTuples();
+    m_tuples.append(other_tuples, 0, other_tuples.size());
 }
 
-void print_tuples(std::vector<Tuple>& m_tuples, int limit_size, bool show_dummy = false) {
+void print_tuples(TupleBlock& m_tuples, int limit_size, bool show_dummy) {
     int counter = 0;
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         if (counter > limit_size) {
             printf("%s...\n", " ");
             break;
@@ -536,8 +575,8 @@ void print_tuples(std::vector<Tuple>& m_tuples, int limit_size, bool show_dummy
                 counter++;
             }
         } else {
-            for (int v : tuple.data)
-                printf(" %i", v);
+            for (int j = 0; j < tuple.size(); j++)
+                printf(" %i", tuple.data[j]);
 
             printf(";%s\n", " ");
             counter++;
@@ -545,45 +584,45 @@ void print_tuples(std::vector<Tuple>& m_tuples, int limit_size, bool show_dummy
     }
 }
 
-void aggregate(std::vector<Tuple>& tuples, const std::vector<int>& join_cols) {
+void aggregate(TupleBlock& tuples, const std::vector<int>& join_cols) {
     int v = 1;
     int agg_col = join_cols.size();
     int num_out_cols = agg_col + 1;
-    tuples[0].data.resize(num_out_cols);
+    tuples.resizeColumns(num_out_cols);
     tuples[0].data[agg_col] = 1;
     for (int i = 0; i < tuples.size() - 1; i++) {
         int can_agg = tuples[i].equal_in_cols(tuples[i + 1], join_cols) & (!tuples[i + 1].is_dummy);
         obliv::cmove(v, v + 1, can_agg);
         obliv::cmove(v, 1, !can_agg);
-        tuples[i + 1].data.resize(num_out_cols);
         tuples[i + 1].data[agg_col] = v;
         tuples[i].is_dummy |= can_agg;
     }
 }
 
-int pkJoinAndExpand(std::vector<Tuple>& R, std::vector<Tuple>& S, std::vector<int>& cols, int output_bound) {
+int pkJoinAndExpand(TupleBlock& R, TupleBlock& S, std::vector<int>& cols, int output_bound) {
     int orig_size = R.size();
     int agg_col_in_S = cols.size();
-    int agg_col_in_R = R[0].size();
+    int agg_col_in_R = R.num_columns();
     int mark_col_in_R = agg_col_in_R + 1;
     int num_cols_R = mark_col_in_R + 1;
-    for (auto& tuple : R) {
-        tuple.data.resize(num_cols_R);
+    R.resizeColumns(num_cols_R);
+    for (TupleRef tuple : R)
         tuple.data[mark_col_in_R] = 1;  // from R gets 1
-    }
-    for (auto& tuple : S) {
-        tuple.data.resize(num_cols_R);
-        tuple.data[agg_col_in_R] = tuple.data[agg_col_in_S];
-        tuple.data[mark_col_in_R] = 0;  // from S gets 0
-    }
+    // S takes R's layout, with its aggregate moved to agg_col_in_R; from S gets 0 in the mark column
+    std::vector<int> s_columns(num_cols_R);
+    for (int j = 0; j < num_cols_R; j++)
+        s_columns[j] = j < S.num_columns() ? j : -1;
+    s_columns[agg_col_in_R] = agg_col_in_S;
+    s_columns[mark_col_in_R] = -1;
+    S.reshape(s_columns, 0);
     auto sort_col = cols;
     sort_col.push_back(mark_col_in_R);
-    R.insert(R.end(), S.begin(), S.end());
+    R.append(S, 0, S.size());
     obliv::sort(R, sort_col);
     std::vector<int> M(R.size(), 0);
     for (int i = 0; i < R.size() - 1; i++) {
-        auto& this_tuple = R[i];
-        auto& next_tuple = R[i + 1];
+        TupleRef this_tuple = R[i];
+        TupleRef next_tuple = R[i + 1];
         int eq = this_tuple.equal_in_cols(next_tuple, cols);
         int can_copy = (!this_tuple.is_dummy) & eq;
         obliv::cmove(next_tuple.data[agg_col_in_R], this_tuple.data[agg_col_in_R], eq);
@@ -597,12 +636,10 @@ int pkJoinAndExpand(std::vector<Tuple>& R, std::vector<Tuple>& S, std::vector<in
     obliv::compact(R, M);
     R.resize(orig_size);
     int ori_size = R.size();
-    for (auto& tuple : R) {
-        tuple.data.pop_back();
-    }
+    R.resizeColumns(num_cols_R - 1);
     int m = output_bound;
     if (m == 0) {
-        for (auto& tuple : R) {
+        for (TupleRef tuple : R) {
             obliv::cmove(m, m + tuple.data[agg_col_in_R], !tuple.is_dummy);
         }
     }
@@ -611,7 +648,7 @@ int pkJoinAndExpand(std::vector<Tuple>& R, std::vector<Tuple>& S, std::vector<in
     else {
         Tuple dummy = R[0].copy();
         dummy.is_dummy = true;
-        R.insert(R.end(), m - ori_size, dummy);
+        R.resize(m, dummy);
     }
     obliv::distributeByCol(R, agg_col_in_R);
     return m;
@@ -623,17 +660,18 @@ int LocalTable::localJoin(LocalTable& other_table, int num_cols, int output_boun
     std::iota(join_cols.begin(), join_cols.end(), 0);
     auto& R = other_table.m_tuples;
     auto& S = m_tuples;
-    int r_total_cols = R[0].size();
-    int s_total_cols = S[0].size();
+    int r_total_cols = R.num_columns();
+    int s_total_cols = S.num_columns();
     int new_num_columns = r_total_cols + s_total_cols - num_cols;
     int m = 0;
     if (output_bound == -1)  // pk join
     {
         m = -1;
         int orig_size = R.size();
-        R.insert(R.end(), S.begin(), S.end());
-        for (auto& tuple : R)
-            tuple.data.resize(new_num_columns);
+        TupleBlock S_wide = S;
+        S_wide.resizeColumns(new_num_columns);
+        R.resizeColumns(new_num_columns);
+        R.append(S_wide, 0, S_wide.size());
         obliv::sort(R, join_cols);
         std::vector<int> M(R.size(), 0);
         obliv::compact(R, M);
@@ -650,14 +688,16 @@ int LocalTable::localJoin(LocalTable& other_table, int num_cols, int output_boun
         log_info("m1=%d, m2=%d", m1, m2);
         m = m1;
         obliv::sort(R, {0});  // simluate the alignment
+        R.resizeColumns(new_num_columns);
+        int width = std::min(R.num_columns(), S.num_columns());
         for (int i = 0; i < m; i++) {
-            R[i].data.resize(new_num_columns);
-            for (int j = num_cols; j < s_total_cols; j++)
-                R[j + r_total_cols - num_cols] = S[j];
+            for (int j = num_cols; j < s_total_cols; j++) {
+                // the rows differ in width, so the dummy flag after the values is carried over on its own
+                memcpy(R.row(j + r_total_cols - num_cols), S.row(j), width * sizeof(int));
+                R[j + r_total_cols - num_cols].is_dummy = S[j].is_dummy;
+            }
         }
     }
-    m_num_columns = m_tuples[0].size();
-    other_table.m_num_columns = other_table.m_tuples[0].size();
     return m;
 }
 
@@ -668,12 +708,11 @@ long long LocalTable::SODA_step1(std::vector<int>& columns, int num_partitions,
 
     sort(columns);
 
-    Tuple pre_tup = m_tuples[0];
     long long ret = 0;
 
     for (int i = 1; i < m_tuples.size(); i++) {
-        Tuple& pre_tup = m_tuples[i - 1];
-        Tuple& cur_tup = m_tuples[i];
+        TupleRef pre_tup = m_tuples[i - 1];
+        TupleRef cur_tup = m_tuples[i];
         int cond = (!cur_tup.is_dummy) & cur_tup.equal_in_cols(pre_tup, columns);
         int v = pre_tup.data[aggCol] * cur_tup.data[aggCol];
         obliv::cmove(v, 0, !cond);
@@ -687,7 +726,7 @@ void LocalTable::SODA_step2(int num_partitions, int p) {
     int cur_bin_size = 0;
     int cur_bin_id = 0;
     int deg_col = num_columns() - 1;
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         int this_size = tuple.data[deg_col];
         cur_bin_size += this_size;
         int cond = cur_bin_size > bin_size;
@@ -700,12 +739,12 @@ void LocalTable::SODA_step2(int num_partitions, int p) {
 void LocalTable::SODA_step3(int num_partitions, int p) {
     int n = m_tuples.size();
     if (n < p) p = n;
-    std::vector<Tuple> slice(m_tuples.begin(), m_tuples.begin() + p);
-    std::vector<Tuple> weights;
+    TupleBlock slice(num_columns());
+    slice.append(m_tuples, 0, p);
+    TupleBlock weights(1);
     Tuple weight;
     weight.data.push_back(1);
-    for (int i = 0; i < p; i++)
-        weights.emplace_back(weight);
+    weights.resize(p, weight);
     int deg_col = num_columns() - 1;
     for (int i = 0; i < n / p + 1; i++) {
         obliv::sort(slice, {deg_col});
@@ -735,7 +774,7 @@ void LocalTable::assignColE(int num_partitions, int col) {
 int LocalTable::max(int column) {
     int ret = INT_MIN;
 
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         int cond = (!tuple.is_dummy) & (tuple.data[column] > ret);
         obliv::cmove(ret, tuple.data[column], cond);
     }
@@ -744,13 +783,12 @@ int LocalTable::max(int column) {
 }
 
 void LocalTable::shuffle_non_obliv(int num_partitions, std::vector<int>& index_list) {
-    std::vector<std::vector<Tuple>> output;
-    output.resize(num_partitions);
+    std::vector<TupleBlock> output(num_partitions, TupleBlock(num_columns()));
     if (index_list.size() != size()) {
         log_error("ERROR: index_list size %i not equal to local table size %i", index_list.size(), size());
     }
     int i = -1;
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         i++;
         int index = index_list[i];
         output[index].push_back(tuple);
@@ -761,7 +799,7 @@ void LocalTable::shuffle_non_obliv(int num_partitions, std::vector<int>& index_l
 void LocalTable::shuffle(int num_partitions, std::vector<int>& index_list, int size_bound) {
     if (index_list.size() != size()) {
         log_error("ERROR: index_list size %i not equal to local table size %i", index_list.size(), size());
-        throw;
+        throw std::runtime_error("index_list does not match the table size");
     }
     if (size_bound > size()) size_bound = size();
     if (m_tuples.size() == 0) {
@@ -769,57 +807,207 @@ void LocalTable::shuffle(int num_partitions, std::vector<int>& index_list, int s
         return;
     }
 
-    std::vector<std::vector<Tuple>> output;
-    output.resize(num_partitions);
-    Tuple dummy = m_tuples[0];
+    Tuple dummy = m_tuples[0].copy();
     dummy.is_dummy = true;
 
     obliv::shuffle(m_tuples, index_list, num_partitions, size_bound, dummy);
 
-    if (size_bound * num_partitions != m_tuples.size()) {
-        log_error("Padding error! size_bound=%d,num_partitions=%d,tuple_size=%d", size_bound, num_partitions, m_tuples.size());
-    }
-
-    auto it = m_tuples.begin();
-    for (int i = 0; i < num_partitions; i++) {
-        output[i].insert(output[i].end(), it, it + size_bound);
-        it += size_bound;
-    }
-
-    shuffleWrite(num_partitions, output);
+    shuffleWrite(num_partitions, size_bound);
 }
 
-const char* serialize_tuple_vector(std::vector<Tuple>& tuple_list, int col_num, size_t* ser_length, int* ser_row_num) {
-    size_t tup_length = Tuple::rowLength(col_num);
-    *ser_row_num = tuple_list.size();
-    *ser_length = tuple_list.size() * tup_length;
-    char* buffer = new char[*ser_length];
-    char* pointer = buffer;
+// rows are stored in their serialized format, so this only points into the block; the result is valid
+// until the block is modified
+const char* serialize_tuple_block(TupleBlock& rows, int begin, int end, size_t* ser_length, int* ser_row_num) {
+    *ser_row_num = end - begin;
+    *ser_length = rows.byteLength(begin, end);
+    return rows.bytes(begin);
+}
 
-    for (auto& tuple : tuple_list) {
-        tuple.serialize(pointer);
-        pointer += tup_length;
-    }
+void LocalTable::project(const std::vector<int>& columns) {
+    m_tuples.reshape(columns);
+}
 
-    return buffer;
-    // return ss.str();
+namespace {
+// the steps of a plan in order; reading past the end clears ok
+struct PlanReader {
+    const int* plan;
+    size_t size;
+    size_t pos;
+    bool ok;
+
+    PlanReader(const int* plan, size_t size) : plan(plan), size(size), pos(0), ok(true) {}
+    bool done() const { return !ok || pos >= size; }
+    int next() {
+        if (pos >= size) {
+            ok = false;
+            return 0;
+        }
+        return plan[pos++];
+    }
+    // a list is its length followed by its elements
+    std::vector<int> nextList() {
+        int n = next();
+        if (n < 0 || (size_t)n > size - pos) {
+            ok = false;
+            return std::vector<int>();
+        }
+        std::vector<int> list(plan + pos, plan + pos + n);
+        pos += n;
+        return list;
+    }
+};
+
+// the column edits of a plan since the rows were last rebuilt: column j is old column columns[j], or
+// fills[j] if that is negative. They are applied in one pass instead of one pass per edit.
+struct ColumnMap {
+    std::vector<int> columns;
+    std::vector<int> fills;
+    bool pending;
+
+    explicit ColumnMap(int num_columns) { reset(num_columns); }
+    int width() const { return columns.size(); }
+    void reset(int num_columns) {
+        columns.resize(num_columns);
+        for (int j = 0; j < num_columns; j++)
+            columns[j] = j;
+        fills.assign(num_columns, 0);
+        pending = false;
+    }
+    // follow with the edit map (a reshape mapping), whose new columns are fill
+    void apply(const std::vector<int>& map, int fill = 0) {
+        std::vector<int> new_columns(map.size()), new_fills(map.size());
+        for (size_t j = 0; j < map.size(); j++) {
+            new_columns[j] = map[j] < 0 ? -1 : columns[map[j]];
+            new_fills[j] = map[j] < 0 ? fill : fills[map[j]];
+        }
+        columns.swap(new_columns);
+        fills.swap(new_fills);
+        pending = true;
+    }
+    void flush(TupleBlock& tuples) {
+        if (!pending)
+            return;
+        tuples.reshape(columns, fills);
+        reset(width());
+    }
+};
+
+// whether col is one of num_columns columns; a plan from the host may name any other
+bool validColumn(int op, int col, int num_columns) {
+    if (col >= 0 && col < num_columns)
+        return true;
+    log_error("Plan step %d names column %d of %d", op, col, num_columns);
+    return false;
 }
+}  // namespace
+
+int LocalTable::runPlan(int num_partitions, const int* plan, size_t plan_size) {
+    PlanReader in(plan, plan_size);
+    ColumnMap map(num_columns());
+    while (!in.done()) {
+        int op = in.next();
+        // column edits are checked against the width they apply to, then only recorded
+        if (op == PLAN_ADD_COL) {
+            int defaultVal = in.next();
+            int col_index = in.next();
+            if (col_index == -1)
+                col_index = map.width();
+            if (!in.ok)
+                break;
+            // a column may also be added after the last one
+            if (!validColumn(op, col_index, map.width() + 1))
+                return -1;
+            map.apply(insertColumn(map.width(), col_index, -1), defaultVal);
+            continue;
+        } else if (op == PLAN_COPY_COL || op == PLAN_DELETE_COL) {
+            int col_index = in.next();
+            if (!in.ok)
+                break;
+            if (!validColumn(op, col_index == -1 ? map.width() - 1 : col_index, map.width()))
+                return -1;
+            map.apply(op == PLAN_COPY_COL ? copyColumn(map.width(), col_index) : deleteColumn(map.width(), col_index));
+            continue;
+        } else if (op == PLAN_PROJECT || op == PLAN_MV_JOIN_COLS_AHEAD) {
+            std::vector<int> columns = in.nextList();
+            if (!in.ok)
+                break;
+            for (int col : columns)
+                if (!validColumn(op, col, map.width()))
+                    return -1;
+            map.apply(op == PLAN_PROJECT ? columns : joinColsAhead(map.width(), columns));
+            continue;
+        }
 
-void LocalTable::project(const std::vector<int>& columns) {
-    int k = columns.size();
-    for (auto& tuple : m_tuples) {
-        std::vector<int> new_tuple_data(k);
-        std::transform(columns.begin(), columns.end(), new_tuple_data.begin(), [tuple](size_t pos) { return tuple.data[pos]; });
-        tuple.data = new_tuple_data;
+        // any other step reads the rows, so the edits so far are applied first
+        std::vector<int> columns;
+        int a = 0, b = 0;
+        switch (op) {
+            case PLAN_LOCAL_SORT:
+            case PLAN_FOREIGN_TABLE_MODIFY_COL_Z:
+            case PLAN_REMOVE_DUP_AFTER_PREFIX:
+                columns = in.nextList();
+                break;
+            case PLAN_FINALIZE_PKJOIN_RESULT:
+                columns = in.nextList();
+                a = in.next();
+                b = in.next();
+                break;
+            case PLAN_ADD_AND_CALCULATE_COL_T_P:
+                a = in.next();
+                b = in.next();
+                break;
+            case PLAN_EXPANSION_PREPARE:
+            case PLAN_EXPANSION_DISTRIBUTE_AND_CLEAR:
+            case PLAN_JOIN_COMPUTE_ALIGNMENT:
+                a = in.next();
+                break;
+            default:
+                log_error("Unknown plan step %d", op);
+                return -1;
+        }
+        if (!in.ok)
+            break;
+        map.flush(m_tuples);
+        switch (op) {
+            case PLAN_LOCAL_SORT:
+                localSort(num_partitions, columns);
+                break;
+            case PLAN_FOREIGN_TABLE_MODIFY_COL_Z:
+                foreignTableModifyColZ(num_partitions, columns);
+                break;
+            case PLAN_REMOVE_DUP_AFTER_PREFIX:
+                remove_dup_after_prefix(num_partitions, columns);
+                break;
+            case PLAN_FINALIZE_PKJOIN_RESULT:
+                finalizePkjoinResult(num_partitions, columns, a, b);
+                break;
+            case PLAN_ADD_AND_CALCULATE_COL_T_P:
+                add_and_calculate_col_t_p(a, b);
+                break;
+            case PLAN_EXPANSION_PREPARE:
+                expansion_prepare(num_partitions, a);
+                break;
+            case PLAN_EXPANSION_DISTRIBUTE_AND_CLEAR:
+                expansion_distribute_and_clear(num_partitions, a);
+                break;
+            case PLAN_JOIN_COMPUTE_ALIGNMENT:
+                joinComputeAlignment(a);
+                break;
+        }
     }
-    m_num_columns = k;
+    if (!in.ok) {
+        log_error("Truncated plan");
+        return -1;
+    }
+    map.flush(m_tuples);
+    return 0;
 }
 
 bool LocalTable::isKeyUnique(const std::vector<int>& key) {
     std::unordered_set<long long int> hash_list;
     std::random_device rd;
     auto seed = rd();
-    for (auto& tuple : m_tuples) {
+    for (TupleRef tuple : m_tuples) {
         if (tuple.is_dummy)
             continue;
         long long int hash_value = tuple.hash(key, seed);
@@ -844,68 +1032,170 @@ bool LocalTable::isKeyUnique(const std::vector<int>& key) {
 // }
 
 void LocalTable::partitionByPivots(std::vector<int>& columns, int num_partitions, int size_bound) {
-    std::vector<Tuple> pivots;
-    FileInfo* f = read_file(genPivotsFileName(global_id, 0, id).c_str(), global_id, id);
-    load_file_str(f, &pivots, m_num_columns);
-    freeFileInfo(f);
-
-    std::vector<std::vector<Tuple>> output;
-    output.resize(num_partitions);
+    TupleBlock pivots(num_columns());
+    read_file(genPivotsFileName(global_id, 0, id).c_str(), global_id, id, &pivots);
 
     if (m_tuples.size() == 0) {
         log_warn("Partition empty table.");
         return;
     }
-    Tuple dummy = m_tuples[0];
+    Tuple dummy = m_tuples[0].copy();
     dummy.is_dummy = true;
-    obliv::partition(m_tuples, pivots, columns, size_bound, dummy);
-    if (size_bound * num_partitions != m_tuples.size()) {
-        log_error("Padding error! size_bound=%d,num_partitions=%d,tuple_size=%d", size_bound, num_partitions, m_tuples.size());
-    }
-
-    auto it = m_tuples.begin();
-    for (int i = 0; i < num_partitions; i++) {
-        output[i].insert(output[i].end(), it, it + size_bound);
-        it += size_bound;
-    }
+    // sort first so that each chunk arrives as a sorted run and sortMerge can merge instead of sort
+    sort(columns);
+    obliv::partition(m_tuples, pivots, columns, size_bound, dummy, true);
 
-    shuffleWrite(num_partitions, output);
+    shuffleWrite(num_partitions, size_bound);
 }
 
 void LocalTable::sort(const std::vector<int>& columns) {
-    obliv::sort(m_tuples, columns);
+    // the size of a partition is public, so choosing the path on it leaks nothing
+    if (sort_budget > 0 && m_tuples.size() > 0 && m_tuples.byteLength(0, m_tuples.size()) > sort_budget)
+        externalSort(columns);
+    else
+        obliv::sort(m_tuples, columns);
+}
+
+/*
+    Bitonic network over sealed runs of run_rows sorted rows each, where a comparator is a merge-split:
+    both runs are unsealed, merged, and the lower half goes to one run and the upper half to the other
+    (Knuth 5.3.4, ex. 38). Which runs are touched depends only on the number of runs, and the enclave
+    holds two runs at a time.
+*/
+struct ExternalMerge {
+    std::vector<SealedRun>& runs;
+    const std::vector<int>& columns;
+    const Tuple& dummy;
+    int run_rows;
+    TupleBlock pair;
+    ExternalMerge(std::vector<SealedRun>& runs, const std::vector<int>& columns, const Tuple& dummy, int run_rows)
+        : runs(runs), columns(columns), dummy(dummy), run_rows(run_rows), pair(dummy.size()) {}
+
+    // the lower half of runs i and j goes to i if ascend, else to j
+    void mergeSplit(int i, int j, bool ascend) {
+        pair.clear();
+        unseal_rows(runs[i], &pair);
+        unseal_rows(runs[j], &pair);
+        obliv::merge(pair, {run_rows, run_rows}, columns, dummy);
+        runs[ascend ? i : j] = seal_rows(pair, 0, run_rows);
+        runs[ascend ? j : i] = seal_rows(pair, run_rows, 2 * run_rows);
+    }
+
+    // bitonic merge of runs [lo, lo + n) for any n
+    void merge(int lo, int n, bool ascend) {
+        if (n <= 1)
+            return;
+        int m = 1;
+        while (m * 2 < n)
+            m *= 2;
+        for (int i = lo; i < lo + n - m; i++)
+            mergeSplit(i, i + m, ascend);
+        merge(lo, m, ascend);
+        merge(lo + m, n - m, ascend);
+    }
+
+    void sort(int lo, int n, bool ascend) {
+        if (n <= 1)
+            return;
+        int m = n / 2;
+        sort(lo, m, !ascend);
+        sort(lo + m, n - m, ascend);
+        merge(lo, n, ascend);
+    }
+};
+
+void LocalTable::externalSort(const std::vector<int>& columns) {
+    // a merge-split holds two runs plus the padded copy obliv::merge makes of them; runs are a power of
+    // two long so that copy needs no padding
+    size_t row_length = Tuple::rowLength(num_columns());
+    int run_rows = 1;
+    while ((size_t)run_rows * 2 * 4 * row_length <= sort_budget)
+        run_rows *= 2;
+    int n = m_tuples.size();
+    int num_runs = (n + run_rows - 1) / run_rows;
+    Tuple dummy = m_tuples[0].copy();
+    dummy.is_dummy = true;
+
+    // the partition stays resident until its runs are sealed, so only the last run is padded rather
+    // than the whole arena
+    std::vector<SealedRun> runs(num_runs);
+    TupleBlock run(num_columns());
+    for (int r = 0; r < num_runs; r++) {
+        run.clear();
+        run.append(m_tuples, r * run_rows, std::min(n, (r + 1) * run_rows));
+        run.resize(run_rows, dummy);
+        obliv::sort(run, columns);
+        runs[r] = seal_rows(run, 0, run_rows);
+    }
+    // give the arena back while the runs are merged, so the rows leave the EPC
+    TupleBlock(num_columns()).swap(m_tuples);
+    run = TupleBlock(num_columns());
+
+    ExternalMerge(runs, columns, dummy, run_rows).sort(0, num_runs, true);
+
+    // padding rows are dummies, which sort after every real row, so they all sit in the last runs
+    m_tuples.reserve(num_runs * run_rows);
+    for (auto& r : runs)
+        unseal_rows(r, &m_tuples);
+    m_tuples.resize(n);
+}
+
+// sample_size rows drawn uniformly at random, with replacement, for getPivots; the rows drawn do not
+// depend on the data
+void LocalTable::samplePivots(int num_partitions, int sample_size) {
+    if (sample_size > size())
+        sample_size = size();
+    TupleBlock sample(num_columns());
+    if (sample_size > 0) {
+        std::random_device rd;
+        std::mt19937 rng(rd());
+        std::uniform_int_distribution<> distr(0, size() - 1);
+        sample.reserve(sample_size);
+        for (int i = 0; i < sample_size; i++)
+            sample.push_back(m_tuples[distr(rng)]);
+    }
+    size_t ser_length = -1;
+    int ser_row_num = -1;
+    const char* ser = serialize_tuple_block(sample, 0, sample.size(), &ser_length, &ser_row_num);
+    write_file(genSampleFileName(global_id, id, 0).c_str(), ser, ser_length, ser_row_num, global_id, id, 0);
 }
 
 void LocalTable::getPivots(int num_partitions, const std::vector<int>& columns) {
     if (id != 0) {
         log_error("Error: in getPivots, only local_table with local_id 0 can perform, not %i", id);
-        throw;
+        throw std::runtime_error("getPivots on a partition other than 0");
+    }
+
+    TupleBlock sample(num_columns());
+    for (int i = 0; i < num_partitions; i++)
+        read_file(genSampleFileName(global_id, i, id).c_str(), global_id, id, &sample);
+    if (sample.size() == 0) {
+        log_error("Error: in getPivots, the sample of table %d is empty", global_id);
+        throw std::runtime_error("empty pivot sample");
     }
 
     // profile_record_time_start("sss", 1000, global_id, id);
-    sort(columns);
+    obliv::sort(sample, columns);
     // profile_record_time_end("sss", 1000, global_id, id);
 
-    // std::vector<int> index;
-    // index.clear();
-    auto index = computeQuatileIndex(size(), num_partitions);
+    auto index = computeQuatileIndex(sample.size(), num_partitions);
 
-    std::vector<Tuple> pivots;
+    TupleBlock pivots(num_columns());
     for (int i = 1; i < num_partitions; i++) {
-        pivots.push_back(m_tuples[index[i]]);
+        pivots.push_back(sample[index[i]]);
     }
 
     for (int i = 0; i < num_partitions; i++) {
 		size_t ser_length = -1;
 		int ser_row_num = -1;
-		const char* ser = serialize_tuple_vector(pivots, m_num_columns, &ser_length, &ser_row_num);
+		const char* ser = serialize_tuple_block(pivots, 0, pivots.size(), &ser_length, &ser_row_num);
 	    write_file(genPivotsFileName(global_id, id, i).c_str(), ser, ser_length, ser_row_num, global_id, id, i);
     }
 }
 
 long long LocalTable::sum(int column) {
     long long ret = 0;
-    for (auto& tuple : m_tuples){
+    for (TupleRef tuple : m_tuples){
         int v = tuple.data[column];
         obliv::cmove(v, 0, tuple.is_dummy);
         ret += v;
@@ -913,7 +1203,7 @@ long long LocalTable::sum(int column) {
     return ret;
 }
 
-Tuple aggCore(std::vector<Tuple>* tuples, AssociateOperator* op, bool doPrefix, bool reverse) {
+Tuple aggCore(TupleBlock* tuples, AssociateOperator* op, bool doPrefix, bool reverse) {
     int n = tuples->size();
     int start = 0, end = n - 1, step = 1;
     if (reverse) {
@@ -921,12 +1211,13 @@ Tuple aggCore(std::vector<Tuple>* tuples, AssociateOperator* op, bool doPrefix,
         end = 0;
         step = -1;
     }
-    Tuple last_tuple = tuples->at(start);
-    last_tuple.is_dummy = true;
+    Tuple last_tuple = (*tuples)[start].copy();
     for (int i = start; i != end; i += step) {
-        bool applied = op->apply(tuples->at(i), tuples->at(i + step));
-        tuples->at(i).is_dummy |= !doPrefix && applied && !tuples->at(i + step).is_dummy;
-        obliv::cmove(last_tuple, tuples->at(i + step), !tuples->at(i + step).is_dummy);
+        TupleRef cur = (*tuples)[i];
+        TupleRef next = (*tuples)[i + step];
+        bool applied = op->apply(cur, next);
+        cur.is_dummy |= !doPrefix && applied && !next.is_dummy;
+        obliv::cmove(last_tuple, next, !next.is_dummy);
     }
     return last_tuple;
 }
@@ -938,71 +1229,71 @@ void LocalTable::groupByAggregateBase(int num_partitions, AssociateOperator* op,
     if (phase == -1) {
         /* group by aggregate */
         aggCore(&m_tuples, op, doPrefix, reverse);
+        return;
     }
-    if (phase == 1) {
-        Tuple last_tuple = aggCore(&m_tuples, op, doPrefix, reverse);
-        std::vector<Tuple> output;
-        output.push_back(last_tuple);
-        size_t ser_length = -1;
-        int ser_row_num = -1;
-        const char* ser = serialize_tuple_vector(output, m_num_columns, &ser_length, &ser_row_num);
-        write_file(genFileName(global_id, id, 0).c_str(), ser, ser_length, ser_row_num, global_id, id, 0);
-    } else if (phase == 2) {
-        if (id != 0) {
-            log_error("Error: in groupByAggregateBase phase 2, only local_table with local_id 0 can perform, not %i", id);
-        }
-
-        std::vector<Tuple> tups;
-
-        for (int i = 0; i < num_partitions; i++) {
-            FileInfo* f = read_file(genFileName(global_id, i, 0).c_str(), global_id, id);
-            load_file_str(f, &tups, m_num_columns);
-            freeFileInfo(f);
-        }
+    prefixScan(num_partitions, op, phase, reverse);
+}
 
-        int num_rows = tups.size();
+// ceil(log2(num_partitions)), the rounds after round 0 of prefixScan
+static int scanRounds(int num_partitions) {
+    int rounds = 0;
+    while ((1 << rounds) < num_partitions)
+        rounds++;
+    return rounds;
+}
 
-        if (num_rows != num_partitions) {
-            log_error("Error: in groupByAggregateBase phase 2, the num_rows %i is not equal to the num_partitions %i", num_rows, num_partitions);
+/* Round 0 aggregates the partition and sends its last tuple to the next partition. In round k the
+ * partition 2^(k-1) places before this one has sent the aggregate of the 2^(k-1) partitions up to
+ * itself; it is added to the aggregate of this partition's predecessors and to the running one, which
+ * then covers 2^k partitions and goes on to the partition 2^k places on. After the last round the
+ * predecessors' aggregate is added to every row. With reverse the partitions are taken from the last
+ * to the first. */
+void LocalTable::prefixScan(int num_partitions, AssociateOperator* op, int round, bool reverse) {
+    int rounds = scanRounds(num_partitions);
+    int rank = reverse ? num_partitions - 1 - id : id;
+    if (round == 0) {
+        m_scan_total = TupleBlock(num_columns());
+        m_scan_total.push_back(aggCore(&m_tuples, op, true, reverse));
+        m_scan_before = TupleBlock(num_columns());
+    } else {
+        int distance = 1 << (round - 1);
+        if (rank >= distance) {
+            int from = reverse ? id + distance : id - distance;
+            TupleBlock tups(num_columns());
+            read_file(genFileName(global_id, from, id).c_str(), global_id, id, &tups);
+            if (tups.size() != 1) {
+                log_error("Error: in prefixScan round %d, the num_rows %i is not equal to 1", round, tups.size());
+            }
+            if (m_scan_before.size() == 0)
+                m_scan_before.push_back(tups[0]);
+            else
+                op->apply(tups[0], m_scan_before[0]);
+            op->apply(tups[0], m_scan_total[0]);
         }
+    }
 
-        aggCore(&tups, op, doPrefix, reverse);
+    int distance = 1 << round;
+    if (round < rounds && rank + distance < num_partitions) {
+        int to = reverse ? id - distance : id + distance;
         size_t ser_length = -1;
         int ser_row_num = -1;
-        if (reverse) {
-            for (int i = num_rows - 1; i > 0; i--) {
-                std::vector<Tuple> output;
-                output.push_back(tups[i]);
-                const char* ser = serialize_tuple_vector(output, m_num_columns, &ser_length, &ser_row_num);
-                write_file(genFileName(global_id, 0, i - 1).c_str(), ser, ser_length, ser_row_num, global_id, id, i - 1);
-            }
-        } else {
-            for (int i = 0; i < num_rows - 1; i++) {
-                std::vector<Tuple> output;
-                output.push_back(tups[i]);
-                const char* ser = serialize_tuple_vector(output, m_num_columns, &ser_length, &ser_row_num);
-                write_file(genFileName(global_id, 0, i + 1).c_str(), ser, ser_length, ser_row_num, global_id, id, i + 1);
-            }
-        }
+        const char* ser = serialize_tuple_block(m_scan_total, 0, 1, &ser_length, &ser_row_num);
+        write_file(genFileName(global_id, id, to).c_str(), ser, ser_length, ser_row_num, global_id, id, to);
     }
-}
-
-void LocalTable::_addValueByKey(AssociateOperator* op) {
-    std::vector<Tuple> tups;
-    FileInfo* f = read_file(genFileName(global_id, 0, id).c_str(), global_id, id);
-    load_file_str(f, &tups, m_num_columns);
-    freeFileInfo(f);
-    if (tups.size() != 1) {
-        log_error("Error: in _addValueByKey, the num_rows %i is not equal to 1", tups.size());
+    if (round == rounds) {
+        if (m_scan_before.size() == 1) {
+            for (TupleRef t : m_tuples)
+                op->apply(m_scan_before[0], t);
+        }
+        m_scan_total.clear();
+        m_scan_before.clear();
     }
-    for (auto& t : m_tuples)
-        op->apply(tups[0], t);
 }
 
 void LocalTable::remove_dup_after_prefix(int num_partitions, std::vector<int>& columns) {
     for (int i = 1; i < m_tuples.size(); i++) {
-        Tuple& this_tuple = m_tuples[i - 1];
-        Tuple& next_tuple = m_tuples[i];
+        TupleRef this_tuple = m_tuples[i - 1];
+        TupleRef next_tuple = m_tuples[i];
         int cond = (!next_tuple.is_dummy) & this_tuple.equal_in_cols(next_tuple, columns);
         this_tuple.is_dummy |= cond;
     }
@@ -1018,34 +1309,22 @@ void LocalTable::soda_shuffleByKey(int num_partitions, const std::vector<int>& k
     std::mt19937 rng(rd());
     std::uniform_int_distribution<> distr(0, num_partitions - 1);
 
-    std::vector<int> index_list;
-    for (auto& tuple : m_tuples) {
-        int index = (unsigned long long int)tuple.hash(key, seed) % num_partitions;
-        obliv::cmove(index, distr(rng), tuple.is_dummy);
-        index_list.push_back(index);
-    }
-    std::vector<std::vector<Tuple>> output;
-    output.resize(num_partitions);
-    Tuple dummy = m_tuples[0];
+    std::vector<int> index_list(m_tuples.size());
+    HashPartition hasher(m_tuples, seed, num_partitions, index_list);
+    dispatchKernel(key, num_columns(), hasher);
+    for (int i = 0; i < m_tuples.size(); i++)
+        obliv::cmove(index_list[i], distr(rng), m_tuples[i].is_dummy);
+    Tuple dummy = m_tuples[0].copy();
     dummy.is_dummy = true;
     obliv::shuffle_soda(m_tuples, index_list, num_partitions, size_bound, dummy);
-    if (size_bound * num_partitions != m_tuples.size()) {
-        log_error("Padding error! size_bound=%d,num_partitions=%d,tuple_size=%d", size_bound, num_partitions, m_tuples.size());
-    }
-
-    auto it = m_tuples.begin();
-    for (int i = 0; i < num_partitions; i++) {
-        output[i].insert(output[i].end(), it, it + size_bound);
-        it += size_bound;
-    }
 
-    shuffleWrite(num_partitions, output);
+    shuffleWrite(num_partitions, size_bound);
 }
 
 void LocalTable::generateData(int num_cols, int num_rows) {
+    m_tuples = TupleBlock(num_cols);
     m_tuples.resize(num_rows);
     for (int i = 0; i < num_rows; i++) {
-        m_tuples[i].data.resize(num_cols);
         for (int j = 0; j < num_cols; j++)
             m_tuples[i].data[j] = i + j;
     }
@@ -2,15 +2,33 @@
 #include <string>
 #include <vector>
 #include "Tuple.h"
+#include "TupleBlock.h"
 // #include "Operators.h"
 #include <random>
 #include "Enclave.h"
 #include "Operators.h"
 
+// steps of a plan for LocalTable::runPlan; keep in sync with LocalPlan::Op in App/include/LocalTable.h
+enum PlanOp {
+  PLAN_ADD_COL,
+  PLAN_COPY_COL,
+  PLAN_DELETE_COL,
+  PLAN_PROJECT,
+  PLAN_MV_JOIN_COLS_AHEAD,
+  PLAN_LOCAL_SORT,
+  PLAN_FOREIGN_TABLE_MODIFY_COL_Z,
+  PLAN_REMOVE_DUP_AFTER_PREFIX,
+  PLAN_FINALIZE_PKJOIN_RESULT,
+  PLAN_EXPANSION_PREPARE,
+  PLAN_ADD_AND_CALCULATE_COL_T_P,
+  PLAN_EXPANSION_DISTRIBUTE_AND_CLEAR,
+  PLAN_JOIN_COMPUTE_ALIGNMENT
+};
+
 class LocalTable {
 public:
   LocalTable(int global_id_, int id_, uint8_t* file, size_t file_length);
-  LocalTable(int global_id_, int id_, std::vector<Tuple>& tuples) : global_id(global_id_), id(id_), m_tuples(tuples) {}
+  LocalTable(int global_id_, int id_, TupleBlock& tuples) : global_id(global_id_), id(id_), m_tuples(tuples) {}
 
   const int size();
   const int num_columns();
@@ -27,12 +45,18 @@ public:
   void randomShuffle(int num_partitions);
   void shuffleByKey(int num_partitions, const std::vector<int>& key, int seed, int size_bound);
   void shuffleByCol(int num_partitions, int i_col_id, int size_bound);
-  void shuffleMerge(int num_partitions);
+  void shuffleByKeyTwoRound(int num_partitions, const std::vector<int>& key, int seed, int size_bound, int overflow_bound);
+  void shuffleRelay(int num_partitions, int overflow_bound);
+  void shuffleMerge(int num_partitions, bool relayed = false);
   void refresh();
 
+  // phase -1 aggregates the partition on its own; with doPrefix, phase is a round of prefixScan
   void groupByAggregateBase(int num_partitions, AssociateOperator* op, bool doPrefix, int phase, bool reverse);
+  // every partition sends a random sample to partition 0, which sorts the samples and sends the p - 1
+  // splitters at their quantiles to every partition for partitionByPivots
+  void samplePivots(int num_partitions, int sample_size);
   void getPivots(int num_partitions, const std::vector<int>& columns);
-  void refreshAndMerge(int num_partitions);
+  void refreshAndMerge(int num_partitions, std::vector<int>* runs = NULL);
   void sortMerge(int num_partitions, const std::vector<int>& columns);
   void localSort(int num_partitions, const std::vector<int>& columns);
   void pad_to_size(int num_partitions, int n);
@@ -45,7 +69,6 @@ public:
   void add_and_calculate_col_t_p(int d_index, int m);
   void expansion_distribute_and_clear(int num_partitions, int m);
   void deleteCol(int num_partitions, int col_index);
-  void expansion_suffix_sum(int num_partitions, int phase);
   long long sum(int column);
   // void shuffle(int num_partitions, const std::vector<int> key, int seed, std::vector<std::vector<Tuple>> &output);
   // sort table by columns (dictionary order); dummy tuples are always moved to the end
@@ -58,15 +81,18 @@ public:
   // long long sum(int column);
   // // Please ensure that the tuples are already sorted by the group by columns; return the last non-dummy tuple
   // Tuple groupByPrefixAggregate(AssociateOperator &op);
-  // // Which is used for groupByPrefixAggregate only
-  void _addValueByKey(AssociateOperator* op);
   void partitionByPivots(std::vector<int>& columns, int num_partitions, int size_bound);
-  void shuffleWrite(int num_partitions, std::vector<std::vector<Tuple>>& output);
+  void shuffleWrite(int num_partitions, std::vector<TupleBlock>& output);
+  // write the size_bound rows of each partition, stored one after another in m_tuples
+  void shuffleWrite(int num_partitions, int size_bound);
   void pkJoinCombine(int num_partitions, int ori_r_col_num, int r_align_col_num, std::vector<int>& combine_sort_cols, std::vector<int>& join_cols, LocalTable& s_table_local);
   void joinComputeAlignment(int m);
   void joinFinalCombine(LocalTable& r_table, int num_join_cols);
+  // run a plan of local steps, each an opcode followed by its arguments (a list is its length, then its
+  // elements). Consecutive column edits are applied to the rows in one pass. Returns -1 for a bad plan.
+  int runPlan(int num_partitions, const int* plan, size_t plan_size);
 
-  std::vector<Tuple> getTuples();
+  TupleBlock getTuples();
   int getNumRows();
   // must be called from the last server to the first server
   void remove_dup_after_prefix(int num_partitions, std::vector<int>& columns);
@@ -89,11 +115,22 @@ private:
   int global_id;  //the global table's id it belongs to
   int id;
   // std::string filePath;
-  std::vector<Tuple> m_tuples;
-  int m_num_columns = 0;
+  TupleBlock m_tuples;
+  // state of a prefix aggregate across the partitions between its rounds: the aggregate of this partition
+  // and the predecessors covered so far, and that of the predecessors alone (no row until one is covered)
+  TupleBlock m_scan_total;
+  TupleBlock m_scan_before;
   // int m_num_rows = 0; //it does not take dummy rows into account
   bool isKeyUnique(const std::vector<int>& key);
+  std::vector<int> targetsByKey(int num_partitions, const std::vector<int>& key, int seed);
+  // one round of a prefix aggregate across the partitions, by recursive doubling: ceil(log2 p) rounds
+  // after the local round 0
+  void prefixScan(int num_partitions, AssociateOperator* op, int round, bool reverse);
+  // sort runs that fit sort_budget, seal them to the host and merge them obliviously; the partition
+  // must still fit in the enclave heap before and after, only the merge's working set is bounded
+  void externalSort(const std::vector<int>& columns);
 };
 
-const char* serialize_tuple_vector(std::vector<Tuple>& tuple_list, int col_num, size_t* ser_length, int* ser_row_num);
+const char* serialize_tuple_block(TupleBlock& rows, int begin, int end, size_t* ser_length, int* ser_row_num);
+void print_tuples(TupleBlock& m_tuples, int limit_size, bool show_dummy = false);
 bool TupleCompare(Tuple& tl, Tuple& tr, const std::vector<int>& columns);
\ No newline at end of file
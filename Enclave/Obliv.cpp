@@ -1,6 +1,15 @@
 #include "Obliv.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <random>
+#include <stdexcept>
 #include <vector>
+#include "Enclave.h"
+#include "ThreadPool.h"
+#include "TupleKernel.h"
 
 namespace obliv {
 
@@ -12,6 +21,30 @@ inline int prev_pow_two(int x) {
     return y >>= 1;
 }
 
+// working set targeted by one block of the bitonic engine (about the size of a per-core L2)
+const int BITONIC_BLOCK_BYTES = 1 << 18;
+// inputs below this size are sorted on the calling thread only
+const int PARALLEL_MIN_SIZE = 1 << 14;
+// chunks handed out per pool thread and stage, to even out the load
+const int TASKS_PER_THREAD = 4;
+// inputs below this size are always sorted with the bitonic network
+const int BUCKET_MIN_SIZE = 1 << 12;
+
+static int sort_algorithm = SORT_BITONIC;
+static double sort_kappa = 40 * 0.69314718;  // failure probability of the bucket sort = exp{-kappa}
+
+void set_sort_algorithm(int algorithm, double kappa) {
+    sort_algorithm = algorithm;
+    sort_kappa = kappa;
+}
+
+int simd_level = SIMD_NONE;
+
+int set_simd_level(int level) {
+    simd_level = std::max((int)SIMD_NONE, std::min(level, simd_built_level()));
+    return simd_level;
+}
+
 class Obliv {
   public:
     virtual int isDummy(int i) = 0;
@@ -34,25 +67,92 @@ class Obliv {
         cswap(i, j, cond);
     }
 
+    // visit the pairs of one stage of the merge of size k, with distance j, whose lower index lies in
+    // [lo, hi); lo must be aligned to 2*j. visit(a, b, q) gets the pair and its ordinal q inside the stage.
+    // The first stage of each merge (2*j == k) pairs i with its mirror inside the 2*j block, so every stage
+    // sorts in the same direction. Indices >= size are treated as +inf padding that never moves, which is
+    // what allows an arbitrary n.
+    template <typename Visit>
+    void _bitonic_pairs(int k, int j, int lo, int hi, Visit visit) {
+        int flip = (j << 1) == k;
+        for (int s = lo; s < hi && s < size; s += (j << 1)) {
+            for (int t = 0; t < j; t++) {
+                int a = s + t;
+                int b = flip ? s + (j << 1) - 1 - t : a + j;
+                if (b < size)
+                    visit(a, b, (s >> 1) + t);
+            }
+        }
+    }
+
     template <typename Compare, typename CSwap>
-    void _bitonic_merge(int ascend, int lo, int hi, Compare compare, CSwap cswap) {
-        if (hi <= lo + 1)
+    void _bitonic_stage(int ascend, int k, int j, int lo, int hi, Compare compare, CSwap cswap) {
+        _bitonic_pairs(k, j, lo, hi, [&](int a, int b, int) { _bitonic_swap(ascend, a, b, compare, cswap); });
+    }
+
+    // split [0, size) into chunks aligned to align and run body(lo, hi) on each of them through the
+    // enclave thread pool. The chunk bounds only depend on size, align and the number of threads.
+    template <typename Body>
+    void _parallel_chunks(int align, Body body) {
+        int units = (size + align - 1) / align;
+        int tasks = std::min(units, thread_pool::concurrency() * TASKS_PER_THREAD);
+        if (tasks <= 1 || size < PARALLEL_MIN_SIZE) {
+            body(0, units * align);
             return;
-        int mid_len = prev_pow_two(hi - lo - 1);
-        for (int i = lo; i < hi - mid_len; i++)
-            _bitonic_swap(ascend, i, i + mid_len, compare, cswap);
-        _bitonic_merge(ascend, lo, lo + mid_len, compare, cswap);
-        _bitonic_merge(ascend, lo + mid_len, hi, compare, cswap);
+        }
+        thread_pool::parallel_for(tasks, [&](int t) {
+            int lo = (int)((long long)units * t / tasks) * align;
+            int hi = (int)((long long)units * (t + 1) / tasks) * align;
+            body(lo, hi);
+        });
+    }
+
+    // walk the stages of the bitonic network over [0, size), calling stage(k, j, lo, hi) for each merge
+    // size k, distance j and range. Stages whose distance is below block only touch pairs inside one
+    // aligned block, so they are run block by block while the block is still cache resident; only the
+    // larger distances sweep the whole array. Blocks (and 2*j groups of the large stages) are independent,
+    // so they are spread over the thread pool. The visited pairs are fixed by size alone.
+    // If the aligned runs of length sorted (a power of two) are already ascending, the merges up to that
+    // size are skipped and only the remaining ones are run.
+    template <typename Stage>
+    void _bitonic_schedule(int block, Stage stage, int sorted = 1) {
+        int n = 1;
+        while (n < size)
+            n <<= 1;
+        if (block > n)
+            block = n;
+        if (sorted < block)
+            _parallel_chunks(block, [&](int lo, int hi) {
+                for (int b = lo; b < hi && b < size; b += block)
+                    for (int k = sorted << 1; k <= block; k <<= 1)
+                        for (int j = k >> 1; j >= 1; j >>= 1)
+                            stage(k, j, b, b + block);
+            });
+        for (int k = std::max(block, sorted) << 1; k <= n; k <<= 1) {
+            for (int j = k >> 1; j >= block; j >>= 1)
+                _parallel_chunks(j << 1, [&](int lo, int hi) { stage(k, j, lo, hi); });
+            _parallel_chunks(block, [&](int lo, int hi) {
+                for (int b = lo; b < hi && b < size; b += block)
+                    for (int j = block >> 1; j >= 1; j >>= 1)
+                        stage(k, j, b, b + block);
+            });
+        }
     }
 
+    // iterative, cache-blocked bitonic sort over [0, size)
     template <typename Compare, typename CSwap>
-    void _bitonic_sort(int ascend, int lo, int hi, Compare compare, CSwap cswap) {
-        int mid = (lo + hi) / 2;
-        if (mid == lo)
-            return;
-        _bitonic_sort(!ascend, lo, mid, compare, cswap);
-        _bitonic_sort(ascend, mid, hi, compare, cswap);
-        _bitonic_merge(ascend, lo, hi, compare, cswap);
+    void _bitonic_sort(int ascend, int block, Compare compare, CSwap cswap) {
+        _bitonic_schedule(block, [&](int k, int j, int lo, int hi) {
+            _bitonic_stage(ascend, k, j, lo, hi, compare, cswap);
+        });
+    }
+
+    // number of elements of elem_bytes each that fit in BITONIC_BLOCK_BYTES, as a power of two
+    inline int block_elems(int elem_bytes) {
+        int block = 2;
+        while ((long long)block * 2 * elem_bytes <= BITONIC_BLOCK_BYTES)
+            block <<= 1;
+        return block;
     }
 
     template <typename CSwap>
@@ -117,16 +217,16 @@ class Obliv {
     }
 
     template <typename Compare, typename CSwap>
-    void _sort(int ascend, Compare compare, CSwap cswap) {
+    void _sort(int ascend, int elem_bytes, Compare compare, CSwap cswap) {
         if (size <= 1)
             return;
-        _bitonic_sort(ascend, 0, size, compare, cswap);
+        _bitonic_sort(ascend, block_elems(elem_bytes), compare, cswap);
     }
 
     template <typename CSwap>
     void _compact(std::vector<int>& _M, CSwap cswap) {
         if (_M.size() != size)
-            throw;
+            throw std::invalid_argument("compaction marks do not match the size");
         if (size <= 1)
             return;
         this->M = &_M[0];
@@ -155,7 +255,7 @@ class IntObliv : public Obliv {
 
     void sort(int ascend = true) {
         _sort(
-            ascend, [this](int i, int j) { return X[i] < X[j]; },
+            ascend, sizeof(int), [this](int i, int j) { return X[i] < X[j]; },
             [this](int i, int j, int cond) { 
                 cswapInt(X[i], X[j], cond); });
     }
@@ -192,52 +292,496 @@ class IntObliv : public Obliv {
     std::vector<int>& X;
 };
 
+/*
+    Slots of the bucket sort, one record each: a row (values and dummy flag), then its sort key, its
+    position in the input, its destination and whether it is a filler, so a compare-exchange is a single cswapInts. A SlotObliv
+    covers two runs of slots, which lets a merge-split compact two buckets where they are.
+*/
+class SlotObliv : public Obliv {
+  public:
+    SlotObliv(int* first, int* second, int half, int width, int n)
+        : first(first), second(second), half(half), width(width) {
+        size = n;
+    }
+
+    inline int* slot(int i) {
+        return i < half ? first + (size_t)i * width : second + (size_t)(i - half) * width;
+    }
+
+    int isDummy(int i) {
+        return slot(i)[width - 1];
+    }
+
+    inline void cswap(int i, int j, int cond) {
+        cswapInts(slot(i), slot(j), width, cond);
+    }
+
+    void compact(std::vector<int>& M) {
+        _compact(M, [this](int i, int j, int cond) { cswap(i, j, cond); });
+    }
+
+    // order the slots by dest, which holds a random rank here
+    void sortByDest() {
+        _sort(
+            true, width * sizeof(int), [this](int i, int j) { return slot(i)[width - 2] < slot(j)[width - 2]; },
+            [this](int i, int j, int cond) { cswap(i, j, cond); });
+    }
+
+  private:
+    int *first, *second;
+    int half, width;
+};
+
+/*
+    Bucket oblivious sort (Asharov et al., SOSA'20). Every element picks a uniformly random bucket and is
+    routed there through a butterfly of merge-split steps; each merge-split is an order-preserving
+    compaction of two buckets of Z slots. Each bucket is then randomly permuted with a small bitonic sort,
+    the fillers are dropped and the randomly ordered elements are sorted with std::sort. Every element
+    carries its input position through the routing and std::sort breaks ties on it, so it sorts distinct
+    (key, input position) pairs. Their order after the shuffle is uniformly random whatever the keys
+    are, so the access pattern of std::sort reveals nothing, not even how many keys are equal.
+    A bucket overflows with probability at most exp{-kappa}; this event only depends on the random
+    choices, and the caller then falls back to bitonic sort.
+*/
+class BucketSort {
+  public:
+    BucketSort(TupleBlock& X, std::vector<int>& key) : X(X), key(key) {
+        n = X.size();
+        stride = X.stride();
+        width = stride + 4;
+    }
+
+    // position in the input of each row of X after shuffle
+    std::vector<int> origin;
+
+    // obliviously permute X and key (in step) at random, recording origin. Returns false if X is too small to be worth it
+    // or a bucket overflowed; then X and key hold a permutation of the input that is not random.
+    bool shuffle() {
+        if (n < BUCKET_MIN_SIZE)
+            return false;
+        chooseBucketSize();
+        assign();
+        bool overflow = false;
+        for (int bit = 1; bit < B; bit <<= 1)
+            overflow |= route(bit);
+        if (overflow) {
+            log_warn("bucket sort overflow (n = %d, Z = %d), falling back to bitonic sort", n, Z);
+            collect();
+            return false;
+        }
+        permuteBuckets();
+        collect();
+        return true;
+    }
+
+    // Less(const TupleRef& a, int key_a, const TupleRef& b, int key_b). Returns false if X was not
+    // sorted, in which case X and key hold a permutation of the input.
+    template <typename Less>
+    bool sort(Less less) {
+        if (!shuffle())
+            return false;
+        std::vector<int> idx(n);
+        for (int i = 0; i < n; i++)
+            idx[i] = i;
+        // ties are broken on the input position, so the comparisons see distinct pairs in a uniformly
+        // random order however many keys are equal
+        std::sort(idx.begin(), idx.end(), [&](int a, int b) {
+            if (less(X[a], key[a], X[b], key[b]))
+                return true;
+            if (less(X[b], key[b], X[a], key[a]))
+                return false;
+            return origin[a] < origin[b];
+        });
+        TupleBlock sorted(X.num_columns());
+        sorted.resize(n);
+        std::vector<int> sorted_key(n);
+        for (int i = 0; i < n; i++) {
+            memcpy(sorted.row(i), X.row(idx[i]), stride * sizeof(int));
+            sorted_key[i] = key[idx[i]];
+        }
+        X.swap(sorted);
+        key.swap(sorted_key);
+        return true;
+    }
+
+  private:
+    TupleBlock& X;
+    std::vector<int>& key;
+    int n, stride, width, Z, B;
+    // B * Z slot records, see SlotObliv
+    std::vector<int> S;
+
+    inline int* slot(size_t i) {
+        return &S[i * width];
+    }
+
+    // smallest power-of-two Z with B log(B) exp{-Z/6} <= exp{-kappa}, where B = 2n/Z
+    void chooseBucketSize() {
+        Z = 64;
+        while (true) {
+            B = 1;
+            while ((long long)B * Z < 2LL * n)
+                B <<= 1;
+            double log_b = std::max(1.0, std::log2((double)B));
+            if (Z / 6.0 >= sort_kappa + std::log(B * log_b))
+                break;
+            Z <<= 1;
+        }
+    }
+
+    // spread the input evenly over the buckets (at most Z/2 per bucket) and draw random destinations
+    void assign() {
+        S.assign((size_t)B * Z * width, 0);
+        for (size_t i = 0; i < (size_t)B * Z; i++) {
+            slot(i)[stride - 1] = 1;
+            slot(i)[width - 1] = 1;
+        }
+        std::random_device rd;
+        std::mt19937 rng(rd());
+        std::uniform_int_distribution<> distr(0, B - 1);
+        int per_bucket = (n + B - 1) / B;
+        for (int i = 0; i < n; i++) {
+            int* s = slot((size_t)(i / per_bucket) * Z + i % per_bucket);
+            memcpy(s, X.row(i), stride * sizeof(int));
+            s[stride] = key[i];
+            s[stride + 1] = i;
+            s[stride + 2] = distr(rng);
+            s[stride + 3] = 0;
+        }
+    }
+
+    // one butterfly level: merge-split every pair of buckets that differ in bit. Returns true on overflow.
+    bool route(int bit) {
+        std::vector<int> lows;
+        for (int b = 0; b < B; b++)
+            if (!(b & bit))
+                lows.push_back(b);
+        std::vector<int> overflow(lows.size(), 0);
+        thread_pool::parallel_for(lows.size(), [&](int t) {
+            overflow[t] = mergeSplit(lows[t], lows[t] | bit, bit);
+        });
+        int any = 0;
+        for (int o : overflow)
+            any |= o;
+        return any;
+    }
+
+    int mergeSplit(int b0, int b1, int bit) {
+        int m = 2 * Z;
+        // the two buckets form one run of 2Z slots, compacted in place
+        SlotObliv run(slot((size_t)b0 * Z), slot((size_t)b1 * Z), Z, width, m);
+        // real elements heading to b0 plus just enough fillers to fill it up come first
+        int c0 = 0, c1 = 0;
+        for (int i = 0; i < m; i++) {
+            const int* s = run.slot(i);
+            int high = (s[stride + 2] & bit) != 0;
+            c0 += (!s[stride + 3]) & (!high);
+            c1 += (!s[stride + 3]) & high;
+        }
+        std::vector<int> M(m);
+        int need = Z - c0;
+        for (int i = 0; i < m; i++) {
+            const int* s = run.slot(i);
+            int f = s[stride + 3];
+            int z = f & (need > 0);
+            need -= z;
+            M[i] = ((!f) & ((s[stride + 2] & bit) == 0)) | z;
+        }
+        run.compact(M);
+        return (c0 > Z) | (c1 > Z);
+    }
+
+    // randomly permute every bucket, moving its fillers to the end
+    void permuteBuckets() {
+        std::random_device rd;
+        std::mt19937 rng(rd());
+        std::uniform_int_distribution<> distr(0, (1 << 30) - 1);
+        for (size_t i = 0; i < (size_t)B * Z; i++)
+            slot(i)[stride + 2] = distr(rng) | (slot(i)[stride + 3] << 30);
+        thread_pool::parallel_for(B, [&](int b) {
+            int* lo = slot((size_t)b * Z);
+            SlotObliv(lo, lo, Z, width, Z).sortByDest();
+        });
+    }
+
+    // move the real elements back to X in slot order; the fillers of a bucket are public after routing
+    void collect() {
+        int j = 0;
+        origin.resize(n);
+        for (size_t i = 0; i < (size_t)B * Z; i++) {
+            const int* s = slot(i);
+            if (s[stride + 3])
+                continue;
+            memcpy(X.row(j), s, stride * sizeof(int));
+            key[j] = s[stride];
+            origin[j++] = s[stride + 1];
+        }
+        std::vector<int>().swap(S);
+    }
+};
+
+/*
+    Tag sort: the wide rows are first permuted at random with the routing of the bucket sort, whose moves
+    are cheap in the row width compared with a sorting network. The narrow tags (is_dummy, the sort keys,
+    the position in the input, the position after the permutation) are then sorted with the bitonic
+    network, and every row is moved once to the place of its tag. Ties are broken on the input position,
+    so the sorted order only depends on the input, and the moves follow it composed with the hidden
+    random permutation: a uniformly random permutation whatever the keys, safe to make non-obliviously.
+*/
+class TagSort : public Obliv {
+  public:
+    TagSort(int n, int width) : width(width), R((size_t)n * width) {
+        size = n;
+    }
+
+    int isDummy(int i) {
+        return R[(size_t)i * width];
+    }
+
+    // tag i: is_dummy, width - 3 key values, the input position of its row, then where that row is now
+    inline int* record(int i) {
+        return &R[(size_t)i * width];
+    }
+
+    // sort the tags: dummy last, then by their keys in order, then by position
+    void sort(int ascend) {
+        _sort(
+            ascend, width * sizeof(int), [this](int i, int j) { return less(record(i), record(j)); },
+            [this](int i, int j, int cond) { cswapInts(record(i), record(j), width, cond); });
+    }
+
+    // move the rows of X to the order of the sorted tags, following the cycles of the permutation in place
+    void apply(TupleBlock& X) {
+        int stride = X.stride();
+        std::vector<int> source(size);
+        for (int i = 0; i < size; i++)
+            source[i] = record(i)[width - 1];
+        std::vector<int> saved(stride);
+        for (int i = 0; i < size; i++) {
+            if (source[i] < 0 || source[i] == i)
+                continue;
+            memcpy(&saved[0], X.row(i), stride * sizeof(int));
+            int j = i;
+            while (source[j] != i) {
+                int from = source[j];
+                memcpy(X.row(j), X.row(from), stride * sizeof(int));
+                source[j] = -1;
+                j = from;
+            }
+            memcpy(X.row(j), &saved[0], stride * sizeof(int));
+            source[j] = -1;
+        }
+    }
+
+  private:
+    int width;
+    std::vector<int> R;
+
+    // same order as Tuple::less_in_cols, the input position breaking ties
+    inline int less(const int* x, const int* y) {
+        int ret = (!x[0]) & y[0];
+        int all_eq = !(x[0] ^ y[0]);
+        for (int c = 1; c < width; c++) {
+            ret |= all_eq & (x[c] < y[c]);
+            all_eq &= x[c] == y[c];
+        }
+        return ret;
+    }
+};
+
 class TupleObliv : public Obliv {
   public:
-    TupleObliv(std::vector<Tuple>& input) : X(input) {
+    TupleObliv(TupleBlock& input) : X(input) {
         size = input.size();
     }
 
+    // bytes touched per element when swapping
+    int rowBytes() {
+        return X.stride() * sizeof(int);
+    }
+
     inline int isDummy(int i) {
-        return X[i].is_dummy;
+        return X.row(i)[X.num_columns()];
     }
 
     void sortByCols(const std::vector<int>& columns, int ascend = true) {
+        std::vector<int> no_key(sort_algorithm == SORT_TAG ? size : 0, 0);
+        BucketSort shuffler(X, no_key);
+        if (sort_algorithm == SORT_TAG && shuffler.shuffle()) {
+            TagSort tag(size, columns.size() + 3);
+            for (int i = 0; i < size; i++) {
+                int* rec = tag.record(i);
+                const int* row = X.row(i);
+                rec[0] = isDummy(i);
+                for (size_t c = 0; c < columns.size(); c++)
+                    rec[c + 1] = row[columns[c]];
+                rec[columns.size() + 1] = shuffler.origin[i];
+                rec[columns.size() + 2] = i;
+            }
+            tag.sort(ascend);
+            tag.apply(X);
+            return;
+        }
+        if (sort_algorithm == SORT_BUCKET) {
+            std::vector<int> key(size, 0);
+            bool sorted = BucketSort(X, key).sort([&columns, ascend](const TupleRef& a, int, const TupleRef& b, int) {
+                return ascend ? a.less_in_cols(b, columns) : b.less_in_cols(a, columns);
+            });
+            if (sorted)
+                return;
+        }
+        KernelSort sorter(*this, columns, ascend);
+        dispatchKernel(columns, X.num_columns(), sorter);
+    }
+
+    // keys of up to three columns are packed (see packKeys), so the network compares one integer
+    template <typename Kernel>
+    void sortByKernel(const Kernel& kernel, const std::vector<int>& columns, int ascend) {
+        if (columns.size() == 1) {
+            sortByPackedKey<uint64_t>(kernel, columns, ascend);
+            return;
+        }
+#ifdef __SIZEOF_INT128__
+        if (columns.size() <= 3) {
+            sortByPackedKey<unsigned __int128>(kernel, columns, ascend);
+            return;
+        }
+#endif
         _sort(
-            ascend, [this, &columns](int i, int j) { return X[i].less_in_cols(X[j], columns); },
-            [this](int i, int j, int cond) { cswapTuple(X[i], X[j], cond); });
+            ascend, rowBytes(), [this, &kernel](int i, int j) { return kernel.less(X.row(i), X.row(j)); },
+            [this, &kernel](int i, int j, int cond) { kernel.cswap(X.row(i), X.row(j), cond); });
+    }
+
+    // order-preserving key of every row: the dummy flag, then each column with its sign bit flipped
+    // (so signed order becomes unsigned order), 32 bits each. Comparing two keys gives the same order
+    // as less_in_cols on columns.
+    template <typename Key>
+    void packKeys(const std::vector<int>& columns, std::vector<Key>& key) {
+        for (int i = 0; i < size; i++) {
+            const int* row = X.row(i);
+            Key k = (Key)row[X.num_columns()];
+            for (int col : columns)
+                k = (k << 32) | (uint32_t)(row[col] ^ 0x80000000);
+            key[i] = k;
+        }
+    }
+
+    template <typename Key, typename Kernel>
+    void sortByPackedKey(const Kernel& kernel, const std::vector<int>& columns, int ascend) {
+        std::vector<Key> key(size);
+        packKeys(columns, key);
+        _sort(
+            ascend, rowBytes() + sizeof(Key), [&key](int i, int j) { return key[i] < key[j]; },
+            [this, &kernel, &key](int i, int j, int cond) {
+                kernel.cswap(X.row(i), X.row(j), cond);
+                Key xored = (-(Key)cond) & (key[i] ^ key[j]);
+                key[i] ^= xored;
+                key[j] ^= xored;
+            });
     }
 
     void sortByKey(std::vector<int>& key, int ascend = true) {
+        BucketSort shuffler(X, key);
+        if (sort_algorithm == SORT_TAG && key.size() == size && shuffler.shuffle()) {
+            TagSort tag(size, 4);
+            for (int i = 0; i < size; i++) {
+                tag.record(i)[0] = 0;
+                tag.record(i)[1] = key[i];
+                tag.record(i)[2] = shuffler.origin[i];
+                tag.record(i)[3] = i;
+            }
+            tag.sort(ascend);
+            tag.apply(X);
+            for (int i = 0; i < size; i++)
+                key[i] = tag.record(i)[1];
+            return;
+        }
+        if (sort_algorithm == SORT_BUCKET && key.size() == size) {
+            bool sorted = BucketSort(X, key).sort([ascend](const TupleRef&, int ka, const TupleRef&, int kb) {
+                return ascend ? ka < kb : kb < ka;
+            });
+            if (sorted)
+                return;
+        }
         _sort(
-            ascend, [this, &key](int i, int j) { return key[i] < key[j]; },
+            ascend, rowBytes() + sizeof(int), [this, &key](int i, int j) { return key[i] < key[j]; },
             [this, &key](int i, int j, int cond) { 
-                cswapTuple(X[i], X[j], cond); 
+                cswapRow(X, i, j, cond); 
                 cswapInt(key[i], key[j], cond); });
     }
 
     void compact(std::vector<int>& M) {
-        _compact(M, [this](int i, int j, int cond) { cswapTuple(X[i], X[j], cond); });
+        _compact(M, [this](int i, int j, int cond) { cswapRow(X, i, j, cond); });
     }
 
-    void partitionByPivots(std::vector<Tuple>& pivots, std::vector<int>& columns, int U, Tuple dummy) {
+    void partitionByPivots(TupleBlock& pivots, std::vector<int>& columns, int U, const Tuple& dummy) {
         int padded_size = (pivots.size() + 1) * U;
-        X.insert(X.end(), padded_size - size, dummy);
+        X.resize(padded_size, dummy);
         size = padded_size;
         _partition(
             pivots.size(), U, [this, &pivots, &columns](int i, int j) { return X[i].less_in_cols(pivots[j], columns); },
-            [this](int i, int j, int cond) { cswapTuple(X[i], X[j], cond); });
+            [this](int i, int j, int cond) { cswapRow(X, i, j, cond); });
     }
 
-    void shuffle(std::vector<int>& targets, int p, int U, Tuple dummy) {
+    // same layout as partitionByPivots, but X must be sorted by columns and every range keeps that order.
+    // Since X is sorted, the tuples of one range are contiguous, so its target is the range offset plus a
+    // running rank, and distribute moves them there in O(n log n).
+    void partitionSorted(TupleBlock& pivots, std::vector<int>& columns, int U, const Tuple& dummy) {
+        int padded_size = (pivots.size() + 1) * U;
+        std::vector<int> targets(padded_size, padded_size);
+        int prev = 0, rank = -1;
+        for (int i = 0; i < size; i++) {
+            int range = 0;
+            for (int j = 0; j < pivots.size(); j++)
+                range += !X[i].less_in_cols(pivots[j], columns);
+            rank = (rank + 1) & (-(range == prev));
+            targets[i] = range * U + rank;
+            prev = range;
+        }
+        X.resize(padded_size, dummy);
+        size = padded_size;
+        distribute(targets);
+    }
+
+    // merge consecutive runs of the given lengths, each sorted ascending by columns. Every run is padded
+    // with dummies to a common power of two R, so only the bitonic merges above R are needed:
+    // O(n log n log p) for p runs instead of O(n log^2 n). The padding ends up last and is cut off.
+    void mergeRuns(const std::vector<int>& runs, const std::vector<int>& columns, const Tuple& dummy) {
+        int R = 1;
+        for (int len : runs)
+            while (R < len)
+                R <<= 1;
+        TupleBlock padded(X.num_columns());
+        padded.reserve(runs.size() * R);
+        int offset = 0;
+        for (int len : runs) {
+            padded.append(X, offset, offset + len);
+            padded.resize(padded.size() + R - len, dummy);
+            offset += len;
+        }
+        X.swap(padded);
+        size = X.size();
+        _bitonic_schedule(
+            block_elems(rowBytes()),
+            [&](int k, int j, int lo, int hi) {
+                _bitonic_stage(
+                    true, k, j, lo, hi, [this, &columns](int a, int b) { return X[a].less_in_cols(X[b], columns); },
+                    [this](int a, int b, int cond) { cswapRow(X, a, b, cond); });
+            },
+            R);
+        X.resize(offset);
+        size = offset;
+    }
+
+    void shuffle(std::vector<int>& targets, int p, int U, const Tuple& dummy) {
         int padded_size = p * U;
-        X.insert(X.end(), padded_size - size, dummy);
+        X.resize(padded_size, dummy);
         targets.insert(targets.end(), padded_size - targets.size(), 0);
         size = padded_size;
         _partition(
             p - 1, U, [this, &targets](int i, int j) { return targets[i] <= j; },
             [this, &targets](int i, int j, int cond) {
-                cswapTuple(X[i], X[j], cond);
+                cswapRow(X, i, j, cond);
                 cswapInt(targets[i], targets[j], cond);
             });
     }
@@ -247,57 +791,109 @@ class TupleObliv : public Obliv {
         for (int j = prev_pow_two(m - 1); j >= 1; j /= 2) {
             for (int i = m - j - 1; i >= 0; i--) {
                 int cond = (targets[i] >= i + j) & (!isDummy(i));
-                cswapTuple(X[i], X[i + j], cond);
+                cswapRow(X, i, i + j, cond);
                 cswapInt(targets[i], targets[i + j], cond);
             }
         }
     }
 
   private:
-    std::vector<Tuple>& X;
+    TupleBlock& X;
+
+    struct KernelSort {
+        TupleObliv& obl;
+        const std::vector<int>& columns;
+        int ascend;
+        KernelSort(TupleObliv& obl, const std::vector<int>& columns, int ascend) : obl(obl), columns(columns), ascend(ascend) {}
+        template <typename Kernel>
+        void operator()(const Kernel& kernel) {
+            obl.sortByKernel(kernel, columns, ascend);
+        }
+    };
 };
 
-void sort(std::vector<Tuple>& X, const std::vector<int>& columns, bool ascend) {
+void sort(TupleBlock& X, const std::vector<int>& columns, bool ascend) {
     TupleObliv(X).sortByCols(columns, ascend);
 }
 
-void compact(std::vector<Tuple>& X, std::vector<int>& M) {
+void compact(TupleBlock& X, std::vector<int>& M) {
     TupleObliv(X).compact(M);
 }
 
-void shuffle_soda(std::vector<Tuple>& X, std::vector<int>& targets, int p, int U, Tuple dummy) {
+void shuffle_soda(TupleBlock& X, std::vector<int>& targets, int p, int U, const Tuple& dummy) {
     auto obl = TupleObliv(X);
     obl.sortByKey(targets);
     int padded_size = p * U;
-    X.insert(X.end(), padded_size - X.size(), dummy);
+    X.resize(padded_size, dummy);
     targets.insert(targets.end(), padded_size - targets.size(), p + 1);
     obl.distribute(targets);
 }
 
-void shuffle(std::vector<Tuple>& X, std::vector<int>& targets, int p, int U, Tuple dummy) {
+void shuffle(TupleBlock& X, std::vector<int>& targets, int p, int U, const Tuple& dummy) {
     TupleObliv(X).shuffle(targets, p, U, dummy);
 }
 
-void partition(std::vector<Tuple>& X, std::vector<Tuple>& pivots, std::vector<int>& columns, int U, Tuple dummy) {
-    TupleObliv(X).partitionByPivots(pivots, columns, U, dummy);
+int shuffle_two_round(TupleBlock& X, std::vector<int>& targets, int p, int U, int B, TupleBlock& overflow, const Tuple& dummy) {
+    int n = X.size();
+    // dummies last, so the real tuples of a target are contiguous and ranked from 0
+    for (int i = 0; i < n; i++)
+        cmove(targets[i], p, X[i].is_dummy);
+    TupleObliv(X).sortByKey(targets);
+    std::vector<int> M(n);
+    int rank = -1, overflowed = 0;
+    for (int i = 0; i < n; i++) {
+        int same = i > 0 && targets[i] == targets[i - 1];
+        rank++;
+        cmove(rank, 0, !same);
+        M[i] = (!X[i].is_dummy) & (rank >= U);
+        overflowed += M[i];
+    }
+
+    int k = X.num_columns();
+    overflow = X;
+    overflow.resizeColumns(k + 1);
+    for (int i = 0; i < n; i++) {
+        TupleRef t = overflow[i];
+        t.data[k] = targets[i];
+        cmove(t.is_dummy, 1, !M[i]);
+        cmove(X[i].is_dummy, 1, M[i]);
+    }
+    compact(overflow, M);
+    Tuple overflow_dummy = dummy;
+    overflow_dummy.data.push_back(p);
+    overflow.resize(B, overflow_dummy);
+
+    shuffle(X, targets, p, U, dummy);
+    return overflowed;
+}
+
+void partition(TupleBlock& X, TupleBlock& pivots, std::vector<int>& columns, int U, const Tuple& dummy, bool sorted) {
+    if (sorted)
+        TupleObliv(X).partitionSorted(pivots, columns, U, dummy);
+    else
+        TupleObliv(X).partitionByPivots(pivots, columns, U, dummy);
+}
+
+void merge(TupleBlock& X, const std::vector<int>& runs, const std::vector<int>& columns, const Tuple& dummy) {
+    TupleObliv(X).mergeRuns(runs, columns, dummy);
 }
 
-void distribute(std::vector<Tuple>& X, std::vector<int>& targets, bool sorted) {
+void distribute(TupleBlock& X, std::vector<int>& targets, bool sorted) {
     auto obl = TupleObliv(X);
     if (!sorted)
         obl.sortByKey(targets);
     obl.distribute(targets);
 }
 
-void distributeByCol(std::vector<Tuple>& X, int col) {
+void distributeByCol(TupleBlock& X, int col) {
     int m = X.size();
     for (int j = prev_pow_two(m - 1); j >= 1; j /= 2) {
         for (int i = m - j - 1; i >= 0; i--) {
-            int cond = (X[i].data[col] >= i + j) & (!X[i].is_dummy);
-            cswapTuple(X[i], X[i + j], cond);
+            TupleRef t = X[i];
+            int cond = (t.data[col] >= i + j) & (!t.is_dummy);
+            cswapRow(X, i, i + j, cond);
         }
     }
 }
 
 };  // namespace obliv
-
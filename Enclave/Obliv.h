@@ -1,17 +1,30 @@
 #pragma once
 
 #include <vector>
-#include "Tuple.h"
+#include "CSwapKernels.h"
+#include "TupleBlock.h"
 
 namespace obliv {
 
+// algorithms behind sort and the sorting steps of shuffle_soda / distribute
+enum SortAlgorithm {
+    SORT_BITONIC = 0,  // bitonic network, O(n log^2 n), deterministic
+    SORT_BUCKET = 1,   // bucket oblivious sort, O(n log n), fails with probability exp{-kappa}
+    SORT_TAG = 2       // random oblivious shuffle, bitonic network on (is_dummy, keys, index) tags, then one move per row
+};
+
+// select the sort algorithm; kappa is the security parameter of randomized algorithms
+void set_sort_algorithm(int algorithm, double kappa);
+
+// select the compare-exchange kernels, capped at what the enclave was built with; returns the level in use
+int set_simd_level(int level);
+
 inline void cmove(int& x, int v, int cond) {
     x ^= (-cond) & (v ^ x);
 }
 
-inline void cmove(Tuple& x, const Tuple& y, int cond) {
-    for (int i = 0; i < x.size(); i++)
-        cmove(x.data[i], y.data[i], cond);
+inline void cmove(TupleRef x, const TupleRef& y, int cond) {
+    cmoveInts(x.data, y.data, x.size(), cond);
     cmove(x.is_dummy, y.is_dummy, cond);
 }
 
@@ -21,23 +34,41 @@ inline void cswapInt(int& x, int& y, int cond) {
     y ^= xored;
 }
 
-inline void cswapTuple(Tuple& x, Tuple& y, int cond) {
-    for (int i = 0; i < x.size(); i++)
-        cswapInt(x.data[i], y.data[i], cond);
+inline void cswapTuple(TupleRef x, TupleRef y, int cond) {
+    cswapInts(x.data, y.data, x.size(), cond);
     cswapInt(x.is_dummy, y.is_dummy, cond);
 }
 
-void sort(std::vector<Tuple>& X, const std::vector<int> &columns, bool ascend = true);
-void compact(std::vector<Tuple>& D, std::vector<int>& M);
-void shuffle(std::vector<Tuple>& X, std::vector<int>& targets, int p, int U, Tuple dummy);
-void shuffle_soda(std::vector<Tuple>& X, std::vector<int>& targets, int p, int U, Tuple dummy);
-void partition(std::vector<Tuple>& X, std::vector<Tuple>& pivots, std::vector<int>& columns, int U, Tuple dummy);
+// rows of a TupleBlock are contiguous, so the values and the dummy flag are swapped in one go
+inline void cswapRow(TupleBlock& X, int i, int j, int cond) {
+    cswapInts(X.row(i), X.row(j), X.stride(), cond);
+}
+
+void sort(TupleBlock& X, const std::vector<int> &columns, bool ascend = true);
+void compact(TupleBlock& D, std::vector<int>& M);
+void shuffle(TupleBlock& X, std::vector<int>& targets, int p, int U, const Tuple& dummy);
+/*
+    First round of a two-round shuffle: like shuffle, but only the first U real tuples of each target are
+    routed. The others are moved to overflow, which gets an extra last column holding their target and
+    is compacted to B rows. Returns how many tuples overflowed; more than B is a failure
+*/
+int shuffle_two_round(TupleBlock& X, std::vector<int>& targets, int p, int U, int B, TupleBlock& overflow, const Tuple& dummy);
+void shuffle_soda(TupleBlock& X, std::vector<int>& targets, int p, int U, const Tuple& dummy);
+/*
+    sorted: Indicate whether the input has been sorted by columns; if so, each output range stays sorted
+*/
+void partition(TupleBlock& X, TupleBlock& pivots, std::vector<int>& columns, int U, const Tuple& dummy, bool sorted = false);
+
+/*
+    Merge consecutive runs of X with the given lengths, each sorted ascending by columns
+*/
+void merge(TupleBlock& X, const std::vector<int>& runs, const std::vector<int>& columns, const Tuple& dummy);
 
 /*
     sorted: Indicate whether the input has been sorted by targets
     Please make sure that dummy tuples are associated with largest targets
 */
-void distribute(std::vector<Tuple>& X, std::vector<int>& targets, bool sorted);
-void distributeByCol(std::vector<Tuple>& X, int col);
+void distribute(TupleBlock& X, std::vector<int>& targets, bool sorted);
+void distributeByCol(TupleBlock& X, int col);
 
 };  // namespace obliv
\ No newline at end of file
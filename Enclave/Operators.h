@@ -18,7 +18,7 @@ class AssociateOperator {
     OperatorList op_id;
     AssociateOperator(){};
     AssociateOperator(std::vector<int> _group_by_columns, int _aggregate_column, int _zero, OperatorList _op_id) : group_by_columns(_group_by_columns), aggregate_column(_aggregate_column), zero(_zero), op_id(_op_id) {}
-    virtual bool apply(Tuple& a, Tuple& b) = 0;  // return whether the operator applied (Tuple b is changed)
+    virtual bool apply(TupleRef a, TupleRef b) = 0;  // return whether the operator applied (row b is changed)
     std::vector<int> group_by_columns;
     int aggregate_column;
 };
@@ -27,7 +27,7 @@ class OperatorAdd : public AssociateOperator {
   public:
     OperatorAdd(std::vector<int> _group_by_columns, int _aggregate_column) : AssociateOperator(_group_by_columns, _aggregate_column, 0, ADD) {}
 
-    bool apply(Tuple& a, Tuple& b) {
+    bool apply(TupleRef a, TupleRef b) {
         int cond = a.equal_in_cols(b, group_by_columns);
         int& b_val = b.data[aggregate_column];
         obliv::cmove(b_val, b_val + a.data[aggregate_column], cond);
@@ -39,7 +39,7 @@ class OperatorMul : public AssociateOperator {
   public:
     OperatorMul(std::vector<int> _group_by_columns, int _aggregate_column) : AssociateOperator(_group_by_columns, _aggregate_column, 1, MUL) {}
 
-    bool apply(Tuple& a, Tuple& b) {
+    bool apply(TupleRef a, TupleRef b) {
         int cond = a.equal_in_cols(b, group_by_columns);
         int& b_val = b.data[aggregate_column];
         obliv::cmove(b_val, b_val * a.data[aggregate_column], cond);
@@ -51,7 +51,7 @@ class OperatorMax : public AssociateOperator {
   public:
     OperatorMax(std::vector<int> _group_by_columns, int _aggregate_column) : AssociateOperator(_group_by_columns, _aggregate_column, INT_MIN, MAX) {}
 
-    bool apply(Tuple& a, Tuple& b) {
+    bool apply(TupleRef a, TupleRef b) {
         int cond = a.equal_in_cols(b, group_by_columns);
         int& b_val = b.data[aggregate_column];
         int a_val = a.data[aggregate_column];
@@ -64,7 +64,7 @@ class OperatorMin : public AssociateOperator {
   public:
     OperatorMin(std::vector<int> _group_by_columns, int _aggregate_column) : AssociateOperator(_group_by_columns, _aggregate_column, INT_MAX, MIN) {}
 
-    bool apply(Tuple& a, Tuple& b) {
+    bool apply(TupleRef a, TupleRef b) {
         int cond = a.equal_in_cols(b, group_by_columns);
         int& b_val = b.data[aggregate_column];
         int a_val = a.data[aggregate_column];
@@ -76,9 +76,9 @@ class OperatorMin : public AssociateOperator {
 // copy the previous tuple to this one if this tuple is non-dummy
 class OperatorCopy : public AssociateOperator {
   public:
-    OperatorCopy() {}
+    OperatorCopy() : AssociateOperator({}, -1, 0, COPY) {}
 
-    bool apply(Tuple& a, Tuple& b) {
+    bool apply(TupleRef a, TupleRef b) {
         obliv::cmove(b, a, b.is_dummy);
         return b.is_dummy;
     }
@@ -0,0 +1,82 @@
+#include "ThreadPool.h"
+#include <sgx_thread.h>
+#include "Enclave.h"
+
+namespace thread_pool {
+
+static sgx_thread_mutex_t pool_mutex = SGX_THREAD_MUTEX_INITIALIZER;
+static sgx_thread_mutex_t submit_mutex = SGX_THREAD_MUTEX_INITIALIZER;
+static sgx_thread_cond_t job_cond = SGX_THREAD_COND_INITIALIZER;
+static sgx_thread_cond_t done_cond = SGX_THREAD_COND_INITIALIZER;
+
+// the current job, all fields are protected by pool_mutex
+static const std::function<void(int)>* job_task = NULL;
+static int job_size = 0;
+static int job_next = 0;
+static int job_done = 0;
+static int num_workers = 0;
+static bool stopping = false;
+
+void worker_loop(int thread_id) {
+    sgx_thread_mutex_lock(&pool_mutex);
+    num_workers++;
+    log_debug("enclave worker %d started", thread_id);
+    while (!stopping) {
+        if (job_next < job_size) {
+            int i = job_next++;
+            const std::function<void(int)>* task = job_task;
+            sgx_thread_mutex_unlock(&pool_mutex);
+            (*task)(i);
+            sgx_thread_mutex_lock(&pool_mutex);
+            if (++job_done == job_size)
+                sgx_thread_cond_signal(&done_cond);
+        } else {
+            sgx_thread_cond_wait(&job_cond, &pool_mutex);
+        }
+    }
+    num_workers--;
+    sgx_thread_mutex_unlock(&pool_mutex);
+}
+
+void stop() {
+    sgx_thread_mutex_lock(&pool_mutex);
+    stopping = true;
+    sgx_thread_cond_broadcast(&job_cond);
+    sgx_thread_mutex_unlock(&pool_mutex);
+}
+
+int concurrency() {
+    sgx_thread_mutex_lock(&pool_mutex);
+    int n = num_workers + 1;
+    sgx_thread_mutex_unlock(&pool_mutex);
+    return n;
+}
+
+void parallel_for(int num_tasks, const std::function<void(int)>& task) {
+    if (num_tasks <= 1 || sgx_thread_mutex_trylock(&submit_mutex) != 0) {
+        for (int i = 0; i < num_tasks; i++)
+            task(i);
+        return;
+    }
+    sgx_thread_mutex_lock(&pool_mutex);
+    job_task = &task;
+    job_size = num_tasks;
+    job_next = 0;
+    job_done = 0;
+    sgx_thread_cond_broadcast(&job_cond);
+    while (job_next < job_size) {
+        int i = job_next++;
+        sgx_thread_mutex_unlock(&pool_mutex);
+        task(i);
+        sgx_thread_mutex_lock(&pool_mutex);
+        job_done++;
+    }
+    while (job_done < job_size)
+        sgx_thread_cond_wait(&done_cond, &pool_mutex);
+    job_task = NULL;
+    job_size = job_next = job_done = 0;
+    sgx_thread_mutex_unlock(&pool_mutex);
+    sgx_thread_mutex_unlock(&submit_mutex);
+}
+
+};  // namespace thread_pool
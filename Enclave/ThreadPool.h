@@ -0,0 +1,24 @@
+#pragma once
+
+#include <functional>
+
+/*
+    Pool of enclave worker threads. Each worker is a host thread that entered the enclave through
+    ecall_thread_pool_worker and stays inside until ecall_thread_pool_stop, so every worker holds one TCS.
+    parallel_for is used by the oblivious primitives to spread the independent compare-exchanges of a
+    stage; the split of the work only depends on public sizes, never on the data.
+*/
+namespace thread_pool {
+
+// body of a worker thread, returns after stop() is called
+void worker_loop(int thread_id);
+void stop();
+
+// number of threads that execute a parallel_for, including the caller
+int concurrency();
+
+// run task(0..num_tasks-1) on the caller and the idle workers, return when all tasks are done.
+// Runs sequentially on the caller if another parallel_for is in flight (e.g. nested calls).
+void parallel_for(int num_tasks, const std::function<void(int)>& task);
+
+};  // namespace thread_pool
@@ -0,0 +1,117 @@
+#include "TupleBlock.h"
+#include <cstring>
+#include "Enclave.h"
+
+Tuple TupleRef::copy() const {
+    std::vector<int> _data(data, data + n);
+    return Tuple(_data, is_dummy);
+}
+
+long long int TupleRef::hash(const std::vector<int>& columns, int seed) const {
+    long long int res = columns.size();
+    for (auto& i : columns)
+        res ^= data[i] + 0x9e3779b99e3779b9 + (res << 6) + (res >> 2);
+    res ^= seed + 0x9e3779b99e3779b9 + (res << 6) + (res >> 2);
+    return res;
+}
+
+int TupleRef::equal_in_cols(const TupleRef& tup, const std::vector<int>& columns) const {
+    int ret = true;
+    for (int i : columns)
+        ret &= data[i] == tup.data[i];
+    return ret;
+}
+
+void TupleBlock::reserve(int n) {
+    m_data.reserve((size_t)n * stride());
+}
+
+void TupleBlock::clear() {
+    m_data.clear();
+    m_size = 0;
+}
+
+void TupleBlock::resize(int n) {
+    m_data.resize((size_t)n * stride(), 0);
+    m_size = n;
+}
+
+void TupleBlock::resize(int n, const Tuple& fill) {
+    if (fill.size() != m_num_columns)
+        log_error("Error: fill row has %d columns, block has %d", fill.size(), m_num_columns);
+    int old_size = m_size;
+    resize(n);
+    for (int i = old_size; i < n; i++) {
+        int* r = row(i);
+        memcpy(r, fill.data.data(), m_num_columns * sizeof(int));
+        r[m_num_columns] = fill.is_dummy;
+    }
+}
+
+void TupleBlock::push_back(const TupleRef& t) {
+    if (t.size() != m_num_columns)
+        log_error("Error: row has %d columns, block has %d", t.size(), m_num_columns);
+    m_data.insert(m_data.end(), t.data, t.data + m_num_columns);
+    m_data.push_back(t.is_dummy);
+    m_size++;
+}
+
+void TupleBlock::push_back(const Tuple& t) {
+    if (t.size() != m_num_columns)
+        log_error("Error: row has %d columns, block has %d", t.size(), m_num_columns);
+    m_data.insert(m_data.end(), t.data.begin(), t.data.end());
+    m_data.push_back(t.is_dummy);
+    m_size++;
+}
+
+void TupleBlock::append(const TupleBlock& other, int begin, int end) {
+    if (other.m_num_columns != m_num_columns)
+        log_error("Error: appending rows of %d columns to a block of %d", other.m_num_columns, m_num_columns);
+    m_data.insert(m_data.end(), other.m_data.begin() + (size_t)begin * stride(), other.m_data.begin() + (size_t)end * stride());
+    m_size += end - begin;
+}
+
+int TupleBlock::append(const char* buffer, size_t length) {
+    size_t row_length = Tuple::rowLength(m_num_columns);
+    if (length % row_length != 0) {
+        log_error("Error: %llu can not be divided by row_length %llu", length, row_length);
+    }
+    int rows = length / row_length;
+    if (rows == 0)
+        return 0;
+    m_data.resize((size_t)(m_size + rows) * stride());
+    memcpy(row(m_size), buffer, (size_t)rows * row_length);
+    m_size += rows;
+    return rows;
+}
+
+void TupleBlock::swap(TupleBlock& other) {
+    std::swap(m_num_columns, other.m_num_columns);
+    std::swap(m_size, other.m_size);
+    m_data.swap(other.m_data);
+}
+
+void TupleBlock::reshape(const std::vector<int>& columns, int fill) {
+    reshape(columns, std::vector<int>(columns.size(), fill));
+}
+
+void TupleBlock::reshape(const std::vector<int>& columns, const std::vector<int>& fills) {
+    int new_columns = columns.size();
+    std::vector<int> new_data((size_t)m_size * (new_columns + 1));
+    for (int i = 0; i < m_size; i++) {
+        const int* src = row(i);
+        int* dst = &new_data[(size_t)i * (new_columns + 1)];
+        for (int j = 0; j < new_columns; j++)
+            dst[j] = columns[j] < 0 ? fills[j] : src[columns[j]];
+        dst[new_columns] = src[m_num_columns];
+    }
+    m_data.swap(new_data);
+    m_num_columns = new_columns;
+}
+
+void TupleBlock::resizeColumns(int num_columns) {
+    std::vector<int> columns(num_columns);
+    for (int j = 0; j < num_columns; j++)
+        columns[j] = j < m_num_columns ? j : -1;
+    reshape(columns);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Tuple.h"
+
+/*
+    View of one row: num_columns values followed by the dummy flag. It points either into a TupleBlock
+    or at a standalone Tuple, and keeps the member names of Tuple so row code works on both.
+*/
+class TupleRef {
+  public:
+    int* data;
+    int& is_dummy;
+
+    TupleRef(int* row, int num_columns) : data(row), is_dummy(row[num_columns]), n(num_columns) {}
+    TupleRef(Tuple& t) : data(t.data.data()), is_dummy(t.is_dummy), n(t.size()) {}
+
+    inline int size() const { return n; }
+
+    // owned copy of the row
+    Tuple copy() const;
+
+    long long int hash(const std::vector<int>& columns, int seed = 0) const;
+    /* return whether the two tuples equal in input columns. Ignore dummy. */
+    int equal_in_cols(const TupleRef& tup, const std::vector<int>& columns) const;
+    /* return whether the first tuple less than the second in input columns */
+    // dummy > non-dummy; inline since it is the comparison of the sorting networks
+    inline int less_in_cols(const TupleRef& tup, const std::vector<int>& columns) const {
+        int ret = (!is_dummy) & tup.is_dummy;
+        int all_eq = !(is_dummy ^ tup.is_dummy);
+        for (auto col : columns) {
+            ret |= all_eq & (data[col] < tup.data[col]);
+            all_eq &= data[col] == tup.data[col];
+        }
+        return ret;
+    }
+
+  private:
+    int n;
+};
+
+/*
+    Rows of a table stored back to back in one arena with a stride of num_columns + 1 ints: the values
+    of a row followed by its is_dummy flag. This is the serialized row format, so reading rows from a
+    file and writing them out are plain memcpys, and swapping two rows touches one contiguous range.
+    Row views are invalidated by anything that reallocates the arena (resize, push_back, append, ...).
+*/
+class TupleBlock {
+  public:
+    class iterator {
+      public:
+        iterator(int* row, int num_columns) : row(row), num_columns(num_columns) {}
+        TupleRef operator*() const { return TupleRef(row, num_columns); }
+        iterator& operator++() {
+            row += num_columns + 1;
+            return *this;
+        }
+        bool operator!=(const iterator& other) const { return row != other.row; }
+
+      private:
+        int* row;
+        int num_columns;
+    };
+
+    explicit TupleBlock(int num_columns = 0) : m_num_columns(num_columns) {}
+
+    inline int size() const { return m_size; }
+    inline int num_columns() const { return m_num_columns; }
+    inline int stride() const { return m_num_columns + 1; }
+
+    inline int* row(int i) { return &m_data[(size_t)i * stride()]; }
+    inline const int* row(int i) const { return &m_data[(size_t)i * stride()]; }
+    inline TupleRef operator[](int i) { return TupleRef(row(i), m_num_columns); }
+
+    iterator begin() { return iterator(m_data.data(), m_num_columns); }
+    iterator end() { return iterator(m_data.data() + (size_t)m_size * stride(), m_num_columns); }
+
+    // raw rows [begin, end) in the serialized format
+    inline const char* bytes(int begin = 0) const { return (const char*)(m_data.data() + (size_t)begin * stride()); }
+    inline size_t byteLength(int begin, int end) const { return (size_t)(end - begin) * stride() * sizeof(int); }
+
+    void reserve(int n);
+    void clear();
+    // new rows are all zero and non-dummy
+    void resize(int n);
+    // new rows are copies of fill
+    void resize(int n, const Tuple& fill);
+    void push_back(const TupleRef& t);
+    void push_back(const Tuple& t);
+    // append rows [begin, end) of other, which must have the same number of columns
+    void append(const TupleBlock& other, int begin, int end);
+    // append length bytes of serialized rows; returns the number of rows appended
+    int append(const char* buffer, size_t length);
+    void swap(TupleBlock& other);
+
+    // rebuild every row from the columns of the old one: new column j is old column columns[j], or
+    // fill if columns[j] < 0. The dummy flags are kept.
+    void reshape(const std::vector<int>& columns, int fill = 0);
+    // the same with a fill value per column, fills[j] for new column j
+    void reshape(const std::vector<int>& columns, const std::vector<int>& fills);
+    // keep the first num_columns columns of every row; new columns are zero
+    void resizeColumns(int num_columns);
+
+  private:
+    int m_num_columns;
+    int m_size = 0;
+    std::vector<int> m_data;
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include "CSwapKernels.h"
+#include "TupleBlock.h"
+
+/*
+    Row operations of TupleRef (less_in_cols, equal_in_cols, hash) plus the row swap, specialized for
+    KeyCols key columns and rows of RowWidth values followed by the dummy flag. The key column indices
+    live in a fixed array and both counts are compile-time constants, so every loop unrolls and the
+    per-comparison walk over a std::vector<int> of columns disappears.
+
+    Operators pick the kernel once with dispatchKernel and run their inner loop in a functor templated
+    on it. Shapes outside the instantiated range get GenericKernel, which has the same interface and
+    the runtime loops of TupleRef, so results never depend on which kernel ran.
+*/
+
+const int KERNEL_MAX_KEY_COLS = 3;
+const int KERNEL_MIN_ROW_WIDTH = 2;
+const int KERNEL_MAX_ROW_WIDTH = 6;
+
+template <int KeyCols, int RowWidth>
+class TupleKernel {
+  public:
+    explicit TupleKernel(const std::vector<int>& columns) {
+        for (int c = 0; c < KeyCols; c++)
+            cols[c] = columns[c];
+    }
+
+    inline int less(const int* a, const int* b) const {
+        int ret = (!a[RowWidth]) & b[RowWidth];
+        int all_eq = !(a[RowWidth] ^ b[RowWidth]);
+        for (int c = 0; c < KeyCols; c++) {
+            ret |= all_eq & (a[cols[c]] < b[cols[c]]);
+            all_eq &= a[cols[c]] == b[cols[c]];
+        }
+        return ret;
+    }
+
+    inline int equal(const int* a, const int* b) const {
+        int ret = true;
+        for (int c = 0; c < KeyCols; c++)
+            ret &= a[cols[c]] == b[cols[c]];
+        return ret;
+    }
+
+    inline long long int hash(const int* a, int seed) const {
+        long long int res = KeyCols;
+        for (int c = 0; c < KeyCols; c++)
+            res ^= a[cols[c]] + 0x9e3779b99e3779b9 + (res << 6) + (res >> 2);
+        res ^= seed + 0x9e3779b99e3779b9 + (res << 6) + (res >> 2);
+        return res;
+    }
+
+    // swap the values and the dummy flag of two rows if cond; the length is a constant here, so the
+    // vector kernels cswapInts picks reduce to straight-line code
+    inline void cswap(int* a, int* b, int cond) const {
+        obliv::cswapInts(a, b, RowWidth + 1, cond);
+    }
+
+  private:
+    int cols[KeyCols];
+};
+
+class GenericKernel {
+  public:
+    GenericKernel(const std::vector<int>& columns, int num_columns) : cols(columns), n(num_columns) {}
+
+    inline int less(const int* a, const int* b) const {
+        return TupleRef(const_cast<int*>(a), n).less_in_cols(TupleRef(const_cast<int*>(b), n), cols);
+    }
+
+    inline int equal(const int* a, const int* b) const {
+        return TupleRef(const_cast<int*>(a), n).equal_in_cols(TupleRef(const_cast<int*>(b), n), cols);
+    }
+
+    inline long long int hash(const int* a, int seed) const {
+        return TupleRef(const_cast<int*>(a), n).hash(cols, seed);
+    }
+
+    inline void cswap(int* a, int* b, int cond) const {
+        obliv::cswapInts(a, b, n + 1, cond);
+    }
+
+  private:
+    const std::vector<int>& cols;
+    int n;
+};
+
+// walks (KeyCols, RowWidth) over the instantiated shapes until it matches
+template <int KeyCols, int RowWidth>
+struct KernelDispatch {
+    template <typename F>
+    static void run(const std::vector<int>& columns, int num_columns, F& f) {
+        if ((int)columns.size() == KeyCols && num_columns == RowWidth) {
+            f(TupleKernel<KeyCols, RowWidth>(columns));
+            return;
+        }
+        KernelDispatch<KeyCols, RowWidth + 1>::run(columns, num_columns, f);
+    }
+};
+
+template <int KeyCols>
+struct KernelDispatch<KeyCols, KERNEL_MAX_ROW_WIDTH + 1> {
+    template <typename F>
+    static void run(const std::vector<int>& columns, int num_columns, F& f) {
+        const int next = KeyCols + 1;
+        KernelDispatch<next, (next < KERNEL_MIN_ROW_WIDTH ? KERNEL_MIN_ROW_WIDTH : next)>::run(columns, num_columns, f);
+    }
+};
+
+template <int RowWidth>
+struct KernelDispatch<KERNEL_MAX_KEY_COLS + 1, RowWidth> {
+    template <typename F>
+    static void run(const std::vector<int>& columns, int num_columns, F& f) {
+        f(GenericKernel(columns, num_columns));
+    }
+};
+
+// call f(kernel) with the kernel for columns.size() key columns and num_columns values per row
+template <typename F>
+void dispatchKernel(const std::vector<int>& columns, int num_columns, F& f) {
+    if (columns.empty() || (int)columns.size() > KERNEL_MAX_KEY_COLS || num_columns < KERNEL_MIN_ROW_WIDTH ||
+        num_columns > KERNEL_MAX_ROW_WIDTH) {
+        f(GenericKernel(columns, num_columns));
+        return;
+    }
+    KernelDispatch<1, KERNEL_MIN_ROW_WIDTH>::run(columns, num_columns, f);
+}